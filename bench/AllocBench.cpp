@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "AllocBench.hpp"
+#include "RamDevice.hpp"
+#include "../driver/fat16.h"
+
+#define SECTOR_COUNT        (40000)
+#define CLUSTER_SIZE        (512)
+#define STEP_COUNT          (20)
+
+AllocBench::AllocBench():
+Benchmark("AllocBench")
+{
+}
+
+bool AllocBench::run()
+{
+    RamDevice dev(SECTOR_COUNT, CLUSTER_SIZE / 512);
+    std::vector<char> cluster(CLUSTER_SIZE, 'x');
+
+    if (fat16_init_block(dev.get_block_dev(), 0) < 0)
+        return false;
+
+    /* Leave holes at the beginning of the data region */
+    for (unsigned int i = 0; i < 100; ++i) {
+        std::string filename = "F" + std::to_string(i) + ".BIN";
+        int fd = fat16_open(filename.c_str(), 'w');
+        if (fd < 0)
+            return false;
+        for (unsigned int j = 0; j < 4; ++j) {
+            if (fat16_write(fd, &cluster[0], cluster.size()) != (int)cluster.size())
+                return false;
+        }
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+    for (unsigned int i = 0; i < 100; i += 2) {
+        std::string filename = "F" + std::to_string(i) + ".BIN";
+        if (fat16_rm(filename.c_str()) < 0)
+            return false;
+    }
+
+    /* Fill the volume one cluster at a time */
+    int fd = fat16_open("FILL.BIN", 'w');
+    if (fd < 0)
+        return false;
+
+    const unsigned int step = SECTOR_COUNT / STEP_COUNT / (CLUSTER_SIZE / 512);
+    unsigned int allocation_count = 0;
+    bool is_full = false;
+
+    printf("%8s %12s %20s\n", "fill", "us/alloc", "sectors read/alloc");
+    while (!is_full) {
+        unsigned int count = 0;
+
+        dev.reset_counters();
+        auto start = std::chrono::steady_clock::now();
+        for (; count < step; ++count) {
+            if (fat16_write(fd, &cluster[0], cluster.size()) != (int)cluster.size()) {
+                is_full = true;
+                break;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        if (count == 0)
+            break;
+
+        allocation_count += count;
+        double us = std::chrono::duration<double, std::micro>(end - start).count();
+        printf("%7u%% %12.2f %20.2f\n",
+               (allocation_count * 100) / (SECTOR_COUNT / (CLUSTER_SIZE / 512)),
+               us / count,
+               (double)dev.get_sectors_read() / count);
+    }
+
+    return fat16_close(fd) == 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "BatchBench.hpp"
+#include "RamDevice.hpp"
+#include "../driver/fat16.h"
+#include "../test/linux_hal.h"
+
+#define SECTOR_COUNT        (40000)
+#define CLUSTER_SIZE        (2048)
+#define FILE_SIZE           (4LU * 1024 * 1024)
+#define WRITE_CHUNK_SIZE    (2 * CLUSTER_SIZE)
+#define READ_CHUNK_SIZE     (64 * 1024)
+
+namespace {
+    const char *image_path = "/tmp/fat16_batch_bench.img";
+
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    double elapsed(time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /*
+     * Write two files in alternating chunks so that their clusters are
+     * interleaved: each large read then spans many short runs.
+     */
+    bool write_interleaved_files()
+    {
+        std::vector<char> chunk(WRITE_CHUNK_SIZE, 'x');
+        int a = fat16_open("A.BIN", 'w');
+        int b = fat16_open("B.BIN", 'w');
+        if (a < 0 || b < 0)
+            return false;
+
+        for (uint32_t i = 0; i < FILE_SIZE / WRITE_CHUNK_SIZE; ++i) {
+            if (fat16_write(a, &chunk[0], chunk.size()) != (int)chunk.size()
+            ||  fat16_write(b, &chunk[0], chunk.size()) != (int)chunk.size())
+                return false;
+        }
+
+        return fat16_close(a) == 0 && fat16_close(b) == 0;
+    }
+
+    bool read_fragmented_file()
+    {
+        std::vector<char> chunk(READ_CHUNK_SIZE);
+        int fd = fat16_open("A.BIN", 'r');
+        if (fd < 0)
+            return false;
+
+        for (uint32_t i = 0; i < FILE_SIZE / READ_CHUNK_SIZE; ++i) {
+            if (fat16_read(fd, &chunk[0], chunk.size()) != (int)chunk.size())
+                return false;
+        }
+
+        return fat16_close(fd) == 0;
+    }
+}
+
+BatchBench::BatchBench():
+Benchmark("BatchBench")
+{
+}
+
+bool BatchBench::run()
+{
+    const char *names[] = { "sequential", "io_uring", "thread pool" };
+    bool ret = true;
+
+    {
+        RamDevice dev(SECTOR_COUNT, CLUSTER_SIZE / 512);
+        if (!dev.save(image_path))
+            return false;
+    }
+
+    if (linux_load_image(image_path) < 0
+    ||  fat16_init(linux_dev, 0) < 0
+    ||  !write_interleaved_files()
+    ||  linux_release_image() < 0)
+        return false;
+
+    printf("%-16s %14s\n", "device", "frag read MB/s");
+    for (int device = 0; device < 3 && ret; ++device) {
+        /* Compare submission strategies, not durability */
+        struct block_dev_t dev = linux_uring_dev;
+        dev.sync = NULL;
+        if (device == 0)
+            dev.submit_batch = NULL;
+
+        if (linux_uring_open_image(image_path, device == 1) < 0)
+            return false;
+
+        if (device == 1 && !linux_uring_is_active()) {
+            printf("%-16s %14s\n", names[device], "unavailable");
+            linux_uring_close_image();
+            continue;
+        }
+
+        if (fat16_init_block(dev, 0) < 0)
+            return false;
+
+        time_point start = std::chrono::steady_clock::now();
+        ret = read_fragmented_file();
+        double read_time = elapsed(start);
+
+        linux_uring_close_image();
+
+        if (ret)
+            printf("%-16s %14.1f\n", names[device], FILE_SIZE / read_time / 1e6);
+    }
+
+    remove(image_path);
+
+    return ret;
+}
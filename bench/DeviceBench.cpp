@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "DeviceBench.hpp"
+#include "RamDevice.hpp"
+#include "../driver/fat16.h"
+#include "../test/linux_hal.h"
+
+#define SECTOR_COUNT        (40000)
+#define CLUSTER_SIZE        (2048)
+#define FILE_SIZE           (8LU * 1024 * 1024)
+#define CHUNK_SIZE          (4096)
+#define SMALL_FILE_COUNT    (100)
+
+namespace {
+    const char *image_path = "/tmp/fat16_bench.img";
+
+    typedef std::chrono::steady_clock::time_point time_point;
+
+    double elapsed(time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool write_large_file()
+    {
+        std::vector<char> chunk(CHUNK_SIZE, 'x');
+        int fd = fat16_open("DATA.BIN", 'w');
+        if (fd < 0)
+            return false;
+
+        for (uint32_t i = 0; i < FILE_SIZE / CHUNK_SIZE; ++i) {
+            if (fat16_write(fd, &chunk[0], chunk.size()) != (int)chunk.size())
+                return false;
+        }
+
+        return fat16_close(fd) == 0;
+    }
+
+    bool read_large_file()
+    {
+        std::vector<char> chunk(CHUNK_SIZE);
+        int fd = fat16_open("DATA.BIN", 'r');
+        if (fd < 0)
+            return false;
+
+        for (uint32_t i = 0; i < FILE_SIZE / CHUNK_SIZE; ++i) {
+            if (fat16_read(fd, &chunk[0], chunk.size()) != (int)chunk.size())
+                return false;
+        }
+
+        return fat16_close(fd) == 0;
+    }
+
+    bool write_small_files()
+    {
+        char content[100] = { 0 };
+
+        if (fat16_mkdir("/SMALL") < 0)
+            return false;
+
+        for (unsigned int i = 0; i < SMALL_FILE_COUNT; ++i) {
+            std::string filename = "/SMALL/F" + std::to_string(i) + ".TXT";
+            int fd = fat16_open(filename.c_str(), 'w');
+            if (fd < 0)
+                return false;
+            if (fat16_write(fd, content, sizeof(content)) != sizeof(content))
+                return false;
+            if (fat16_close(fd) < 0)
+                return false;
+        }
+
+        return true;
+    }
+}
+
+DeviceBench::DeviceBench():
+Benchmark("DeviceBench")
+{
+}
+
+bool DeviceBench::run()
+{
+    /* stdio only flushes libc buffers, msync also waits for the disk */
+    const char *names[] = { "stdio", "mmap", "mmap (no msync)" };
+    bool ret = true;
+
+    printf("%-16s %14s %14s %14s\n", "device", "write MB/s", "read MB/s", "small files/s");
+    for (int device = 0; device < 3 && ret; ++device) {
+        bool is_mapped = device > 0;
+        double write_time, read_time, small_files_time;
+
+        {
+            RamDevice dev(SECTOR_COUNT, CLUSTER_SIZE / 512);
+            if (!dev.save(image_path))
+                return false;
+        }
+
+        if (is_mapped) {
+            struct block_dev_t dev = linux_mapped_dev;
+            if (device == 2)
+                dev.sync = NULL;
+
+            if (linux_map_image(image_path) < 0
+            ||  fat16_init_block(dev, 0) < 0)
+                return false;
+        } else {
+            if (linux_load_image(image_path) < 0
+            ||  fat16_init(linux_dev, 0) < 0)
+                return false;
+        }
+
+        time_point start = std::chrono::steady_clock::now();
+        ret = write_large_file();
+        write_time = elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        ret = ret && read_large_file();
+        read_time = elapsed(start);
+
+        start = std::chrono::steady_clock::now();
+        ret = ret && write_small_files();
+        small_files_time = elapsed(start);
+
+        if (is_mapped)
+            linux_unmap_image();
+        else
+            linux_release_image();
+
+        if (ret)
+            printf("%-16s %14.1f %14.1f %14.1f\n", names[device],
+                   FILE_SIZE / write_time / 1e6,
+                   FILE_SIZE / read_time / 1e6,
+                   SMALL_FILE_COUNT / small_files_time);
+    }
+
+    remove(image_path);
+
+    return ret;
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include "RamDevice.hpp"
+
+#define SECTOR_SIZE         (512)
+#define ROOT_ENTRY_COUNT    (512)
+
+RamDevice::RamDevice(uint32_t sector_count, uint8_t sectors_per_cluster):
+m_data(sector_count * SECTOR_SIZE),
+m_sectors_read(0),
+m_sectors_written(0),
+m_request_count(0)
+{
+    format(sectors_per_cluster);
+}
+
+struct block_dev_t RamDevice::get_block_dev(bool is_mapped)
+{
+    struct block_dev_t dev;
+
+    dev.sector_size = SECTOR_SIZE;
+    dev.read_sectors = RamDevice::read_sectors;
+    dev.write_sectors = RamDevice::write_sectors;
+    dev.map_sectors = is_mapped ? RamDevice::map_sectors : nullptr;
+    dev.sync = nullptr;
+    dev.submit_batch = nullptr;
+    dev.start_batch = nullptr;
+    dev.poll_batch = nullptr;
+    dev.context = this;
+    return dev;
+}
+
+bool RamDevice::save(const std::string &path) const
+{
+    std::ofstream file(path, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(m_data.data()), m_data.size());
+    return file.good();
+}
+
+void RamDevice::reset_counters()
+{
+    m_sectors_read = 0;
+    m_sectors_written = 0;
+    m_request_count = 0;
+}
+
+uint64_t RamDevice::get_sectors_read() const
+{
+    return m_sectors_read;
+}
+
+uint64_t RamDevice::get_sectors_written() const
+{
+    return m_sectors_written;
+}
+
+uint64_t RamDevice::get_request_count() const
+{
+    return m_request_count;
+}
+
+int RamDevice::read_sectors(void *context, uint32_t lba, uint32_t count, void *buffer)
+{
+    RamDevice *device = static_cast<RamDevice *>(context);
+
+    if ((uint64_t)(lba + count) * SECTOR_SIZE > device->m_data.size())
+        return -1;
+
+    memcpy(buffer, &device->m_data[lba * SECTOR_SIZE], count * SECTOR_SIZE);
+    device->m_sectors_read += count;
+    ++device->m_request_count;
+    return 0;
+}
+
+int RamDevice::write_sectors(void *context, uint32_t lba, uint32_t count, const void *buffer)
+{
+    RamDevice *device = static_cast<RamDevice *>(context);
+
+    if ((uint64_t)(lba + count) * SECTOR_SIZE > device->m_data.size())
+        return -1;
+
+    memcpy(&device->m_data[lba * SECTOR_SIZE], buffer, count * SECTOR_SIZE);
+    device->m_sectors_written += count;
+    ++device->m_request_count;
+    return 0;
+}
+
+const void *RamDevice::map_sectors(void *context, uint32_t lba, uint32_t count)
+{
+    RamDevice *device = static_cast<RamDevice *>(context);
+
+    if ((uint64_t)(lba + count) * SECTOR_SIZE > device->m_data.size())
+        return nullptr;
+
+    return &device->m_data[lba * SECTOR_SIZE];
+}
+
+namespace {
+    template<typename T>
+    void put(std::vector<uint8_t> &data, unsigned int pos, T value)
+    {
+        for (unsigned int i = 0; i < sizeof(T); ++i)
+            data[pos + i] = (value >> (8 * i)) & 0xFF;
+    }
+}
+
+void RamDevice::format(uint8_t sectors_per_cluster)
+{
+    uint32_t sector_count = m_data.size() / SECTOR_SIZE;
+    uint16_t fat_size = ((sector_count / sectors_per_cluster) * 2 + SECTOR_SIZE - 1) / SECTOR_SIZE;
+
+    std::fill(m_data.begin(), m_data.end(), 0);
+
+    /* Boot sector */
+    m_data[0] = 0xEB;
+    m_data[1] = 0x3C;
+    m_data[2] = 0x90;
+    memcpy(&m_data[3], "RAMDEV  ", 8);
+    put<uint16_t>(m_data, 11, SECTOR_SIZE);
+    m_data[13] = sectors_per_cluster;
+    put<uint16_t>(m_data, 14, 1);
+    m_data[16] = 2;
+    put<uint16_t>(m_data, 17, ROOT_ENTRY_COUNT);
+    if (sector_count < 65536)
+        put<uint16_t>(m_data, 19, sector_count);
+    else
+        put<uint32_t>(m_data, 32, sector_count);
+    m_data[21] = 0xF8;
+    put<uint16_t>(m_data, 22, fat_size);
+    m_data[38] = 0x29;
+    memcpy(&m_data[43], "NO NAME    ", 11);
+    memcpy(&m_data[54], "FAT16   ", 8);
+    m_data[510] = 0x55;
+    m_data[511] = 0xAA;
+
+    /* Reserved entries of both FATs */
+    for (unsigned int i = 0; i < 2; ++i) {
+        unsigned int fat = SECTOR_SIZE + i * fat_size * SECTOR_SIZE;
+        put<uint16_t>(m_data, fat, 0xFFF8);
+        put<uint16_t>(m_data, fat + 2, 0xFFFF);
+    }
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _RAMDEVICE_HPP_
+#define _RAMDEVICE_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../driver/fat16.h"
+
+/**
+ * Block device backed by memory, formatted as an empty FAT16 volume.
+ *
+ * The device is passed as context of the callbacks, so that several
+ * RamDevice can be mounted at the same time.
+ */
+class RamDevice
+{
+    public :
+
+        RamDevice(uint32_t sector_count, uint8_t sectors_per_cluster);
+
+        /**
+         * @brief Get the block device
+         *
+         * @param[in] is_mapped If true, the driver can access sectors in memory
+         * @return Block device
+         */
+        struct block_dev_t get_block_dev(bool is_mapped = false);
+
+        /**
+         * @brief Write the content of the device to a file
+         *
+         * @param[in] path
+         * @return False if the file could not be written
+         */
+        bool save(const std::string &path) const;
+
+        void reset_counters();
+        uint64_t get_sectors_read() const;
+        uint64_t get_sectors_written() const;
+        uint64_t get_request_count() const;
+
+    private :
+
+        static int read_sectors(void *context, uint32_t lba, uint32_t count, void *buffer);
+        static int write_sectors(void *context, uint32_t lba, uint32_t count, const void *buffer);
+        static const void *map_sectors(void *context, uint32_t lba, uint32_t count);
+
+        void format(uint8_t sectors_per_cluster);
+
+        std::vector<uint8_t> m_data;
+        uint64_t m_sectors_read;
+        uint64_t m_sectors_written;
+        uint64_t m_request_count;
+};
+
+#endif
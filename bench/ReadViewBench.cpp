@@ -0,0 +1,135 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "ReadViewBench.hpp"
+#include "RamDevice.hpp"
+#include "../driver/fat16.h"
+
+#define SECTOR_COUNT        (40000)
+#define CLUSTER_SIZE        (2048)
+#define FILE_SIZE           (16LU * 1024 * 1024)
+#define CHUNK_SIZE          (4096)
+
+namespace {
+    enum Method {
+        READ,
+        VIEW,
+        MAPPED_VIEW
+    };
+
+    bool read_file(enum Method method, uint32_t &checksum)
+    {
+        int fd = fat16_open("DATA.BIN", 'r');
+        if (fd < 0)
+            return false;
+
+        std::vector<uint8_t> buffer(CHUNK_SIZE);
+        checksum = 0;
+        while (1) {
+            const uint8_t *data;
+            uint32_t count;
+
+            if (method == READ) {
+                int ret = fat16_read(fd, &buffer[0], buffer.size());
+                if (ret < 0)
+                    return false;
+                data = &buffer[0];
+                count = ret;
+            } else {
+                const void *view;
+                if (fat16_read_view(fd, CHUNK_SIZE, &view, &count) < 0)
+                    return false;
+                data = static_cast<const uint8_t *>(view);
+            }
+
+            if (count == 0)
+                break;
+
+            /* Touch every byte, as a parser would */
+            for (uint32_t i = 0; i < count; ++i)
+                checksum += data[i];
+
+            if (method != READ && fat16_release_view(data) < 0)
+                return false;
+        }
+
+        return fat16_close(fd) == 0;
+    }
+}
+
+ReadViewBench::ReadViewBench():
+Benchmark("ReadViewBench")
+{
+}
+
+bool ReadViewBench::run()
+{
+    RamDevice dev(SECTOR_COUNT, CLUSTER_SIZE / 512);
+
+    if (fat16_init_block(dev.get_block_dev(), 0) < 0)
+        return false;
+
+    {
+        std::vector<uint8_t> chunk(CHUNK_SIZE);
+        int fd = fat16_open("DATA.BIN", 'w');
+        if (fd < 0)
+            return false;
+
+        for (uint32_t i = 0; i < FILE_SIZE / CHUNK_SIZE; ++i) {
+            for (uint32_t j = 0; j < chunk.size(); ++j)
+                chunk[j] = i + j;
+            if (fat16_write(fd, &chunk[0], chunk.size()) != (int)chunk.size())
+                return false;
+        }
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    const char *names[] = { "fat16_read", "fat16_read_view", "fat16_read_view (mapped)" };
+    uint32_t expected_checksum = 0;
+
+    printf("%-26s %10s %14s\n", "method", "MB/s", "sectors read");
+    for (int method = READ; method <= MAPPED_VIEW; ++method) {
+        uint32_t checksum;
+
+        if (fat16_init_block(dev.get_block_dev(method == MAPPED_VIEW), 0) < 0)
+            return false;
+
+        dev.reset_counters();
+        auto start = std::chrono::steady_clock::now();
+        if (!read_file(static_cast<enum Method>(method), checksum))
+            return false;
+        auto end = std::chrono::steady_clock::now();
+
+        if (method == READ)
+            expected_checksum = checksum;
+        else if (checksum != expected_checksum)
+            return false;
+
+        double s = std::chrono::duration<double>(end - start).count();
+        printf("%-26s %10.1f %14llu\n", names[method], FILE_SIZE / s / 1e6,
+               (unsigned long long)dev.get_sectors_read());
+    }
+
+    return true;
+}
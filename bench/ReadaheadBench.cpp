@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include "ReadaheadBench.hpp"
+#include "RamDevice.hpp"
+#include "../driver/fat16.h"
+
+#define SECTOR_COUNT        (40000)
+#define CLUSTER_SIZE        (2048)
+#define FILE_SIZE           (2LU * 1024 * 1024)
+#define READ_SIZE           (256)
+
+namespace {
+    bool read_file(bool is_sequential)
+    {
+        std::vector<uint8_t> buffer(READ_SIZE);
+        int fd = fat16_open("DATA.BIN", 'r');
+        if (fd < 0)
+            return false;
+
+        srand(0);
+        for (uint32_t i = 0; i < FILE_SIZE / READ_SIZE; ++i) {
+            if (!is_sequential) {
+                int32_t position = (rand() % (FILE_SIZE / READ_SIZE)) * READ_SIZE;
+                if (fat16_seek(fd, position, FAT16_SEEK_SET) != position)
+                    return false;
+            }
+
+            if (fat16_read(fd, &buffer[0], buffer.size()) != (int)buffer.size())
+                return false;
+        }
+
+        return fat16_close(fd) == 0;
+    }
+}
+
+ReadaheadBench::ReadaheadBench():
+Benchmark("ReadaheadBench")
+{
+}
+
+bool ReadaheadBench::run()
+{
+    RamDevice dev(SECTOR_COUNT, CLUSTER_SIZE / 512);
+
+    if (fat16_init_block(dev.get_block_dev(), 0) < 0)
+        return false;
+
+    {
+        std::vector<uint8_t> chunk(CLUSTER_SIZE, 'x');
+        int fd = fat16_open("DATA.BIN", 'w');
+        if (fd < 0)
+            return false;
+
+        for (uint32_t i = 0; i < FILE_SIZE / CLUSTER_SIZE; ++i) {
+            if (fat16_write(fd, &chunk[0], chunk.size()) != (int)chunk.size())
+                return false;
+        }
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    const char *names[] = { "random", "sequential" };
+
+    printf("%-16s %10s %14s %14s\n", "access", "MB/s", "requests", "sectors read");
+    for (int is_sequential = 0; is_sequential < 2; ++is_sequential) {
+        dev.reset_counters();
+        auto start = std::chrono::steady_clock::now();
+        if (!read_file(is_sequential))
+            return false;
+        auto end = std::chrono::steady_clock::now();
+
+        double s = std::chrono::duration<double>(end - start).count();
+        printf("%-16s %10.1f %14llu %14llu\n", names[is_sequential], FILE_SIZE / s / 1e6,
+               (unsigned long long)dev.get_request_count(),
+               (unsigned long long)dev.get_sectors_read());
+    }
+
+    return true;
+}
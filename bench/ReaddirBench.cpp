@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include "ReaddirBench.hpp"
+#include "RamDevice.hpp"
+#include "../driver/fat16.h"
+
+#define SECTOR_COUNT        (40000)
+#define CLUSTER_SIZE        (2048)
+#define FILE_COUNT          (2048)
+
+namespace {
+    enum Method {
+        LS,
+        READDIR,
+        READDIR_OPEN,
+        READDIR_BATCH
+    };
+
+    /* Get the size of a file, as an indexer would */
+    bool get_size(const char *filename, uint32_t &size)
+    {
+        std::string path = std::string("/DATA/") + filename;
+        int fd = fat16_open(path.c_str(), 'r');
+        if (fd < 0)
+            return false;
+
+        int32_t end = fat16_seek(fd, 0, FAT16_SEEK_END);
+        if (end < 0)
+            return false;
+        size = end;
+
+        return fat16_close(fd) == 0;
+    }
+
+    bool list_directory(enum Method method, unsigned int &count)
+    {
+        char filename[13];
+        int ret;
+
+        count = 0;
+        if (method == LS) {
+            uint32_t i = 0;
+            while ((ret = fat16_ls(&i, filename, "/DATA")) == 1)
+                ++count;
+            return ret == 0;
+        }
+
+        int dir = fat16_opendir("/DATA");
+        if (dir < 0)
+            return false;
+
+        if (method == READDIR_BATCH) {
+            struct fat16_dirent entries[16];
+            while ((ret = fat16_readdir_batch(dir, entries, 16, FAT16_SKIP_DIRECTORIES)) > 0)
+                count += ret;
+        } else {
+            while ((ret = fat16_readdir(dir, filename)) == 1) {
+                uint32_t size;
+                if (method == READDIR_OPEN && filename[0] == '.')
+                    continue;
+                if (method == READDIR_OPEN && !get_size(filename, size))
+                    return false;
+                ++count;
+            }
+        }
+
+        return fat16_closedir(dir) == 0 && ret == 0;
+    }
+}
+
+ReaddirBench::ReaddirBench():
+Benchmark("ReaddirBench")
+{
+}
+
+bool ReaddirBench::run()
+{
+    RamDevice dev(SECTOR_COUNT, CLUSTER_SIZE / 512);
+
+    if (fat16_init_block(dev.get_block_dev(), 0) < 0)
+        return false;
+
+    if (fat16_mkdir("/DATA") < 0)
+        return false;
+
+    for (unsigned int i = 0; i < FILE_COUNT; ++i) {
+        std::string path = "/DATA/" + std::to_string(i) + ".TXT";
+        int fd = fat16_open(path.c_str(), 'w');
+        if (fd < 0 || fat16_close(fd) < 0)
+            return false;
+    }
+
+    const char *names[] = { "fat16_ls", "fat16_readdir", "fat16_readdir + fat16_open", "fat16_readdir_batch" };
+
+    printf("%-28s %10s %14s\n", "method", "ms", "sectors read");
+    for (int method = LS; method <= READDIR_BATCH; ++method) {
+        unsigned int count;
+
+        if (fat16_init_block(dev.get_block_dev(), 0) < 0)
+            return false;
+
+        dev.reset_counters();
+        auto start = std::chrono::steady_clock::now();
+        if (!list_directory(static_cast<enum Method>(method), count))
+            return false;
+        auto end = std::chrono::steady_clock::now();
+
+        /* Files, and . and .. if names are only listed */
+        if (count != FILE_COUNT + (method <= READDIR ? 2 : 0))
+            return false;
+
+        double ms = std::chrono::duration<double, std::milli>(end - start).count();
+        printf("%-28s %10.1f %14llu\n", names[method], ms,
+               (unsigned long long)dev.get_sectors_read());
+    }
+
+    return true;
+}
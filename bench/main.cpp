@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <iostream>
+#include <vector>
+#include "AllocBench.hpp"
+#include "BatchBench.hpp"
+#include "Benchmark.hpp"
+#include "DeviceBench.hpp"
+#include "ReadaheadBench.hpp"
+#include "ReaddirBench.hpp"
+#include "ReadViewBench.hpp"
+
+int main()
+{
+    std::vector<Benchmark*> benchmarks;
+    benchmarks.push_back(new AllocBench());
+    benchmarks.push_back(new ReadViewBench());
+    benchmarks.push_back(new DeviceBench());
+    benchmarks.push_back(new BatchBench());
+    benchmarks.push_back(new ReadaheadBench());
+    benchmarks.push_back(new ReaddirBench());
+
+    unsigned int failing_count = 0;
+    for (Benchmark *benchmark : benchmarks) {
+        std::cout << "===== " << benchmark->get_name() << " =====" << std::endl;
+        if (!benchmark->run()) {
+            std::cout << "FAIL" << std::endl;
+            ++failing_count;
+        }
+    }
+
+    for (Benchmark *benchmark : benchmarks)
+        delete benchmark;
+
+    return failing_count;
+}
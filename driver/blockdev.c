@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdbool.h>
+#include <string.h>
+#include "blockdev.h"
+#include "cache.h"
+#include "debug.h"
+#include "fat16.h"
+#include "fat16_priv.h"
+#include "lock.h"
+
+/* Byte-oriented device wrapped by storage_dev_to_block_dev */
+static struct storage_dev_t storage_dev;
+static uint32_t storage_offset;
+
+#define STORAGE_DEV_SECTOR_SIZE         (512)
+
+static int storage_dev_read_sectors(void *context, uint32_t lba, uint32_t count, void *buffer)
+{
+    int ret = -1;
+    (void)context;
+
+    /* The position of the device is shared by all threads */
+    lock_storage();
+    if (storage_dev.seek(storage_offset + lba * STORAGE_DEV_SECTOR_SIZE) == 0)
+        ret = storage_dev.read(buffer, count * STORAGE_DEV_SECTOR_SIZE);
+    unlock_storage();
+
+    return ret;
+}
+
+static int storage_dev_write_sectors(void *context, uint32_t lba, uint32_t count, const void *buffer)
+{
+    int ret = -1;
+    (void)context;
+
+    lock_storage();
+    if (storage_dev.seek(storage_offset + lba * STORAGE_DEV_SECTOR_SIZE) == 0)
+        ret = storage_dev.write(buffer, count * STORAGE_DEV_SECTOR_SIZE);
+    unlock_storage();
+
+    return ret;
+}
+
+struct block_dev_t storage_dev_to_block_dev(struct storage_dev_t _dev, uint32_t offset)
+{
+    struct block_dev_t block_dev;
+
+    storage_dev = _dev;
+    storage_offset = offset;
+
+    block_dev.sector_size = STORAGE_DEV_SECTOR_SIZE;
+    block_dev.read_sectors = storage_dev_read_sectors;
+    block_dev.write_sectors = storage_dev_write_sectors;
+    block_dev.map_sectors = NULL;
+    block_dev.sync = NULL;
+    block_dev.submit_batch = NULL;
+    block_dev.start_batch = NULL;
+    block_dev.poll_batch = NULL;
+    block_dev.context = NULL;
+
+    return block_dev;
+}
+
+int blockdev_init(struct fat16_volume *vol, struct block_dev_t _dev, uint32_t _first_sector)
+{
+    if (_dev.sector_size == 0
+    ||  _dev.sector_size > FAT16_MAX_SECTOR_SIZE
+    ||  (_dev.sector_size & (_dev.sector_size - 1)) != 0) {
+        FAT16DBG("FAT16: Unsupported device sector size %u.\n", _dev.sector_size);
+        return -1;
+    }
+
+    if (_dev.start_batch != NULL && _dev.poll_batch == NULL) {
+        FAT16DBG("FAT16: Device can start batches but not poll them.\n");
+        return -1;
+    }
+
+    vol->dev = _dev;
+    vol->first_sector = _first_sector;
+    vol->batch_count = 0;
+    vol->is_batch_running = false;
+    vol->batch_status = 0;
+    vol->is_sync_needed = false;
+    cache_init(vol);
+
+    return 0;
+}
+
+uint16_t get_sector_size(struct fat16_volume *vol)
+{
+    return vol->dev.sector_size;
+}
+
+/**
+ * @brief Update the status of the batch started by dev_start
+ *
+ * @param[in] vol
+ * @param[in] is_blocking If true, wait until the batch is complete
+ */
+static void check_batch(struct fat16_volume *vol, bool is_blocking)
+{
+    while (vol->is_batch_running) {
+        int ret = vol->dev.poll_batch(vol->dev.context);
+
+        if (ret != 0) {
+            vol->is_batch_running = false;
+            vol->batch_status = ret < 0 ? -1 : 0;
+        } else if (!is_blocking) {
+            break;
+        }
+    }
+}
+
+int read_sectors(struct fat16_volume *vol, uint32_t sector, uint32_t count, void *buffer)
+{
+    check_batch(vol, true);
+    return vol->dev.read_sectors(vol->dev.context, vol->first_sector + sector, count, buffer);
+}
+
+int write_sectors(struct fat16_volume *vol, uint32_t sector, uint32_t count, const void *buffer)
+{
+    check_batch(vol, true);
+    vol->is_sync_needed = true;
+    return vol->dev.write_sectors(vol->dev.context, vol->first_sector + sector, count, buffer);
+}
+
+static const void *map_bytes(struct fat16_volume *vol, uint32_t pos, uint32_t length)
+{
+    uint32_t sector = pos / vol->dev.sector_size;
+    uint16_t offset = pos % vol->dev.sector_size;
+    uint32_t count = (offset + length + vol->dev.sector_size - 1) / vol->dev.sector_size;
+    const uint8_t *data;
+
+    if (vol->dev.map_sectors == NULL)
+        return NULL;
+
+    check_batch(vol, true);
+
+    /* The cache may hold more recent data than the device */
+    if (cache_sync_range(vol, sector, count) < 0)
+        return NULL;
+
+    data = (const uint8_t *)vol->dev.map_sectors(vol->dev.context, vol->first_sector + sector, count);
+    if (data == NULL)
+        return NULL;
+
+    return &data[offset];
+}
+
+const void *dev_map(struct fat16_volume *vol, uint32_t pos, uint32_t length)
+{
+    const void *data;
+
+    lock_cache(vol);
+    data = map_bytes(vol, pos, length);
+    unlock_cache(vol);
+
+    return data;
+}
+
+int dev_sync(struct fat16_volume *vol)
+{
+    check_batch(vol, true);
+    if (vol->dev.sync == NULL || !vol->is_sync_needed)
+        return 0;
+
+    vol->is_sync_needed = false;
+    return vol->dev.sync(vol->dev.context);
+}
+
+/**
+ * @brief Queue a transfer of whole sectors
+ *
+ * The transfer is merged with the previous one if they are contiguous on
+ * the device and in memory. The queue is submitted if it is full.
+ *
+ * @param[in] vol
+ * @param[in] sector Index of the first sector in the partition
+ * @param[in] count Number of sectors
+ * @param[in] buffer
+ * @param[in] is_write
+ * @return 0 if successful, -1 otherwise
+ */
+static int queue_request(struct fat16_volume *vol, uint32_t sector, uint32_t count, uint8_t *buffer, bool is_write)
+{
+    /* The queue is owned by the device until the running batch completes */
+    check_batch(vol, true);
+
+    if (vol->batch_count > 0) {
+        struct block_request *last = &vol->batch[vol->batch_count - 1];
+
+        if (last->is_write == is_write
+        &&  last->lba + last->count == vol->first_sector + sector
+        &&  (uint8_t *)last->buffer + last->count * vol->dev.sector_size == buffer) {
+            last->count += count;
+            return 0;
+        }
+    }
+
+    if (vol->batch_count == FAT16_BATCH_SIZE && dev_submit(vol) < 0)
+        return -1;
+
+    if (is_write)
+        vol->is_sync_needed = true;
+
+    vol->batch[vol->batch_count].lba = vol->first_sector + sector;
+    vol->batch[vol->batch_count].count = count;
+    vol->batch[vol->batch_count].buffer = buffer;
+    vol->batch[vol->batch_count].is_write = is_write;
+    ++vol->batch_count;
+
+    return 0;
+}
+
+int write_sectors_deferred(struct fat16_volume *vol, uint32_t sector, uint32_t count, const void *buffer)
+{
+    return queue_request(vol, sector, count, (uint8_t *)buffer, true);
+}
+
+int dev_submit(struct fat16_volume *vol)
+{
+    uint32_t i, count = vol->batch_count;
+
+    if (count == 0)
+        return 0;
+
+    /* Empty the queue first, even if a transfer fails */
+    vol->batch_count = 0;
+
+    check_batch(vol, true);
+    if (vol->dev.submit_batch != NULL)
+        return vol->dev.submit_batch(vol->dev.context, vol->batch, count);
+
+    for (i = 0; i < count; ++i) {
+        int ret;
+
+        if (vol->batch[i].is_write)
+            ret = vol->dev.write_sectors(vol->dev.context, vol->batch[i].lba, vol->batch[i].count, vol->batch[i].buffer);
+        else
+            ret = vol->dev.read_sectors(vol->dev.context, vol->batch[i].lba, vol->batch[i].count, vol->batch[i].buffer);
+        if (ret < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+int dev_start(struct fat16_volume *vol)
+{
+    uint32_t count = vol->batch_count;
+
+    check_batch(vol, true);
+    if (vol->dev.start_batch == NULL || count == 0) {
+        vol->batch_status = dev_submit(vol);
+        return vol->batch_status;
+    }
+
+    vol->batch_count = 0;
+    if (vol->dev.start_batch(vol->dev.context, vol->batch, count) < 0) {
+        vol->batch_status = -1;
+        return -1;
+    }
+
+    vol->is_batch_running = true;
+    return 0;
+}
+
+int dev_poll(struct fat16_volume *vol)
+{
+    check_batch(vol, false);
+    if (vol->is_batch_running)
+        return 0;
+
+    return vol->batch_status < 0 ? -1 : 1;
+}
+
+/**
+ * @brief Read bytes from the partition
+ *
+ * @param[in] vol
+ * @param[in] pos Position in bytes from the start of the partition
+ * @param[out] buffer
+ * @param[in] length
+ * @param[in] is_deferred If true, reads of whole sectors are queued
+ * @return 0 if successful, -1 otherwise
+ */
+static int read_bytes(struct fat16_volume *vol, uint32_t pos, void *buffer, uint32_t length, bool is_deferred)
+{
+    uint8_t *bytes = (uint8_t *)buffer;
+
+    while (length > 0) {
+        uint32_t sector = pos / vol->dev.sector_size;
+        uint16_t offset = pos % vol->dev.sector_size;
+        uint32_t chunk_length;
+
+        if (offset == 0 && length >= vol->dev.sector_size) {
+            uint32_t count = length / vol->dev.sector_size;
+
+            chunk_length = count * vol->dev.sector_size;
+
+            /* The cache may hold more recent data than the device */
+            if (cache_sync_range(vol, sector, count) < 0)
+                return -1;
+
+            if (is_deferred) {
+                if (queue_request(vol, sector, count, bytes, false) < 0)
+                    return -1;
+            } else {
+                int ret;
+
+                /* Other threads can use the cache during the transfer */
+                check_batch(vol, true);
+                unlock_cache(vol);
+                ret = vol->dev.read_sectors(vol->dev.context, vol->first_sector + sector, count, bytes);
+                lock_cache(vol);
+                if (ret < 0)
+                    return -1;
+            }
+        } else {
+            uint8_t *buffer;
+
+            chunk_length = vol->dev.sector_size - offset;
+            if (chunk_length > length)
+                chunk_length = length;
+
+            buffer = cache_get_sector(vol, sector, false);
+            if (buffer == NULL)
+                return -1;
+            memcpy(bytes, &buffer[offset], chunk_length);
+        }
+
+        pos += chunk_length;
+        bytes += chunk_length;
+        length -= chunk_length;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Write bytes to the partition
+ *
+ * @param[in] vol
+ * @param[in] pos Position in bytes from the start of the partition
+ * @param[in] buffer
+ * @param[in] length
+ * @param[in] kind Content of the sectors, see enum SECTOR_KIND
+ * @param[in] is_deferred If true, writes of whole sectors are queued
+ * @return 0 if successful, -1 otherwise
+ */
+static int write_bytes(struct fat16_volume *vol, uint32_t pos, const void *buffer, uint32_t length, uint8_t kind, bool is_deferred)
+{
+    const uint8_t *bytes = (const uint8_t *)buffer;
+
+    while (length > 0) {
+        uint32_t sector = pos / vol->dev.sector_size;
+        uint16_t offset = pos % vol->dev.sector_size;
+        uint32_t chunk_length;
+
+        if (offset == 0 && length >= vol->dev.sector_size) {
+            uint32_t count = length / vol->dev.sector_size;
+
+            chunk_length = count * vol->dev.sector_size;
+
+            /* Cached copies of these sectors are now stale */
+            cache_discard_range(vol, sector, count);
+            if (is_deferred) {
+                if (queue_request(vol, sector, count, (uint8_t *)bytes, true) < 0)
+                    return -1;
+            } else if (write_sectors(vol, sector, count, bytes) < 0) {
+                return -1;
+            }
+        } else {
+            uint8_t *buffer;
+
+            chunk_length = vol->dev.sector_size - offset;
+            if (chunk_length > length)
+                chunk_length = length;
+
+            buffer = cache_modify_sector(vol, sector, kind);
+            if (buffer == NULL)
+                return -1;
+            memcpy(&buffer[offset], bytes, chunk_length);
+        }
+
+        pos += chunk_length;
+        bytes += chunk_length;
+        length -= chunk_length;
+    }
+
+    return 0;
+}
+
+int dev_read(struct fat16_volume *vol, uint32_t pos, void *buffer, uint32_t length)
+{
+    int ret;
+
+    lock_cache(vol);
+    ret = read_bytes(vol, pos, buffer, length, false);
+    unlock_cache(vol);
+
+    return ret;
+}
+
+int dev_write(struct fat16_volume *vol, uint32_t pos, const void *buffer, uint32_t length, uint8_t kind)
+{
+    int ret;
+
+    lock_cache(vol);
+    ret = write_bytes(vol, pos, buffer, length, kind, false);
+    unlock_cache(vol);
+
+    return ret;
+}
+
+int dev_read_deferred(struct fat16_volume *vol, uint32_t pos, void *buffer, uint32_t length)
+{
+    int ret;
+
+    lock_cache(vol);
+    ret = read_bytes(vol, pos, buffer, length, true);
+    unlock_cache(vol);
+
+    return ret;
+}
+
+int dev_write_deferred(struct fat16_volume *vol, uint32_t pos, const void *buffer, uint32_t length, uint8_t kind)
+{
+    int ret;
+
+    lock_cache(vol);
+    ret = write_bytes(vol, pos, buffer, length, kind, true);
+    unlock_cache(vol);
+
+    return ret;
+}
+
+int write_bytes_deferred(struct fat16_volume *vol, uint32_t pos, const void *buffer, uint32_t length, uint8_t kind)
+{
+    return write_bytes(vol, pos, buffer, length, kind, true);
+}
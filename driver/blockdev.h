@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FAT16_BLOCKDEV_H__
+#define __FAT16_BLOCKDEV_H__
+
+#include <stdint.h>
+#include "fat16.h"
+
+/*
+ * Largest sector size supported by the driver. A buffer of this size is
+ * statically allocated.
+ */
+#ifndef FAT16_MAX_SECTOR_SIZE
+#define FAT16_MAX_SECTOR_SIZE           (512)
+#endif
+
+/*
+ * Maximum number of transfers queued by dev_read_deferred and
+ * dev_write_deferred before they are submitted to the device.
+ */
+#ifndef FAT16_BATCH_SIZE
+#define FAT16_BATCH_SIZE                (8)
+#endif
+
+/*
+ * Content of a sector written through the cache. Dirty sectors are written
+ * back in this order at flush points, so that the FAT never links clusters
+ * whose data is not on the device, and directory entries never point to
+ * clusters which are still free in the FAT.
+ */
+enum SECTOR_KIND {
+    DATA_SECTOR,        /**< Content of a file */
+    FAT_SECTOR,         /**< Entries of the FAT */
+    ENTRY_SECTOR        /**< Directory entries */
+};
+
+/**
+ * @brief Wrap a byte-oriented device in a block device.
+ *
+ * Sectors are 512 bytes long. Only one byte-oriented device can be wrapped
+ * at a time.
+ *
+ * @param[in] dev
+ * @param[in] offset Absolute position of the first byte of the FAT16 partition
+ * @return Block device whose sector 0 starts at offset
+ */
+struct block_dev_t storage_dev_to_block_dev(struct storage_dev_t dev, uint32_t offset);
+
+/**
+ * @brief Set the device used by dev_read and dev_write.
+ *
+ * @param[in] vol
+ * @param[in] dev
+ * @param[in] first_sector Index of the first sector of the FAT16 partition
+ * @return 0 if successful, -1 otherwise
+ */
+int blockdev_init(struct fat16_volume *vol, struct block_dev_t dev, uint32_t first_sector);
+
+/** @return Size in bytes of a sector of the device */
+uint16_t get_sector_size(struct fat16_volume *vol);
+
+/**
+ * @brief Read sectors from the device, bypassing the cache
+ *
+ * @param[in] vol
+ * @param[in] sector Index of the first sector in the partition
+ * @param[in] count Number of sectors
+ * @param[out] buffer
+ * @return 0 if successful, -1 otherwise
+ */
+int read_sectors(struct fat16_volume *vol, uint32_t sector, uint32_t count, void *buffer);
+
+/**
+ * @brief Write sectors to the device, bypassing the cache
+ *
+ * @param[in] vol
+ * @param[in] sector Index of the first sector in the partition
+ * @param[in] count Number of sectors
+ * @param[in] buffer
+ * @return 0 if successful, -1 otherwise
+ */
+int write_sectors(struct fat16_volume *vol, uint32_t sector, uint32_t count, const void *buffer);
+
+/**
+ * @brief Get a pointer to bytes of the partition in device memory.
+ *
+ * Dirty cached sectors in the range are written to the device first.
+ *
+ * @param[in] vol
+ * @param[in] pos Position in bytes from the start of the partition
+ * @param[in] length
+ * @return Pointer to the bytes, NULL if the device is not mapped in memory or if an error occurred
+ */
+const void *dev_map(struct fat16_volume *vol, uint32_t pos, uint32_t length);
+
+/**
+ * @brief Ask the device to make written sectors durable.
+ *
+ * Nothing is done if no sector was written since the last call.
+ *
+ * @param[in] vol
+ * @return 0 if successful, -1 otherwise
+ */
+int dev_sync(struct fat16_volume *vol);
+
+/**
+ * @brief Queue a write of sectors to the device, bypassing the cache
+ *
+ * The write is only performed by dev_submit (or when the queue is full). The
+ * buffer must not be modified before dev_submit returns.
+ *
+ * @param[in] vol
+ * @param[in] sector Index of the first sector in the partition
+ * @param[in] count Number of sectors
+ * @param[in] buffer
+ * @return 0 if successful, -1 otherwise
+ */
+int write_sectors_deferred(struct fat16_volume *vol, uint32_t sector, uint32_t count, const void *buffer);
+
+/**
+ * @brief Read bytes from the partition.
+ *
+ * Partial sectors are read through the sector cache, whole sectors are
+ * transferred straight to the caller buffer.
+ *
+ * @param[in] vol
+ * @param[in] pos Position in bytes from the start of the partition
+ * @param[out] buffer
+ * @param[in] length
+ * @return 0 if successful, -1 otherwise
+ */
+int dev_read(struct fat16_volume *vol, uint32_t pos, void *buffer, uint32_t length);
+
+/**
+ * @brief Write bytes to the partition.
+ *
+ * Partial sectors are modified in the sector cache and only written to the
+ * device when they are evicted or when the cache is flushed. Whole sectors
+ * are written straight to the device.
+ *
+ * @param[in] vol
+ * @param[in] pos Position in bytes from the start of the partition
+ * @param[in] buffer
+ * @param[in] length
+ * @param[in] kind Content of the sectors, see enum SECTOR_KIND
+ * @return 0 if successful, -1 otherwise
+ */
+int dev_write(struct fat16_volume *vol, uint32_t pos, const void *buffer, uint32_t length, uint8_t kind);
+
+/**
+ * @brief Read bytes from the partition, whole sectors are read later.
+ *
+ * Same as dev_read, except that transfers of whole sectors are queued and
+ * only performed by dev_submit (or when the queue is full). The buffer must
+ * not be used before dev_submit returns.
+ *
+ * @param[in] vol
+ * @param[in] pos Position in bytes from the start of the partition
+ * @param[out] buffer
+ * @param[in] length
+ * @return 0 if successful, -1 otherwise
+ */
+int dev_read_deferred(struct fat16_volume *vol, uint32_t pos, void *buffer, uint32_t length);
+
+/**
+ * @brief Write bytes to the partition, whole sectors are written later.
+ *
+ * Same as dev_write, except that transfers of whole sectors are queued and
+ * only performed by dev_submit (or when the queue is full). The buffer must
+ * not be modified before dev_submit returns.
+ *
+ * @param[in] vol
+ * @param[in] pos Position in bytes from the start of the partition
+ * @param[in] buffer
+ * @param[in] length
+ * @param[in] kind Content of the sectors, see enum SECTOR_KIND
+ * @return 0 if successful, -1 otherwise
+ */
+int dev_write_deferred(struct fat16_volume *vol, uint32_t pos, const void *buffer, uint32_t length, uint8_t kind);
+
+/**
+ * @brief Write bytes to the partition, whole sectors are written later.
+ *
+ * Same as dev_write_deferred, except that the cache is not locked: it must
+ * already be locked by the caller, or the volume must be locked exclusively.
+ *
+ * @param[in] vol
+ * @param[in] pos Position in bytes from the start of the partition
+ * @param[in] buffer
+ * @param[in] length
+ * @param[in] kind Content of the sectors, see enum SECTOR_KIND
+ * @return 0 if successful, -1 otherwise
+ */
+int write_bytes_deferred(struct fat16_volume *vol, uint32_t pos, const void *buffer, uint32_t length, uint8_t kind);
+
+/**
+ * @brief Perform all queued transfers
+ *
+ * If the device supports it, they are submitted as a single batch. Unlike
+ * dev_read and dev_write, this function and the following ones do not lock
+ * the cache: the volume must be locked exclusively.
+ *
+ * @param[in] vol
+ * @return 0 if successful, -1 otherwise
+ */
+int dev_submit(struct fat16_volume *vol);
+
+/**
+ * @brief Start all queued transfers without waiting for them
+ *
+ * If the device cannot start transfers, they are performed before this
+ * function returns. Any other access to the device waits for the batch.
+ *
+ * @param[in] vol
+ * @return 0 if successful, -1 otherwise
+ */
+int dev_start(struct fat16_volume *vol);
+
+/**
+ * @brief Check if the transfers started by dev_start are complete
+ *
+ * @param[in] vol
+ * @return 1 if they are complete, 0 if they are in progress, -1 if any of them failed
+ */
+int dev_poll(struct fat16_volume *vol);
+
+#endif
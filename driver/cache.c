@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "blockdev.h"
+#include "cache.h"
+#include "debug.h"
+#include "fat16_priv.h"
+#include "fat_table.h"
+#include "lock.h"
+
+void cache_init(struct fat16_volume *vol)
+{
+    struct cache *cache = &vol->cache;
+
+    memset(cache->entries, 0, sizeof(cache->entries));
+    cache->use_counter = 0;
+    cache->fat_copy_count = 0;
+}
+
+void cache_set_fat_copies(struct fat16_volume *vol, uint32_t first_sector, uint32_t sector_count, uint8_t copy_count)
+{
+    struct cache *cache = &vol->cache;
+
+    cache->fat_first_sector = first_sector;
+    cache->fat_sector_count = sector_count;
+    cache->fat_copy_count = copy_count;
+}
+
+/** @return Number of copies of the FAT the slot must also be written to */
+static uint8_t get_copy_count(struct fat16_volume *vol, uint16_t i)
+{
+    struct cache *cache = &vol->cache;
+
+    if (cache->entries[i].kind != FAT_SECTOR
+    ||  cache->entries[i].sector < cache->fat_first_sector
+    ||  cache->entries[i].sector - cache->fat_first_sector >= cache->fat_sector_count)
+        return 0;
+
+    return cache->fat_copy_count;
+}
+
+/**
+ * @brief Write a dirty sector to the device
+ *
+ * Dirty sectors of the kinds which come before it (see enum SECTOR_KIND)
+ * are written and synced first, so that an evicted FAT sector or directory
+ * entry never reaches the device before the data it refers to. Before a
+ * directory entry, this includes the FAT kept in memory. The slot is pinned
+ * meanwhile, so that it is not evicted by the sectors these writes load.
+ *
+ * @param[in] vol
+ * @param[in] i Index of the slot
+ * @return 0 if successful, -1 otherwise
+ */
+static int write_back(struct fat16_volume *vol, uint16_t i)
+{
+    struct cache *cache = &vol->cache;
+    uint8_t kind, copy;
+
+    if (!cache->entries[i].is_dirty)
+        return 0;
+
+    ++cache->entries[i].pin_count;
+    for (kind = DATA_SECTOR; kind < cache->entries[i].kind; ++kind) {
+        if ((kind == FAT_SECTOR && fat_table_flush(vol) < 0)
+        ||  cache_flush(vol, kind) < 0
+        ||  dev_sync(vol) < 0) {
+            --cache->entries[i].pin_count;
+            return -1;
+        }
+    }
+    --cache->entries[i].pin_count;
+
+    if (write_sectors(vol, cache->entries[i].sector, 1, cache->buffers[i]) < 0) {
+        FAT16DBG("FAT16: Failed to write back sector %u.\n", cache->entries[i].sector);
+        return -1;
+    }
+
+    for (copy = 1; copy <= get_copy_count(vol, i); ++copy) {
+        if (write_sectors(vol, cache->entries[i].sector + copy * cache->fat_sector_count, 1, cache->buffers[i]) < 0) {
+            FAT16DBG("FAT16: Failed to write back sector %u.\n", cache->entries[i].sector);
+            return -1;
+        }
+    }
+
+    cache->entries[i].is_dirty = false;
+    return 0;
+}
+
+/**
+ * @brief Find a slot for a sector which is not in the cache
+ *
+ * An invalid slot is preferred. Otherwise, the least recently used sector
+ * is evicted. Pinned slots are skipped.
+ *
+ * @param[in] vol
+ * @return Index of the slot, -1 if all slots are pinned or if the evicted sector could not be written back
+ */
+static int find_slot(struct fat16_volume *vol)
+{
+    struct cache *cache = &vol->cache;
+    int i, lru = -1;
+
+    for (i = 0; i < CACHE_SECTOR_COUNT; ++i) {
+        if (cache->entries[i].pin_count > 0)
+            continue;
+
+        if (!cache->entries[i].is_valid)
+            return i;
+
+        if (lru < 0
+        ||  cache->use_counter - cache->entries[i].last_use > cache->use_counter - cache->entries[lru].last_use)
+            lru = i;
+    }
+
+    if (lru < 0)
+        return -1;
+
+    if (write_back(vol, lru) < 0)
+        return -1;
+
+    cache->entries[lru].is_valid = false;
+    return lru;
+}
+
+uint8_t *cache_get_sector(struct fat16_volume *vol, uint32_t sector, bool will_modify)
+{
+    struct cache *cache = &vol->cache;
+    int i;
+
+    for (i = 0; i < CACHE_SECTOR_COUNT; ++i) {
+        if (cache->entries[i].is_valid && cache->entries[i].sector == sector)
+            break;
+    }
+
+    if (i == CACHE_SECTOR_COUNT) {
+        i = find_slot(vol);
+        if (i < 0)
+            return NULL;
+
+        if (read_sectors(vol, sector, 1, cache->buffers[i]) < 0)
+            return NULL;
+
+        cache->entries[i].sector = sector;
+        cache->entries[i].is_valid = true;
+        cache->entries[i].is_dirty = false;
+    }
+
+    cache->entries[i].last_use = ++cache->use_counter;
+    if (will_modify)
+        cache->entries[i].is_dirty = true;
+
+    return cache->buffers[i];
+}
+
+uint8_t *cache_modify_sector(struct fat16_volume *vol, uint32_t sector, uint8_t kind)
+{
+    struct cache *cache = &vol->cache;
+    uint8_t *buffer = cache_get_sector(vol, sector, true);
+
+    if (buffer != NULL)
+        cache->entries[(buffer - cache->buffers[0]) / FAT16_MAX_SECTOR_SIZE].kind = kind;
+
+    return buffer;
+}
+
+static const uint8_t *pin_sector(struct fat16_volume *vol, uint32_t sector)
+{
+    struct cache *cache = &vol->cache;
+    uint16_t i, pinned_count = 0;
+    uint8_t *buffer;
+
+    for (i = 0; i < CACHE_SECTOR_COUNT; ++i) {
+        if (cache->entries[i].pin_count > 0)
+            ++pinned_count;
+    }
+
+    buffer = cache_get_sector(vol, sector, false);
+    if (buffer == NULL)
+        return NULL;
+
+    i = (buffer - cache->buffers[0]) / FAT16_MAX_SECTOR_SIZE;
+    if (cache->entries[i].pin_count == 0xFF
+    ||  (cache->entries[i].pin_count == 0 && pinned_count + 1 >= CACHE_SECTOR_COUNT)) {
+        FAT16DBG("FAT16: Too many pinned sectors.\n");
+        return NULL;
+    }
+
+    ++cache->entries[i].pin_count;
+    return buffer;
+}
+
+const uint8_t *cache_pin_sector(struct fat16_volume *vol, uint32_t sector)
+{
+    const uint8_t *buffer;
+
+    lock_cache(vol);
+    buffer = pin_sector(vol, sector);
+    unlock_cache(vol);
+
+    return buffer;
+}
+
+void cache_unpin_sector(struct fat16_volume *vol, const uint8_t *data)
+{
+    struct cache *cache = &vol->cache;
+    uint16_t i;
+
+    if (data < cache->buffers[0] || data >= cache->buffers[CACHE_SECTOR_COUNT - 1] + FAT16_MAX_SECTOR_SIZE)
+        return;
+
+    i = (data - cache->buffers[0]) / FAT16_MAX_SECTOR_SIZE;
+    lock_cache(vol);
+    if (cache->entries[i].pin_count > 0)
+        --cache->entries[i].pin_count;
+    unlock_cache(vol);
+}
+
+int cache_sync_range(struct fat16_volume *vol, uint32_t sector, uint32_t count)
+{
+    struct cache *cache = &vol->cache;
+    uint16_t i;
+
+    for (i = 0; i < CACHE_SECTOR_COUNT; ++i) {
+        if (!cache->entries[i].is_valid
+        ||  cache->entries[i].sector < sector
+        ||  cache->entries[i].sector - sector >= count)
+            continue;
+
+        if (write_back(vol, i) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+void cache_discard_range(struct fat16_volume *vol, uint32_t sector, uint32_t count)
+{
+    struct cache *cache = &vol->cache;
+    uint16_t i;
+
+    for (i = 0; i < CACHE_SECTOR_COUNT; ++i) {
+        if (cache->entries[i].is_valid
+        &&  cache->entries[i].sector >= sector
+        &&  cache->entries[i].sector - sector < count)
+            cache->entries[i].is_valid = false;
+    }
+}
+
+int cache_flush(struct fat16_volume *vol, uint8_t kind)
+{
+    struct cache *cache = &vol->cache;
+    bool is_queued[CACHE_SECTOR_COUNT];
+    uint8_t copy, copy_count = kind == FAT_SECTOR ? cache->fat_copy_count : 0;
+    uint16_t i;
+
+    memset(is_queued, 0, sizeof(is_queued));
+
+    /*
+     * Queue sectors in ascending order to avoid seeking back and forth, so
+     * that the device receives them in batches. Sectors of the first FAT are
+     * then queued again for each other copy.
+     */
+    for (copy = 0; copy <= copy_count; ++copy) {
+        int last = -1;
+
+        while (1) {
+            int next = -1;
+
+            for (i = 0; i < CACHE_SECTOR_COUNT; ++i) {
+                if (!cache->entries[i].is_valid || !cache->entries[i].is_dirty
+                ||  cache->entries[i].kind != kind
+                ||  (copy > 0 && get_copy_count(vol, i) < copy)
+                ||  (last >= 0 && cache->entries[i].sector <= cache->entries[last].sector))
+                    continue;
+
+                if (next < 0 || cache->entries[i].sector < cache->entries[next].sector)
+                    next = i;
+            }
+
+            if (next < 0)
+                break;
+
+            is_queued[next] = true;
+            last = next;
+            if (write_sectors_deferred(vol, cache->entries[next].sector + copy * cache->fat_sector_count, 1, cache->buffers[next]) < 0) {
+                dev_submit(vol);
+                return -1;
+            }
+        }
+    }
+
+    /* Sectors stay dirty if they may not have been written */
+    if (dev_submit(vol) < 0) {
+        FAT16DBG("FAT16: Failed to flush the cache.\n");
+        return -1;
+    }
+
+    for (i = 0; i < CACHE_SECTOR_COUNT; ++i) {
+        if (is_queued[i])
+            cache->entries[i].is_dirty = false;
+    }
+
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FAT16_CACHE_H__
+#define __FAT16_CACHE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "blockdev.h"
+
+/*
+ * Amount of memory in bytes reserved for the sector cache. It must hold at
+ * least one sector of FAT16_MAX_SECTOR_SIZE bytes.
+ */
+#ifndef FAT16_CACHE_SIZE
+#define FAT16_CACHE_SIZE                (2048)
+#endif
+
+#define CACHE_SECTOR_COUNT              (FAT16_CACHE_SIZE / FAT16_MAX_SECTOR_SIZE)
+
+#if CACHE_SECTOR_COUNT < 1
+#error "FAT16_CACHE_SIZE must be at least FAT16_MAX_SECTOR_SIZE"
+#endif
+
+struct cache_entry {
+    uint32_t    sector;     /**< Index of the sector in the partition */
+    uint32_t    last_use;   /**< Value of use_counter when the sector was last accessed */
+    bool        is_valid;
+    bool        is_dirty;   /**< True if the sector must be written back to the device */
+    uint8_t     kind;       /**< Content of a dirty sector, see enum SECTOR_KIND */
+    uint8_t     pin_count;  /**< Number of users which need the slot to keep its content */
+};
+
+/* Sector cache of a volume */
+struct cache {
+    struct cache_entry  entries[CACHE_SECTOR_COUNT];
+    uint8_t             buffers[CACHE_SECTOR_COUNT][FAT16_MAX_SECTOR_SIZE];
+    uint32_t            use_counter;
+
+    /* Location of the first FAT and number of other copies, see cache_set_fat_copies */
+    uint32_t            fat_first_sector;
+    uint32_t            fat_sector_count;
+    uint8_t             fat_copy_count;
+};
+
+/**
+ * @brief Drop all sectors in the cache
+ *
+ * Dirty sectors are not written to the device.
+ *
+ * @param[in] vol
+ */
+void cache_init(struct fat16_volume *vol);
+
+/**
+ * @brief Write FAT sectors to every copy of the FAT
+ *
+ * Dirty sectors of kind FAT_SECTOR in the first FAT are written at the same
+ * offset in the other copies whenever they are written back.
+ *
+ * @param[in] vol
+ * @param[in] first_sector Index of the first sector of the first FAT
+ * @param[in] sector_count Number of sectors in a FAT
+ * @param[in] copy_count Number of other copies, 0 to disable mirroring
+ */
+void cache_set_fat_copies(struct fat16_volume *vol, uint32_t first_sector, uint32_t sector_count, uint8_t copy_count);
+
+/**
+ * @brief Get a sector from the cache
+ *
+ * The sector is read from the device if it is not in the cache. If the
+ * cache is full, the least recently used sector is evicted (and written to
+ * the device if it is dirty).
+ *
+ * The returned buffer is only valid until the next call to a cache function.
+ *
+ * @param[in] vol
+ * @param[in] sector Index of the sector in the partition
+ * @param[in] will_modify If true, the sector is marked as dirty.
+ * @return Pointer to the content of the sector, NULL if an error occurred
+ */
+uint8_t *cache_get_sector(struct fat16_volume *vol, uint32_t sector, bool will_modify);
+
+/**
+ * @brief Get a sector from the cache in order to modify it
+ *
+ * Same as cache_get_sector, the sector is marked as dirty and remembers
+ * its kind so that cache_flush can write it back in order.
+ *
+ * @param[in] vol
+ * @param[in] sector Index of the sector in the partition
+ * @param[in] kind Content of the sector, see enum SECTOR_KIND
+ * @return Pointer to the content of the sector, NULL if an error occurred
+ */
+uint8_t *cache_modify_sector(struct fat16_volume *vol, uint32_t sector, uint8_t kind);
+
+/**
+ * @brief Get a sector from the cache and keep it there until it is unpinned
+ *
+ * A pinned sector is never evicted. At least one slot of the cache is kept
+ * unpinned for other accesses.
+ *
+ * @param[in] vol
+ * @param[in] sector Index of the sector in the partition
+ * @return Pointer to the content of the sector, NULL if an error occurred or if too many sectors are pinned
+ */
+const uint8_t *cache_pin_sector(struct fat16_volume *vol, uint32_t sector);
+
+/**
+ * @brief Release a sector pinned by cache_pin_sector
+ *
+ * @param[in] vol
+ * @param[in] data Any pointer in the content of the sector
+ */
+void cache_unpin_sector(struct fat16_volume *vol, const uint8_t *data);
+
+/**
+ * @brief Write dirty sectors in a range to the device
+ *
+ * Sectors stay in the cache.
+ *
+ * @param[in] vol
+ * @param[in] sector Index of the first sector in the partition
+ * @param[in] count Number of sectors
+ * @return 0 if successful, -1 otherwise
+ */
+int cache_sync_range(struct fat16_volume *vol, uint32_t sector, uint32_t count);
+
+/**
+ * @brief Drop sectors in a range from the cache
+ *
+ * Dirty sectors are not written to the device. This must be called when
+ * sectors are overwritten without going through the cache. Pinned sectors
+ * keep their slot until they are unpinned.
+ *
+ * @param[in] vol
+ * @param[in] sector Index of the first sector in the partition
+ * @param[in] count Number of sectors
+ */
+void cache_discard_range(struct fat16_volume *vol, uint32_t sector, uint32_t count);
+
+/**
+ * @brief Write all dirty sectors of a kind to the device
+ *
+ * @param[in] vol
+ * @param[in] kind Content of the sectors, see enum SECTOR_KIND
+ * @return 0 if successful, -1 otherwise
+ */
+int cache_flush(struct fat16_volume *vol, uint8_t kind);
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Functions of the original API, working on a single volume mounted by
+ * fat16_init or fat16_init_block.
+ */
+
+#include <stddef.h>
+#include "blockdev.h"
+#include "fat16.h"
+#include "fat16_priv.h"
+#include "lock.h"
+
+
+static struct fat16_volume *default_volume;
+
+int fat16_init(struct storage_dev_t dev, uint32_t offset)
+{
+    /* The previous volume may use the byte-oriented device replaced below */
+    if (default_volume != NULL && fat16_vol_sync(default_volume) < 0)
+        return -1;
+
+    return fat16_init_block(storage_dev_to_block_dev(dev, offset), 0);
+}
+
+int fat16_init_block(struct block_dev_t dev, uint32_t first_sector)
+{
+    int ret;
+
+    if (default_volume == NULL)
+        return fat16_mount(&default_volume, dev, first_sector);
+
+    /*
+     * Calling it again mounts the partition in place of the previous one.
+     * Files open for writing are flushed first, as fat16_sync does, so
+     * that data in the cache is not lost. If this fails, the previous
+     * volume stays mounted.
+     */
+    if (fat16_vol_sync(default_volume) < 0)
+        return -1;
+
+    lock_volume_table();
+    (void)lock_volume(default_volume, true);
+    ret = mount_volume(default_volume, dev, first_sector);
+    unlock_volume(default_volume);
+    unlock_volume_table();
+    if (ret < 0)
+        default_volume = NULL;
+
+    return ret;
+}
+
+int fat16_open(const char *filepath, char mode)
+{
+    return fat16_vol_open(default_volume, filepath, mode);
+}
+
+int fat16_read(uint8_t handle, void *buffer, uint32_t count)
+{
+    return fat16_vol_read(default_volume, handle, buffer, count);
+}
+
+int fat16_write(uint8_t handle, const void *buffer, uint32_t count)
+{
+    return fat16_vol_write(default_volume, handle, buffer, count);
+}
+
+int fat16_readv(uint8_t handle, const struct fat16_iovec *iov, uint8_t iov_count)
+{
+    return fat16_vol_readv(default_volume, handle, iov, iov_count);
+}
+
+int fat16_writev(uint8_t handle, const struct fat16_iovec *iov, uint8_t iov_count)
+{
+    return fat16_vol_writev(default_volume, handle, iov, iov_count);
+}
+
+int fat16_read_async(uint8_t handle, void *buffer, uint32_t count, fat16_callback_t callback, void *context)
+{
+    return fat16_vol_read_async(default_volume, handle, buffer, count, callback, context);
+}
+
+int fat16_write_async(uint8_t handle, const void *buffer, uint32_t count, fat16_callback_t callback, void *context)
+{
+    return fat16_vol_write_async(default_volume, handle, buffer, count, callback, context);
+}
+
+int fat16_poll(void)
+{
+    return fat16_vol_poll(default_volume);
+}
+
+int fat16_get_result(int request, int *result)
+{
+    return fat16_vol_get_result(default_volume, request, result);
+}
+
+int fat16_read_view(uint8_t handle, uint32_t max_count, const void **data, uint32_t *count)
+{
+    return fat16_vol_read_view(default_volume, handle, max_count, data, count);
+}
+
+int fat16_release_view(const void *data)
+{
+    return fat16_vol_release_view(default_volume, data);
+}
+
+int fat16_pread(uint8_t handle, void *buffer, uint32_t count, uint32_t offset)
+{
+    return fat16_vol_pread(default_volume, handle, buffer, count, offset);
+}
+
+int fat16_pwrite(uint8_t handle, const void *buffer, uint32_t count, uint32_t offset)
+{
+    return fat16_vol_pwrite(default_volume, handle, buffer, count, offset);
+}
+
+int32_t fat16_seek(uint8_t handle, int32_t offset, uint8_t whence)
+{
+    return fat16_vol_seek(default_volume, handle, offset, whence);
+}
+
+int32_t fat16_tell(uint8_t handle)
+{
+    return fat16_vol_tell(default_volume, handle);
+}
+
+int fat16_fallocate(uint8_t handle, uint32_t size)
+{
+    return fat16_vol_fallocate(default_volume, handle, size);
+}
+
+int fat16_flush(uint8_t handle)
+{
+    return fat16_vol_flush(default_volume, handle);
+}
+
+int fat16_sync(void)
+{
+    return fat16_vol_sync(default_volume);
+}
+
+int fat16_close(uint8_t handle)
+{
+    return fat16_vol_close(default_volume, handle);
+}
+
+int fat16_rm(const char *filepath)
+{
+    return fat16_vol_rm(default_volume, filepath);
+}
+
+int fat16_ls(uint32_t *index, char *filename, const char *dirpath)
+{
+    return fat16_vol_ls(default_volume, index, filename, dirpath);
+}
+
+int fat16_opendir(const char *dirpath)
+{
+    return fat16_vol_opendir(default_volume, dirpath);
+}
+
+int fat16_readdir(uint8_t dir, char *filename)
+{
+    return fat16_vol_readdir(default_volume, dir, filename);
+}
+
+int fat16_readdir_batch(uint8_t dir, struct fat16_dirent *entries, uint32_t count, uint8_t filter)
+{
+    return fat16_vol_readdir_batch(default_volume, dir, entries, count, filter);
+}
+
+int fat16_closedir(uint8_t dir)
+{
+    return fat16_vol_closedir(default_volume, dir);
+}
+
+int fat16_mkdir(const char *dirpath)
+{
+    return fat16_vol_mkdir(default_volume, dirpath);
+}
+
+int fat16_rmdir(const char *dirpath)
+{
+    return fat16_vol_rmdir(default_volume, dirpath);
+}
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "dentry.h"
+#include "fat16_priv.h"
+#include "lock.h"
+
+#if FAT16_DENTRY_COUNT > 0
+
+/** @return Slot of a name in a directory */
+static struct dentry *get_slot(struct fat16_volume *vol, uint16_t dir_cluster, const char *name)
+{
+    uint32_t hash = dir_cluster;
+    uint8_t i;
+
+    for (i = 0; i < sizeof(((struct dentry *)0)->name); ++i)
+        hash = hash * 31 + (uint8_t)name[i];
+
+    return &vol->dentries[hash & (FAT16_DENTRY_COUNT - 1)];
+}
+
+static bool has_key(const struct dentry *d, uint16_t dir_cluster, const char *name)
+{
+    return d->is_valid
+        && d->dir_cluster == dir_cluster
+        && memcmp(d->name, name, sizeof(d->name)) == 0;
+}
+
+void dentry_init(struct fat16_volume *vol)
+{
+    memset(vol->dentries, 0, sizeof(vol->dentries));
+}
+
+bool dentry_lookup(struct fat16_volume *vol, uint16_t dir_cluster, const char *name, struct dir_entry *entry, uint32_t *pos_entry, bool *exists)
+{
+    struct dentry *d;
+    bool is_found;
+
+    lock_cache(vol);
+    d = get_slot(vol, dir_cluster, name);
+    is_found = has_key(d, dir_cluster, name);
+    if (is_found) {
+        *exists = d->exists;
+        if (d->exists) {
+            memset(entry, 0, sizeof(struct dir_entry));
+            memcpy(entry->name, d->name, sizeof(entry->name));
+            entry->attribute = d->attribute;
+            entry->starting_cluster = d->starting_cluster;
+            entry->size = d->size;
+            *pos_entry = d->pos_entry;
+        }
+    }
+    unlock_cache(vol);
+
+    return is_found;
+}
+
+void dentry_add(struct fat16_volume *vol, uint16_t dir_cluster, const struct dir_entry *entry, uint32_t pos_entry)
+{
+    struct dentry *d;
+
+    lock_cache(vol);
+    d = get_slot(vol, dir_cluster, entry->name);
+    d->is_valid = true;
+    d->exists = true;
+    d->dir_cluster = dir_cluster;
+    memcpy(d->name, entry->name, sizeof(d->name));
+    d->attribute = entry->attribute;
+    d->pos_entry = pos_entry;
+    d->starting_cluster = entry->starting_cluster;
+    d->size = entry->size;
+    unlock_cache(vol);
+}
+
+void dentry_add_missing(struct fat16_volume *vol, uint16_t dir_cluster, const char *name)
+{
+    struct dentry *d;
+
+    lock_cache(vol);
+    d = get_slot(vol, dir_cluster, name);
+    d->is_valid = true;
+    d->exists = false;
+    d->dir_cluster = dir_cluster;
+    memcpy(d->name, name, sizeof(d->name));
+    unlock_cache(vol);
+}
+
+void dentry_update(struct fat16_volume *vol, uint32_t pos_entry, uint16_t starting_cluster, uint32_t size)
+{
+    uint16_t i;
+
+    lock_cache(vol);
+    for (i = 0; i < FAT16_DENTRY_COUNT; ++i) {
+        struct dentry *d = &vol->dentries[i];
+        if (d->is_valid && d->exists && d->pos_entry == pos_entry) {
+            d->starting_cluster = starting_cluster;
+            d->size = size;
+        }
+    }
+    unlock_cache(vol);
+}
+
+#else
+
+void dentry_init(struct fat16_volume *vol)
+{
+    (void)vol;
+}
+
+bool dentry_lookup(struct fat16_volume *vol, uint16_t dir_cluster, const char *name, struct dir_entry *entry, uint32_t *pos_entry, bool *exists)
+{
+    (void)vol;
+    (void)dir_cluster;
+    (void)name;
+    (void)entry;
+    (void)pos_entry;
+    (void)exists;
+    return false;
+}
+
+void dentry_add(struct fat16_volume *vol, uint16_t dir_cluster, const struct dir_entry *entry, uint32_t pos_entry)
+{
+    (void)vol;
+    (void)dir_cluster;
+    (void)entry;
+    (void)pos_entry;
+}
+
+void dentry_add_missing(struct fat16_volume *vol, uint16_t dir_cluster, const char *name)
+{
+    (void)vol;
+    (void)dir_cluster;
+    (void)name;
+}
+
+void dentry_update(struct fat16_volume *vol, uint32_t pos_entry, uint16_t starting_cluster, uint32_t size)
+{
+    (void)vol;
+    (void)pos_entry;
+    (void)starting_cluster;
+    (void)size;
+}
+
+#endif
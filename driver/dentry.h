@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FAT16_DENTRY_H__
+#define __FAT16_DENTRY_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fat16.h"
+
+/*
+ * Number of directory entries remembered by each volume, must be a power of
+ * 2. Names which have been looked up are then found without reading their
+ * directory. Set it to 0 to disable the cache.
+ */
+#ifndef FAT16_DENTRY_COUNT
+#define FAT16_DENTRY_COUNT              (16)
+#endif
+
+#if FAT16_DENTRY_COUNT > 0 && (FAT16_DENTRY_COUNT & (FAT16_DENTRY_COUNT - 1)) != 0
+#error "FAT16_DENTRY_COUNT must be 0 or a power of 2"
+#endif
+
+/* Key of the root directory, which does not start in a cluster */
+#define ROOT_DIR_CLUSTER                (0)
+
+struct dir_entry;
+
+/*
+ * Entry found, or not found, by name in a directory. Each key has a single
+ * slot given by its hash, an entry replaces the one which was in its slot.
+ *
+ * Entries of a deleted directory are not removed: it was empty, so they all
+ * say that names are missing, which stays true for a directory created later
+ * in the same cluster.
+ */
+struct dentry {
+    bool        is_valid;
+    bool        exists;             /**< False if the directory does not contain the name */
+    uint16_t    dir_cluster;        /**< First cluster of the directory, ROOT_DIR_CLUSTER for the root directory */
+    char        name[11];           /**< 8.3 short name */
+    uint8_t     attribute;
+    uint32_t    pos_entry;          /**< Absolute position of the entry */
+    uint16_t    starting_cluster;
+    uint32_t    size;
+};
+
+/**
+ * @brief Forget all entries of a volume
+ *
+ * @param[in] vol
+ */
+void dentry_init(struct fat16_volume *vol);
+
+/**
+ * @brief Look for a name in the cache
+ *
+ * Only the name, attribute, starting cluster and size of the entry are known,
+ * other fields are set to 0.
+ *
+ * @param[in] vol
+ * @param[in] dir_cluster First cluster of the directory, ROOT_DIR_CLUSTER for the root directory
+ * @param[in] name 8.3 short name
+ * @param[out] entry Set if the name is in the directory
+ * @param[out] pos_entry Set if the name is in the directory
+ * @param[out] exists True if the name is in the directory
+ * @return True if the cache knows whether the name is in the directory
+ */
+bool dentry_lookup(struct fat16_volume *vol, uint16_t dir_cluster, const char *name, struct dir_entry *entry, uint32_t *pos_entry, bool *exists);
+
+/**
+ * @brief Remember an entry found or created in a directory
+ *
+ * @param[in] vol
+ * @param[in] dir_cluster First cluster of the directory, ROOT_DIR_CLUSTER for the root directory
+ * @param[in] entry
+ * @param[in] pos_entry Absolute position of the entry
+ */
+void dentry_add(struct fat16_volume *vol, uint16_t dir_cluster, const struct dir_entry *entry, uint32_t pos_entry);
+
+/**
+ * @brief Remember that a directory does not contain a name
+ *
+ * It must be called when an entry is deleted.
+ *
+ * @param[in] vol
+ * @param[in] dir_cluster First cluster of the directory, ROOT_DIR_CLUSTER for the root directory
+ * @param[in] name 8.3 short name
+ */
+void dentry_add_missing(struct fat16_volume *vol, uint16_t dir_cluster, const char *name);
+
+/**
+ * @brief Update the starting cluster and the size of a cached entry
+ *
+ * It must be called when these fields are written to the directory entry.
+ * Entries are not indexed by position, so all of them are checked.
+ *
+ * @param[in] vol
+ * @param[in] pos_entry Absolute position of the entry
+ * @param[in] starting_cluster
+ * @param[in] size
+ */
+void dentry_update(struct fat16_volume *vol, uint32_t pos_entry, uint16_t starting_cluster, uint32_t size);
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <stdint.h>
+#include "extent.h"
+#include "fat16_priv.h"
+
+#if FAT16_EXTENT_COUNT > 0
+
+void init_extent_map(struct extent_map *map, uint16_t starting_cluster)
+{
+    map->starting_cluster = starting_cluster;
+    map->count = 0;
+}
+
+/**
+ * @brief Find the extent holding a cluster index, or the last extent before it
+ *
+ * @param[in] map Must hold at least one extent
+ * @param[in] index Index of the cluster in the file
+ * @return Position of the extent in the map
+ */
+static uint8_t search_extent(struct extent_map *map, uint32_t index)
+{
+    uint8_t low = 0, high = map->count - 1;
+
+    /* Extents are sorted by index, look for the last one starting before index */
+    while (low < high) {
+        uint8_t middle = (low + high + 1) / 2;
+        if (map->extents[middle].first_index <= index)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+
+    return low;
+}
+
+int find_cluster_in_extent_map(struct fat16_volume *vol, struct extent_map *map, uint16_t *cluster, uint32_t *run_length, uint32_t index)
+{
+    struct extent *e;
+    uint32_t last_index;
+    uint16_t last_cluster;
+
+    if (map->starting_cluster == 0)
+        return -1;
+
+    if (map->count == 0) {
+        map->extents[0].first_index = 0;
+        map->extents[0].first_cluster = map->starting_cluster;
+        map->extents[0].length = 1;
+        map->count = 1;
+    }
+
+    e = &map->extents[search_extent(map, index)];
+    last_index = e->first_index + e->length - 1;
+    last_cluster = e->first_cluster + e->length - 1;
+
+    /* Follow the chain from the end of the map until index is reached */
+    while (index > last_index) {
+        uint16_t next_cluster;
+
+        if (get_next_cluster(vol, &next_cluster, last_cluster) < 0
+        ||  next_cluster >= 0xFFF8)
+            return -1;
+        ++last_index;
+
+        if (e == &map->extents[map->count - 1]
+        &&  last_index == (uint32_t)e->first_index + e->length) {
+            if (next_cluster == last_cluster + 1 && e->length < 0xFFFF) {
+                ++e->length;
+            } else if (map->count < FAT16_EXTENT_COUNT && last_index <= 0xFFFF) {
+                e = &map->extents[map->count++];
+                e->first_index = last_index;
+                e->first_cluster = next_cluster;
+                e->length = 1;
+            }
+        }
+        last_cluster = next_cluster;
+    }
+
+    /* Clusters past the end of the map are not known to be contiguous */
+    if (index >= (uint32_t)e->first_index + e->length) {
+        *cluster = last_cluster;
+        *run_length = 1;
+        return 0;
+    }
+
+    *cluster = e->first_cluster + (index - e->first_index);
+    *run_length = e->length - (index - e->first_index);
+    return 0;
+}
+
+bool is_past_full_extent_map(const struct extent_map *map, uint32_t index)
+{
+    const struct extent *e = &map->extents[FAT16_EXTENT_COUNT - 1];
+
+    return map->count == FAT16_EXTENT_COUNT
+        && index >= (uint32_t)e->first_index + e->length;
+}
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FAT16_EXTENT_H__
+#define __FAT16_EXTENT_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fat16.h"
+
+/*
+ * Number of extents remembered by each file handle. A file whose clusters
+ * form up to FAT16_EXTENT_COUNT contiguous runs is then accessed at any
+ * position without walking its cluster chain. Set it to 0 to disable extent
+ * maps.
+ */
+#ifndef FAT16_EXTENT_COUNT
+#define FAT16_EXTENT_COUNT              (8)
+#endif
+
+#if FAT16_EXTENT_COUNT > 255
+#error "FAT16_EXTENT_COUNT must not be greater than 255"
+#endif
+
+#if FAT16_EXTENT_COUNT > 0
+
+struct extent {
+    uint16_t    first_index;        /**< Index of the first cluster of the extent in the file */
+    uint16_t    first_cluster;      /**< First cluster of the extent */
+    uint16_t    length;             /**< Number of contiguous clusters in the extent */
+};
+
+/*
+ * The map only holds the beginning of the cluster chain of a file which has
+ * already been walked. It is extended by following the chain from its last
+ * extent, so clusters appended to the file are found without invalidating it.
+ */
+struct extent_map {
+    uint16_t        starting_cluster;   /**< First cluster of the file, 0 if the file is empty */
+    uint8_t         count;              /**< Number of extents in the map */
+    struct extent   extents[FAT16_EXTENT_COUNT];
+};
+
+/**
+ * @brief Reset an extent map
+ *
+ * @param[out] map
+ * @param[in] starting_cluster First cluster of the file, 0 if the file is empty
+ */
+void init_extent_map(struct extent_map *map, uint16_t starting_cluster);
+
+/**
+ * @brief Find a cluster of a file
+ *
+ * The map is extended if the cluster is past its last extent. If the map is
+ * full, the chain is walked from the last extent without recording anything.
+ *
+ * @param[in] vol
+ * @param[in|out] map
+ * @param[out] cluster
+ * @param[out] run_length Number of contiguous clusters known to belong to the file from cluster
+ * @param[in] index Index of the cluster in the file
+ * @return 0 if successful, -1 if the chain is too short or an error occurred
+ */
+int find_cluster_in_extent_map(struct fat16_volume *vol, struct extent_map *map, uint16_t *cluster, uint32_t *run_length, uint32_t index);
+
+/**
+ * @brief Check if a cluster lies past the end of a full map
+ *
+ * Such a cluster can only be found by walking the chain, which is cheaper
+ * from a closer cluster than the last one of the map.
+ *
+ * @param[in] map
+ * @param[in] index Index of the cluster in the file
+ * @return True if the map is full and does not hold the cluster
+ */
+bool is_past_full_extent_map(const struct extent_map *map, uint32_t index);
+
+#endif
+
+#endif
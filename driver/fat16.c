@@ -21,32 +21,29 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include "blockdev.h"
+#include "cache.h"
 #include "debug.h"
+#include "extent.h"
 #include "fat16.h"
 #include "fat16_priv.h"
+#include "fat_table.h"
+#include "lock.h"
+#include "open_file.h"
 #include "path.h"
 #include "rootdir.h"
 #include "subdir.h"
 
 
-#define INVALID_HANDLE  (255)
-#define HANDLE_COUNT    (16)        /* Must not be greater than 254 */
+static struct fat16_volume volumes[FAT16_VOLUME_COUNT];
 
-struct fat16_bpb bpb;
-
-static struct entry_handle handles[HANDLE_COUNT];
-
-struct fat16_layout layout;
-
-struct storage_dev_t dev;
-
-static int fat16_read_bpb(void)
+static int fat16_read_bpb(struct fat16_volume *vol)
 {
+    uint8_t jump[3];
     uint8_t data;
+    uint32_t sector_count_32b;
 
-    memset(&bpb, 0, sizeof(struct fat16_bpb));
-
-    dev.seek(layout.offset);
+    memset(&vol->bpb, 0, sizeof(struct fat16_bpb));
 
     /* Parse boot sector */
     FAT16DBG("FAT16: #######   BPB   #######\n");
@@ -55,183 +52,320 @@ static int fat16_read_bpb(void)
      * Either: 0xEB,0x??, 0x90
      * or: 0xE9,0x??,0x??
      */
-    dev.read_byte(&data);
-    if (data == 0xEB) {
-        dev.read_byte(&data);
-        dev.read_byte(&data);
-        if (data != 0x90)
+    if (dev_read(vol, 0, jump, sizeof(jump)) < 0)
+        return -1;
+    if (jump[0] == 0xEB) {
+        if (jump[2] != 0x90)
             return -INVALID_JUMP_INSTRUCTION;
-    } else if (data == 0xE9) {
-        dev.read_byte(&data);
-        dev.read_byte(&data);
-    } else {
+    } else if (jump[0] != 0xE9) {
         return -INVALID_JUMP_INSTRUCTION;
     }
 
-    dev.read(&bpb.oem_name, 8);
-    FAT16DBG("FAT16: OEM NAME: %s\n", bpb.oem_name);
-    dev.read(&bpb.bytes_per_sector, 2);
-    FAT16DBG("FAT16: bytes per sector: %u\n", bpb.bytes_per_sector);
-    if (bpb.bytes_per_sector != 512
-        && bpb.bytes_per_sector != 1024
-        && bpb.bytes_per_sector != 2048
-        && bpb.bytes_per_sector != 4096)
+    dev_read(vol, 3, &vol->bpb.oem_name, 8);
+    FAT16DBG("FAT16: OEM NAME: %s\n", vol->bpb.oem_name);
+    dev_read(vol, 11, &vol->bpb.bytes_per_sector, 2);
+    FAT16DBG("FAT16: bytes per sector: %u\n", vol->bpb.bytes_per_sector);
+    if (vol->bpb.bytes_per_sector != 512
+        && vol->bpb.bytes_per_sector != 1024
+        && vol->bpb.bytes_per_sector != 2048
+        && vol->bpb.bytes_per_sector != 4096)
         return -INVALID_BYTES_PER_SECTOR;
 
-    dev.read(&bpb.sectors_per_cluster, 1);
-    FAT16DBG("FAT16: sectors per cluster: %u\n", bpb.sectors_per_cluster);
-    if (bpb.sectors_per_cluster != 1
-        && bpb.sectors_per_cluster != 2
-        && bpb.sectors_per_cluster != 4
-        && bpb.sectors_per_cluster != 8
-        && bpb.sectors_per_cluster != 16
-        && bpb.sectors_per_cluster != 32
-        && bpb.sectors_per_cluster != 64
-        && bpb.sectors_per_cluster != 128)
+    dev_read(vol, 13, &vol->bpb.sectors_per_cluster, 1);
+    FAT16DBG("FAT16: sectors per cluster: %u\n", vol->bpb.sectors_per_cluster);
+    if (vol->bpb.sectors_per_cluster != 1
+        && vol->bpb.sectors_per_cluster != 2
+        && vol->bpb.sectors_per_cluster != 4
+        && vol->bpb.sectors_per_cluster != 8
+        && vol->bpb.sectors_per_cluster != 16
+        && vol->bpb.sectors_per_cluster != 32
+        && vol->bpb.sectors_per_cluster != 64
+        && vol->bpb.sectors_per_cluster != 128)
         return -INVALID_SECTOR_PER_CLUSTER;
 
-    if (bpb.bytes_per_sector * bpb.sectors_per_cluster > MAX_BYTES_PER_CLUSTER)
+    if (vol->bpb.bytes_per_sector * vol->bpb.sectors_per_cluster > MAX_BYTES_PER_CLUSTER)
         return -INVALID_BYTES_PER_CLUSTER;
 
-    dev.read(&bpb.reversed_sector_count, 2);
-    FAT16DBG("FAT16: reserved sector count: %u\n", bpb.reversed_sector_count);
-    if (bpb.reversed_sector_count != 1)
+    dev_read(vol, 14, &vol->bpb.reversed_sector_count, 2);
+    FAT16DBG("FAT16: reserved sector count: %u\n", vol->bpb.reversed_sector_count);
+    if (vol->bpb.reversed_sector_count != 1)
         return -INVALID_RESERVED_SECTOR_COUNT;
 
-    dev.read(&bpb.num_fats, 1);
-    FAT16DBG("FAT16: num fats: %u\n", bpb.num_fats);
+    dev_read(vol, 16, &vol->bpb.num_fats, 1);
+    FAT16DBG("FAT16: num fats: %u\n", vol->bpb.num_fats);
 
-    dev.read(&bpb.root_entry_count, 2);
-    FAT16DBG("FAT16: root entry count: %u\n", bpb.root_entry_count);
-    if ((((32 * bpb.root_entry_count) / bpb.bytes_per_sector) & 0x1) != 0)
+    dev_read(vol, 17, &vol->bpb.root_entry_count, 2);
+    FAT16DBG("FAT16: root entry count: %u\n", vol->bpb.root_entry_count);
+    if ((((32 * vol->bpb.root_entry_count) / vol->bpb.bytes_per_sector) & 0x1) != 0)
         return -INVALID_ROOT_ENTRY_COUNT;
 
-    dev.read(&bpb.sector_count, 2);
+    /* Media, sector per track, number of heads and hidden sectors are skipped */
+    dev_read(vol, 19, &vol->bpb.sector_count, 2);
+    dev_read(vol, 22, &vol->bpb.fat_size, 2);
+    FAT16DBG("FAT16: fat size: %u\n", vol->bpb.fat_size);
 
-
-    /* Skip media */
-    dev.read_byte(&data);
-
-    dev.read(&bpb.fat_size, 2);
-    FAT16DBG("FAT16: fat size: %u\n", bpb.fat_size);
-
-    /* Skip sector per track for int 0x13 */
-    dev.read_byte(&data);
-    dev.read_byte(&data);
-
-    /* Skip number of heads for int 0x13 */
-    dev.read_byte(&data);
-    dev.read_byte(&data);
-
-    /* Skip hidden sectors */
-    dev.read_byte(&data);
-    dev.read_byte(&data);
-    dev.read_byte(&data);
-    dev.read_byte(&data);
-
-    uint32_t sector_count_32b;
-    dev.read(&sector_count_32b, 4);
-    if ((bpb.sector_count != 0 && sector_count_32b != 0)
-        || (bpb.sector_count == 0 && sector_count_32b == 0))
+    dev_read(vol, 32, &sector_count_32b, 4);
+    if ((vol->bpb.sector_count != 0 && sector_count_32b != 0)
+        || (vol->bpb.sector_count == 0 && sector_count_32b == 0))
         return -INVALID_SECTOR_COUNT;
 
-    if (bpb.sector_count == 0)
-        bpb.sector_count = sector_count_32b;
-    FAT16DBG("FAT16: sector count: %u\n", bpb.sector_count);
-
-    /* Skip drive number */
-    dev.read_byte(&data);
+    if (vol->bpb.sector_count == 0)
+        vol->bpb.sector_count = sector_count_32b;
+    FAT16DBG("FAT16: sector count: %u\n", vol->bpb.sector_count);
 
-    /* Skip reserved byte */
-    dev.read_byte(&data);
-
-    dev.read_byte(&data);
+    /* Drive number and reserved byte are skipped */
+    dev_read(vol, 38, &data, 1);
     if (data == 0x29) {
-        dev.read(&bpb.volume_id, 4);
-        FAT16DBG("FAT16: volume ID: %u\n", bpb.volume_id);
+        dev_read(vol, 39, &vol->bpb.volume_id, 4);
+        FAT16DBG("FAT16: volume ID: %u\n", vol->bpb.volume_id);
 
-        dev.read(&bpb.label, 11);
-        FAT16DBG("FAT16: label: %s\n", bpb.label);
+        dev_read(vol, 43, &vol->bpb.label, 11);
+        FAT16DBG("FAT16: label: %s\n", vol->bpb.label);
 
-        dev.read(bpb.fs_type, 8);
-        FAT16DBG("FAT16: fs type: %s\n", bpb.fs_type);
+        dev_read(vol, 54, vol->bpb.fs_type, 8);
+        FAT16DBG("FAT16: fs type: %s\n", vol->bpb.fs_type);
     }
 
     return 0;
 }
 
-static uint8_t find_available_handle(void)
+/**
+ * @brief Write the FAT kept in memory and all dirty sectors to the device
+ *
+ * Sectors are written in three steps separated by a device sync: content
+ * of files, then the FAT, then directory entries. An interruption can then
+ * leak clusters but never leaves an entry pointing to unwritten data.
+ *
+ * @param[in] vol
+ * @return 0 if successful, -1 otherwise
+ */
+static int flush_all(struct fat16_volume *vol)
 {
-    uint8_t i = 0;
+    if (cache_flush(vol, DATA_SECTOR) < 0
+    ||  dev_sync(vol) < 0)
+        return -1;
 
-    for (; i < HANDLE_COUNT; ++i) {
-        if (handles[i].mode == 0)
-            return i;
-    }
+    if (fat_table_flush(vol) < 0
+    ||  cache_flush(vol, FAT_SECTOR) < 0
+    ||  dev_sync(vol) < 0)
+        return -1;
+
+    if (cache_flush(vol, ENTRY_SECTOR) < 0)
+        return -1;
+
+    return dev_sync(vol);
+}
 
-    return INVALID_HANDLE;
+/** @return True if volume is mounted, false otherwise */
+static bool check_volume(struct fat16_volume *vol)
+{
+    return vol != NULL && vol->is_mounted;
 }
 
 /** @return True if handle is valid, false otherwise */
-static bool check_handle(uint8_t handle)
+static bool check_handle(struct fat16_volume *vol, uint8_t handle)
 {
+    if (!check_volume(vol))
+        return false;
+
     if (handle >= HANDLE_COUNT)
         return false;
 
-    if (handles[handle].mode == 0)
+    if (vol->handles[handle].mode == 0)
         return false;
 
     return true;
 }
 
-int fat16_init(struct storage_dev_t _dev, uint32_t offset)
+int mount_volume(struct fat16_volume *vol, struct block_dev_t dev, uint32_t first_sector)
 {
+    int ret;
     uint32_t data_sector_count, root_directory_sector_count;
 
-    dev = _dev;
-    layout.offset = offset;
-    int ret = fat16_read_bpb();
+    vol->is_mounted = false;
+
+    if (blockdev_init(vol, dev, first_sector) < 0)
+        return -INVALID_DEVICE_SECTOR_SIZE;
 
+    ret = fat16_read_bpb(vol);
     if (ret < 0)
         return ret;
 
-    root_directory_sector_count = (bpb.root_entry_count * 32) / bpb.bytes_per_sector;
+    root_directory_sector_count = (vol->bpb.root_entry_count * 32) / vol->bpb.bytes_per_sector;
     FAT16DBG("FAT16: root directory sector count: %u\n", root_directory_sector_count);
 
     /* Find number of sectors in data region */
-    data_sector_count = bpb.sector_count - (bpb.reversed_sector_count + (bpb.num_fats * bpb.fat_size) + root_directory_sector_count);
-    layout.data_cluster_count = data_sector_count / bpb.sectors_per_cluster;
+    data_sector_count = vol->bpb.sector_count - (vol->bpb.reversed_sector_count + (vol->bpb.num_fats * vol->bpb.fat_size) + root_directory_sector_count);
+    vol->layout.data_cluster_count = data_sector_count / vol->bpb.sectors_per_cluster;
 
-    if (layout.data_cluster_count < 4085
-        || layout.data_cluster_count >= 65525)
+    if (vol->layout.data_cluster_count < 4085
+        || vol->layout.data_cluster_count >= 65525)
         return -INVALID_FAT_TYPE;
 
-    layout.start_fat_region = bpb.reversed_sector_count;
-    layout.start_fat_region *= bpb.bytes_per_sector;
-    layout.start_root_directory_region = bpb.num_fats;
-    layout.start_root_directory_region *= bpb.fat_size;
-    layout.start_root_directory_region *= bpb.bytes_per_sector;
-    layout.start_root_directory_region += layout.start_fat_region;
-    layout.start_data_region = root_directory_sector_count;
-    layout.start_data_region *= bpb.bytes_per_sector;
-    layout.start_data_region += layout.start_root_directory_region;
+    vol->layout.start_fat_region = vol->bpb.reversed_sector_count;
+    vol->layout.start_fat_region *= vol->bpb.bytes_per_sector;
+    vol->layout.start_root_directory_region = vol->bpb.num_fats;
+    vol->layout.start_root_directory_region *= vol->bpb.fat_size;
+    vol->layout.start_root_directory_region *= vol->bpb.bytes_per_sector;
+    vol->layout.start_root_directory_region += vol->layout.start_fat_region;
+    vol->layout.start_data_region = root_directory_sector_count;
+    vol->layout.start_data_region *= vol->bpb.bytes_per_sector;
+    vol->layout.start_data_region += vol->layout.start_root_directory_region;
     FAT16DBG("FAT16: file system layout:\n");
-    FAT16DBG("\tstart_fat_region=%08X\n", layout.start_fat_region);
-    FAT16DBG("\tstart_root_directory_region=%08X\n", layout.start_root_directory_region);
-    FAT16DBG("\tstart_data_region=%08X\n", layout.start_data_region);
-    FAT16DBG("\tdata cluster count: %u\n", layout.data_cluster_count);
+    FAT16DBG("\tstart_fat_region=%08X\n", vol->layout.start_fat_region);
+    FAT16DBG("\tstart_root_directory_region=%08X\n", vol->layout.start_root_directory_region);
+    FAT16DBG("\tstart_data_region=%08X\n", vol->layout.start_data_region);
+    FAT16DBG("\tdata cluster count: %u\n", vol->layout.data_cluster_count);
+
+    if (fat_table_init(vol) < 0)
+        return -1;
 
     /* Make sure that all handles are available */
-    memset(handles, 0, sizeof(handles));
+    memset(vol->handles, 0, sizeof(vol->handles));
+    init_open_files(vol);
+    dentry_init(vol);
+    path_cache_init(vol);
+    memset(vol->views, 0, sizeof(vol->views));
+    memset(vol->dirs, 0, sizeof(vol->dirs));
+    memset(vol->async_requests, 0, sizeof(vol->async_requests));
+    vol->async_sequence = 0;
+#if FAT16_READAHEAD_COUNT > 0
+    memset(vol->readaheads, 0, sizeof(vol->readaheads));
+    vol->readahead_clusters = FAT16_READAHEAD_SIZE / (vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector);
+    if (vol->readahead_clusters < 2) {
+        FAT16DBG("FAT16: Clusters are too large to be read ahead.\n");
+        vol->readahead_clusters = 0;
+    }
+#endif
 
+    vol->is_mounted = true;
     return 0;
 }
 
-int fat16_open(const char *filepath, char mode)
+int fat16_mount(struct fat16_volume **volume, struct block_dev_t dev, uint32_t first_sector)
+{
+    int i;
+
+    int ret = -1;
+
+    if (volume == NULL)
+        return -1;
+
+    lock_volume_table();
+    for (i = 0; i < FAT16_VOLUME_COUNT; ++i) {
+        if (volumes[i].is_mounted)
+            continue;
+
+#ifdef FAT16_THREAD_SAFE
+        volumes[i].index = i;
+#endif
+        ret = mount_volume(&volumes[i], dev, first_sector);
+        if (ret == 0)
+            *volume = &volumes[i];
+        break;
+    }
+    unlock_volume_table();
+
+    if (i == FAT16_VOLUME_COUNT) {
+        FAT16DBG("FAT16: No volume available.\n");
+    }
+
+    return ret;
+}
+
+static int unmount_volume(struct fat16_volume *vol)
 {
     int i;
+
+    if (!check_volume(vol))
+        return -1;
+
+    /* Refuse to unmount a volume which is still in use */
+    if (count_open_handles(vol) > 0)
+        return -1;
+    for (i = 0; i < FAT16_VIEW_COUNT; ++i) {
+        if (vol->views[i].is_used)
+            return -1;
+    }
+    for (i = 0; i < FAT16_DIR_COUNT; ++i) {
+        if (vol->dirs[i].is_used)
+            return -1;
+    }
+
+    if (flush_all(vol) < 0)
+        return -1;
+
+    vol->is_mounted = false;
+    return 0;
+}
+
+int fat16_unmount(struct fat16_volume *vol)
+{
+    int ret;
+
+    lock_volume_table();
+    if (!lock_volume(vol, true)) {
+        unlock_volume_table();
+        return -1;
+    }
+    ret = unmount_volume(vol);
+    unlock_volume(vol);
+    unlock_volume_table();
+
+    return ret;
+}
+
+
+/**
+ * @brief Open the entry of a file
+ *
+ * @param[in] vol
+ * @param[out] handle
+ * @param[in] dir_handle Directory of the file, NULL if it is in the root directory
+ * @param[in] filename
+ * @param[in] mode
+ * @return 0 if successful, -1 otherwise
+ */
+static int open_file_entry(struct fat16_volume *vol, struct entry_handle *handle, const struct entry_handle *dir_handle, char *filename, char mode)
+{
+    if (dir_handle == NULL)
+        return open_file_in_root(vol, handle, filename, mode);
+
+    *handle = *dir_handle;
+    return open_file_in_subdir(vol, handle, filename, mode);
+}
+
+static int create_file_entry(struct fat16_volume *vol, const struct entry_handle *dir_handle, char *filename)
+{
+    struct entry_handle h;
+
+    if (dir_handle == NULL)
+        return create_file_in_root(vol, filename);
+
+    h = *dir_handle;
+    return create_file_in_subdir(vol, &h, filename);
+}
+
+static int delete_file_entry(struct fat16_volume *vol, const struct entry_handle *dir_handle, char *filename)
+{
+    struct entry_handle h;
+
+    if (dir_handle == NULL)
+        return delete_file_in_root(vol, filename);
+
+    h = *dir_handle;
+    return delete_file_in_subdir(vol, &h, filename);
+}
+
+static int open_file(struct fat16_volume *vol, const char *filepath, char mode)
+{
+    int handle;
     char filename[11];
-    uint8_t handle = INVALID_HANDLE;
+    struct entry_handle h, dir_handle, *dir = NULL;
+    bool exists;
+
+    if (!check_volume(vol))
+        return -1;
 
     if (mode != 'r' && mode != 'w' && mode != 'a') {
         FAT16DBG("FAT16: Invalid mode.\n");
@@ -243,8 +377,7 @@ int fat16_open(const char *filepath, char mode)
         return -1;
     }
 
-    handle = find_available_handle();
-    if (handle == INVALID_HANDLE) {
+    if (!has_free_handle(vol)) {
         FAT16DBG("FAT16: No available handle found.\n");
         return -1;
     }
@@ -252,93 +385,110 @@ int fat16_open(const char *filepath, char mode)
     if (is_in_root(filepath)) {
         if (to_short_filename(filename, filepath) < 0)
             return -1;
-
-        if (mode == 'w') {
-            /* Delete existing file */
-            if (!open_file_in_root(&handles[handle], filename, mode)) {
-                if (delete_file_in_root(filename) < 0)
-                    return -1;
-            }
-
-            if (create_file_in_root(filename) < 0)
-                return -1;
-        } else if (mode == 'a') {
-            /* Create file if it does not exist */
-            if (open_file_in_root(&handles[handle], filename, mode) < 0) {
-                if (create_file_in_root(filename) < 0) {
-                    handles[handle].mode = 0;
-                    return -1;
-                }
-            }
-        }
-
-        if (open_file_in_root(&handles[handle], filename, mode) < 0) {
-            handles[handle].mode = 0;
-            return -1;
-        }
     } else {
-        struct entry_handle dir_handle;
-        if (navigate_to_subdir(&dir_handle, filename, filepath) < 0)
-            return -1;
-
-        if (mode == 'w') {
-            /* Delete existing file */
-            struct entry_handle h = dir_handle;
-            if (!open_file_in_subdir(&h, filename, mode)) {
-                h = dir_handle;
-                if (delete_file_in_subdir(&h, filename) < 0)
-                    return -1;
-            }
-            h = dir_handle;
-            if (create_file_in_subdir(&h, filename) < 0)
-                return -1;
-        } else if (mode == 'a') {
-            /* Create file if it does not exist */
-            struct entry_handle h = dir_handle;
-            if (open_file_in_subdir(&h, filename, mode) < 0) {
-                if (create_file_in_subdir(&h, filename) < 0)
-                    return -1;
-            }
-        }
-        if (open_file_in_subdir(&dir_handle, filename, mode) < 0)
+        if (navigate_to_subdir(vol, &dir_handle, filename, filepath) < 0)
             return -1;
-
-        handles[handle] = dir_handle;
+        dir = &dir_handle;
     }
 
     /*
-     * To avoid bugs, we restrict opening the same file several times.
-     * If a file is opened in write mode, this file cannot be opened anymore until
-     * is closed.
-     * If a file is opened in read mode, this file cannot be opened later in write
-     * mode. Hence, a file can only be opened several times in read mode.
+     * A file can be opened several times in read mode only. This must be
+     * checked before the content of the file is erased.
      */
-    for (i = 0; i < HANDLE_COUNT; ++i) {
-        if (handles[i].mode == 0)
-            continue;
+    exists = open_file_entry(vol, &h, dir, filename, mode) == 0;
+    if (exists && !can_open_file(vol, h.pos_entry, mode)) {
+        FAT16DBG("FAT16: File is already open.\n");
+        return -1;
+    }
 
-        if (i == handle)
-            continue;
+    if (mode == 'r' && !exists)
+        return -1;
+
+    /* Delete existing file */
+    if (mode == 'w' && exists && delete_file_entry(vol, dir, filename) < 0)
+        return -1;
+
+    /* Create file if it does not exist anymore */
+    if ((mode == 'w' || !exists)
+    &&  (create_file_entry(vol, dir, filename) < 0
+      || open_file_entry(vol, &h, dir, filename, mode) < 0))
+        return -1;
+
+    handle = add_handle(vol, &h);
+    if (handle < 0)
+        return -1;
 
-        if (handles[handle].pos_entry == handles[i].pos_entry) {
-            if ((mode == 'r' && handles[i].mode != 'r') || mode != 'r') {
-                handles[handle].mode = 0;
-                return -1;
+#if FAT16_EXTENT_COUNT > 0
+    /* Clusters of the file are recorded in its extent map as they are accessed */
+    vol->handles[handle].extents = &vol->extent_maps[handle];
+    init_extent_map(vol->handles[handle].extents, vol->handles[handle].starting_cluster);
+#endif
+
+#if FAT16_READAHEAD_COUNT > 0
+    /* Files in read mode get a readahead buffer while there are some left */
+    if (mode == 'r' && vol->readahead_clusters > 0) {
+        uint8_t i;
+
+        for (i = 0; i < FAT16_READAHEAD_COUNT; ++i) {
+            if (!vol->readaheads[i].is_used) {
+                vol->readaheads[i].is_used = true;
+                init_readahead(&vol->readaheads[i], vol->handles[handle].position);
+                vol->handles[handle].readahead = &vol->readaheads[i];
+                break;
             }
         }
     }
+#endif
+
+    /* Make sure that the file entry is written to the device */
+    if (mode != 'r' && flush_all(vol) < 0) {
+        remove_handle(vol, handle);
+        return -1;
+    }
 
     return handle;
 }
 
-int fat16_read(uint8_t handle, void *buffer, uint32_t count)
+int fat16_vol_open(struct fat16_volume *vol, const char *filepath, char mode)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = open_file(vol, filepath, mode);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+/** @return True if an asynchronous request of handle is not complete */
+static bool has_pending_request(struct fat16_volume *vol, uint8_t handle)
+{
+    uint8_t i;
+
+    for (i = 0; i < FAT16_ASYNC_COUNT; ++i) {
+        if (vol->async_requests[i].handle == handle
+        &&  (vol->async_requests[i].state == ASYNC_QUEUED
+          || vol->async_requests[i].state == ASYNC_RUNNING))
+            return true;
+    }
+
+    return false;
+}
+
+static int read_file(struct fat16_volume *vol, uint8_t handle, void *buffer, uint32_t count)
 {
-    if (check_handle(handle) == false) {
+    if (check_handle(vol, handle) == false) {
         FAT16DBG("FAT16: fat16_read: Invalid handle.\n");
         return -1;
     }
 
-    if (handles[handle].mode != 'r') {
+    if (has_pending_request(vol, handle)) {
+        FAT16DBG("FAT16: fat16_read: Asynchronous requests are not complete.\n");
+        return -1;
+    }
+
+    if (vol->handles[handle].mode != 'r') {
         FAT16DBG("FAT16: fat16_read: Cannot read with handle in write mode.\n");
         return -1;
     }
@@ -351,17 +501,34 @@ int fat16_read(uint8_t handle, void *buffer, uint32_t count)
     if (count == 0)
         return 0;
 
-    return read_from_handle(&handles[handle], buffer, count);
+    return read_from_handle(vol, &vol->handles[handle], buffer, count);
+}
+
+int fat16_vol_read(struct fat16_volume *vol, uint8_t handle, void *buffer, uint32_t count)
+{
+    int ret;
+
+    if (!lock_file(vol, handle))
+        return -1;
+    ret = read_file(vol, handle, buffer, count);
+    unlock_file(vol, handle);
+
+    return ret;
 }
 
-int fat16_write(uint8_t handle, const void *buffer, uint32_t count)
+static int write_file(struct fat16_volume *vol, uint8_t handle, const void *buffer, uint32_t count)
 {
-    if (check_handle(handle) == false) {
+    if (check_handle(vol, handle) == false) {
         FAT16DBG("FAT16: fat16_write: Invalid handle.\n");
         return -1;
     }
 
-    if (handles[handle].mode == 'r') {
+    if (has_pending_request(vol, handle)) {
+        FAT16DBG("FAT16: fat16_write: Asynchronous requests are not complete.\n");
+        return -1;
+    }
+
+    if (vol->handles[handle].mode == 'r') {
         FAT16DBG("FAT16: fat16_write: Cannot write with handle in read mode.\n");
         return -1;
     }
@@ -374,169 +541,1306 @@ int fat16_write(uint8_t handle, const void *buffer, uint32_t count)
     if (count == 0)
         return 0;
 
-    return write_from_handle(&handles[handle], buffer, count);
+    /* In append mode, data is always written at the end of the file */
+    if (vol->handles[handle].mode == 'a'
+    &&  move_handle(vol, &vol->handles[handle], vol->handles[handle].size) < 0)
+        return -1;
+
+    return write_from_handle(vol, &vol->handles[handle], buffer, count);
 }
 
-int fat16_close(uint8_t handle)
+int fat16_vol_write(struct fat16_volume *vol, uint8_t handle, const void *buffer, uint32_t count)
 {
-    if (check_handle(handle) == false) {
-        FAT16DBG("FAT16: fat16_write: Invalid handle.\n");
+    int ret;
+
+    if (!lock_volume(vol, true))
         return -1;
-    }
+    ret = write_file(vol, handle, buffer, count);
+    unlock_volume(vol);
 
-    handles[handle].mode = 0;
-    return 0;
+    return ret;
 }
 
-int fat16_rm(const char *filepath)
+/**
+ * @brief Check that all buffers of a vector are valid
+ *
+ * @param[in] iov
+ * @param[in] iov_count
+ * @return True if the vector is valid
+ */
+static bool check_iovec(const struct fat16_iovec *iov, uint8_t iov_count)
 {
-    char filename[11];
+    uint8_t i;
 
-    if (filepath == NULL) {
-        FAT16DBG("FAT16: Cannot open a file with a null path string.\n");
+    if (iov == NULL)
+        return false;
+
+    for (i = 0; i < iov_count; ++i) {
+        if (iov[i].base == NULL && iov[i].length > 0)
+            return false;
+    }
+
+    return true;
+}
+
+static int readv_file(struct fat16_volume *vol, uint8_t handle, const struct fat16_iovec *iov, uint8_t iov_count)
+{
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_readv: Invalid handle.\n");
         return -1;
     }
 
-    if (is_in_root(filepath)) {
-        if (to_short_filename(filename, filepath) < 0)
-            return -1;
+    if (has_pending_request(vol, handle)) {
+        FAT16DBG("FAT16: fat16_readv: Asynchronous requests are not complete.\n");
+        return -1;
+    }
 
-        if (delete_file_in_root(filename) < 0)
-            return -1;
-    } else {
-        struct entry_handle dir_handle;
-        if (navigate_to_subdir(&dir_handle, filename, filepath) < 0)
-            return -1;
+    if (vol->handles[handle].mode != 'r') {
+        FAT16DBG("FAT16: fat16_readv: Cannot read with handle in write mode.\n");
+        return -1;
+    }
 
-        if (delete_file_in_subdir(&dir_handle, filename) < 0)
-            return -1;
+    if (check_iovec(iov, iov_count) == false) {
+        FAT16DBG("FAT16: fat16_readv: Cannot read using null buffer.\n");
+        return -1;
     }
 
-    return 0;
+    return read_vector_from_handle(vol, &vol->handles[handle], iov, iov_count);
 }
 
-int fat16_ls(uint32_t *index, char *filename, const char *dirpath)
+int fat16_vol_readv(struct fat16_volume *vol, uint8_t handle, const struct fat16_iovec *iov, uint8_t iov_count)
 {
     int ret;
-    char name[11];
 
-    if (index == NULL || filename == NULL)
+    if (!lock_file(vol, handle))
         return -1;
+    ret = readv_file(vol, handle, iov, iov_count);
+    unlock_file(vol, handle);
 
-    if (dirpath == NULL || dirpath[0] != '/')
+    return ret;
+}
+
+static int writev_file(struct fat16_volume *vol, uint8_t handle, const struct fat16_iovec *iov, uint8_t iov_count)
+{
+    uint32_t count = 0;
+    uint8_t i;
+
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_writev: Invalid handle.\n");
         return -1;
+    }
 
-    if (dirpath[1] == '\0') {
-        ret = ls_in_root(index, name);
-    } else {
-        struct entry_handle handle;
-        char dirname[11];
-
-        if (is_in_root(dirpath)) {
-            if (to_short_filename(dirname, dirpath) < 0)
-                return -1;
-
-            if (open_directory_in_root(&handle, dirname) < 0)
-                return -1;
-        } else {
-            if (navigate_to_subdir(&handle, dirname, dirpath) < 0
-            ||  open_directory_in_subdir(&handle, dirname) < 0)
-                return -1;
-        }
+    if (has_pending_request(vol, handle)) {
+        FAT16DBG("FAT16: fat16_writev: Asynchronous requests are not complete.\n");
+        return -1;
+    }
 
-        ret = ls_in_subdir(index, name, &handle);
+    if (vol->handles[handle].mode == 'r') {
+        FAT16DBG("FAT16: fat16_writev: Cannot write with handle in read mode.\n");
+        return -1;
     }
 
-    if (ret == 1) {
-        uint8_t name_length = 0, ext_length = 0;
+    if (check_iovec(iov, iov_count) == false) {
+        FAT16DBG("FAT16: fat16_writev: Cannot write using null buffer.\n");
+        return -1;
+    }
 
-        /* Special case for . and .. entries */
-        if (name[0] == '.' && name[1] == ' ') {
-            filename[0] = '.';
-            filename[1] = '\0';
-            return 1;
-        } else if (name[0] == '.' && name[1] == '.' && name[2] == ' ') {
-            filename[0] = '.';
-            filename[1] = '.';
-            filename[2] = '\0';
-            return 1;
-        }
+    for (i = 0; i < iov_count; ++i)
+        count += iov[i].length;
 
-        /*
-         * Reformat filename:
-         *   - Trim name
-         *   - Add '.' to separate name and extension
-         *   - Trim extension
-         *   - Add null terminated
-         */
-        for (name_length = 0; name_length < 8; ++name_length) {
-            char c = name[name_length];
-            if (c == ' ')
-                break;
+    if (count == 0)
+        return 0;
 
-            filename[name_length] = c;
-        }
+    /* In append mode, data is always written at the end of the file */
+    if (vol->handles[handle].mode == 'a'
+    &&  move_handle(vol, &vol->handles[handle], vol->handles[handle].size) < 0)
+        return -1;
 
-        filename[name_length] = '.';
+    return write_vector_from_handle(vol, &vol->handles[handle], iov, iov_count);
+}
 
-        for (ext_length = 0; ext_length < 3; ++ext_length) {
-            char c = name[8 + ext_length];
-            if (c == ' ')
-                break;
-            filename[name_length + 1 + ext_length] = c;
-        }
+int fat16_vol_writev(struct fat16_volume *vol, uint8_t handle, const struct fat16_iovec *iov, uint8_t iov_count)
+{
+    int ret;
 
-        filename[name_length + 1 + ext_length] = '\0';
-    }
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = writev_file(vol, handle, iov, iov_count);
+    unlock_volume(vol);
 
     return ret;
 }
 
-int fat16_mkdir(const char *dirpath)
+/**
+ * @brief Queue an asynchronous request
+ *
+ * @param[in] vol
+ * @return Request number, -1 if all slots are used
+ */
+static int queue_async_request(struct fat16_volume *vol, uint8_t handle, uint8_t *buffer, uint32_t count, bool is_write, fat16_callback_t callback, void *context)
 {
-    char dirname[11];
+    uint8_t i;
 
-    if (is_in_root(dirpath)) {
-        if (to_short_filename(dirname, dirpath) < 0)
-            return -1;
+    for (i = 0; i < FAT16_ASYNC_COUNT; ++i) {
+        struct async_request *request = &vol->async_requests[i];
 
-        return create_directory_in_root(dirname);
-    } else {
-        struct entry_handle handle;
+        if (request->state != ASYNC_FREE)
+            continue;
 
-        if (navigate_to_subdir(&handle, dirname, dirpath) < 0)
-            return -1;
+        request->state = ASYNC_QUEUED;
+        request->handle = handle;
+        request->is_write = is_write;
+        request->has_failed = false;
+        request->buffer = buffer;
+        request->count = count;
+        request->done_count = 0;
+        request->step_count = 0;
+        request->sequence = vol->async_sequence++;
+        request->result = 0;
+        request->callback = callback;
+        request->context = context;
+
+        return i;
+    }
+
+    FAT16DBG("FAT16: No asynchronous request available.\n");
+    return -1;
+}
+
+static int read_file_async(struct fat16_volume *vol, uint8_t handle, void *buffer, uint32_t count, fat16_callback_t callback, void *context)
+{
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_read_async: Invalid handle.\n");
+        return -1;
+    }
+
+    if (vol->handles[handle].mode != 'r') {
+        FAT16DBG("FAT16: fat16_read_async: Cannot read with handle in write mode.\n");
+        return -1;
+    }
 
-        return create_directory_in_subdir(&handle, dirname);
+    if (buffer == NULL) {
+        FAT16DBG("FAT16: fat16_read_async: Cannot read using null buffer.\n");
+        return -1;
     }
+
+    return queue_async_request(vol, handle, (uint8_t *)buffer, count, false, callback, context);
 }
 
-int fat16_rmdir(const char *dirpath)
+int fat16_vol_read_async(struct fat16_volume *vol, uint8_t handle, void *buffer, uint32_t count, fat16_callback_t callback, void *context)
 {
-    char dirname[11];
-    struct entry_handle handle, dir_handle;
-    bool in_root = is_in_root(dirpath);
+    int ret;
 
-    if (in_root) {
-        if (to_short_filename(dirname, dirpath) < 0)
-            return -1;
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = read_file_async(vol, handle, buffer, count, callback, context);
+    unlock_volume(vol);
 
-        if (open_directory_in_root(&handle, dirname) < 0)
-            return -1;
-    } else {
-        if (navigate_to_subdir(&dir_handle, dirname, dirpath) < 0)
-            return -1;
+    return ret;
+}
 
-        handle = dir_handle;
-        if (open_directory_in_subdir(&handle, dirname) < 0)
-            return -1;
+static int write_file_async(struct fat16_volume *vol, uint8_t handle, const void *buffer, uint32_t count, fat16_callback_t callback, void *context)
+{
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_write_async: Invalid handle.\n");
+        return -1;
     }
 
-    if (!is_subdir_empty(&handle))
+    if (vol->handles[handle].mode == 'r') {
+        FAT16DBG("FAT16: fat16_write_async: Cannot write with handle in read mode.\n");
         return -1;
+    }
+
+    if (buffer == NULL) {
+        FAT16DBG("FAT16: fat16_write_async: Cannot write using null buffer.\n");
+        return -1;
+    }
+
+    return queue_async_request(vol, handle, (uint8_t *)buffer, count, true, callback, context);
+}
+
+int fat16_vol_write_async(struct fat16_volume *vol, uint8_t handle, const void *buffer, uint32_t count, fat16_callback_t callback, void *context)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = write_file_async(vol, handle, buffer, count, callback, context);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+/**
+ * @brief Find the oldest asynchronous request which is not complete
+ *
+ * @param[in] vol
+ * @return Index of the request, FAT16_ASYNC_COUNT if there is none
+ */
+static uint8_t find_current_request(struct fat16_volume *vol)
+{
+    uint8_t i, current = FAT16_ASYNC_COUNT;
+
+    for (i = 0; i < FAT16_ASYNC_COUNT; ++i) {
+        if (vol->async_requests[i].state != ASYNC_QUEUED
+        &&  vol->async_requests[i].state != ASYNC_RUNNING)
+            continue;
+
+        /* Sequence numbers can wrap around */
+        if (current == FAT16_ASYNC_COUNT
+        ||  (int32_t)(vol->async_requests[i].sequence - vol->async_requests[current].sequence) < 0)
+            current = i;
+    }
+
+    return current;
+}
+
+/**
+ * @brief Queue the transfers of the next step of a request and start them
+ *
+ * @param[in] vol
+ * @param[in] index
+ */
+static void start_async_step(struct fat16_volume *vol, uint8_t index)
+{
+    struct async_request *request = &vol->async_requests[index];
+    struct entry_handle *handle = &vol->handles[request->handle];
+    uint8_t *buffer = &request->buffer[request->done_count];
+    uint32_t count = request->count - request->done_count;
+    int32_t ret = 0;
+
+    /* In append mode, data is always written at the end of the file */
+    if (request->is_write && request->done_count == 0 && handle->mode == 'a'
+    &&  move_handle(vol, handle, handle->size) < 0) {
+        request->has_failed = true;
+        count = 0;
+    }
+
+    if (count > 0 && request->is_write)
+        ret = queue_write_from_handle(vol, handle, buffer, count);
+    else if (count > 0)
+        ret = queue_read_from_handle(vol, handle, buffer, count);
+
+    if (ret < 0) {
+        /* Queued transfers must be performed even if an error happened */
+        dev_submit(vol);
+        request->has_failed = true;
+        ret = 0;
+    }
+
+    request->step_count = ret;
+    request->state = ASYNC_RUNNING;
+    dev_start(vol);
+}
+
+/**
+ * @brief Complete a request, its callback is invoked if it has one
+ *
+ * @param[in] vol
+ * @param[in] index
+ */
+static void complete_async_request(struct fat16_volume *vol, uint8_t index)
+{
+    struct async_request *request = &vol->async_requests[index];
+
+    /* Clusters allocated for the whole request may not all have been written */
+    if (request->is_write && request->has_failed)
+        vol->handles[request->handle].has_reserved_clusters = true;
+
+    /* As fat16_write, fail if nothing could be written */
+    if (request->done_count == 0
+    &&  (request->has_failed || (request->is_write && request->count > 0)))
+        request->result = -1;
+    else
+        request->result = request->done_count;
+
+    if (request->callback == NULL) {
+        request->state = ASYNC_DONE;
+        return;
+    }
+
+    /* The callback can start a new request in this slot */
+    request->state = ASYNC_FREE;
+    request->callback(index, request->result, request->context);
+}
+
+/**
+ * @brief Check if the transfers of the current step of a request are complete
+ *
+ * @param[in] vol
+ * @param[in] index
+ */
+static void check_async_step(struct fat16_volume *vol, uint8_t index)
+{
+    struct async_request *request = &vol->async_requests[index];
+    int ret = dev_poll(vol);
+
+    if (ret == 0)
+        return;
+
+    if (ret < 0) {
+        request->has_failed = true;
+    } else {
+        request->done_count += request->step_count;
+
+        /* The data is on the device, the size of the file can be updated */
+        if (request->is_write)
+            update_size_file(vol, &vol->handles[request->handle]);
+    }
 
-    if (in_root)
-        return delete_directory_in_root(dirname);
+    if (request->has_failed
+    ||  request->step_count == 0
+    ||  request->done_count == request->count)
+        complete_async_request(vol, index);
     else
-        return delete_directory_in_subdir(&dir_handle, dirname);
+        request->state = ASYNC_QUEUED;
+}
+
+static int poll_requests(struct fat16_volume *vol)
+{
+    uint8_t i, index;
+    int pending_count = 0;
+
+    if (!check_volume(vol))
+        return -1;
+
+    index = find_current_request(vol);
+    if (index < FAT16_ASYNC_COUNT) {
+        if (vol->async_requests[index].state == ASYNC_QUEUED)
+            start_async_step(vol, index);
+        check_async_step(vol, index);
+    }
+
+    for (i = 0; i < FAT16_ASYNC_COUNT; ++i) {
+        if (vol->async_requests[i].state == ASYNC_QUEUED
+        ||  vol->async_requests[i].state == ASYNC_RUNNING)
+            ++pending_count;
+    }
+
+    return pending_count;
+}
+
+int fat16_vol_poll(struct fat16_volume *vol)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = poll_requests(vol);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int get_request_result(struct fat16_volume *vol, int request, int *result)
+{
+    if (!check_volume(vol))
+        return -1;
+
+    if (request < 0 || request >= FAT16_ASYNC_COUNT
+    ||  vol->async_requests[request].state == ASYNC_FREE
+    ||  vol->async_requests[request].callback != NULL) {
+        FAT16DBG("FAT16: fat16_get_result: Invalid request.\n");
+        return -1;
+    }
+
+    if (result == NULL) {
+        FAT16DBG("FAT16: fat16_get_result: Cannot store result using null pointer.\n");
+        return -1;
+    }
+
+    if (vol->async_requests[request].state != ASYNC_DONE)
+        return 0;
+
+    *result = vol->async_requests[request].result;
+    vol->async_requests[request].state = ASYNC_FREE;
+
+    return 1;
+}
+
+int fat16_vol_get_result(struct fat16_volume *vol, int request, int *result)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = get_request_result(vol, request, result);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int read_file_view(struct fat16_volume *vol, uint8_t handle, uint32_t max_count, const void **data, uint32_t *count)
+{
+    const uint8_t *bytes;
+    bool is_pinned;
+    uint8_t i;
+    int ret;
+
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_read_view: Invalid handle.\n");
+        return -1;
+    }
+
+    if (has_pending_request(vol, handle)) {
+        FAT16DBG("FAT16: fat16_read_view: Asynchronous requests are not complete.\n");
+        return -1;
+    }
+
+    if (vol->handles[handle].mode != 'r') {
+        FAT16DBG("FAT16: fat16_read_view: Cannot read with handle in write mode.\n");
+        return -1;
+    }
+
+    if (data == NULL || count == NULL) {
+        FAT16DBG("FAT16: fat16_read_view: Cannot return view using null pointers.\n");
+        return -1;
+    }
+
+    /* The slot is reserved first, readers of other files share the table of views */
+    lock_cache(vol);
+    for (i = 0; i < FAT16_VIEW_COUNT; ++i) {
+        if (!vol->views[i].is_used)
+            break;
+    }
+    if (i < FAT16_VIEW_COUNT)
+        vol->views[i].is_used = true;
+    unlock_cache(vol);
+    if (i == FAT16_VIEW_COUNT) {
+        FAT16DBG("FAT16: fat16_read_view: Too many views.\n");
+        return -1;
+    }
+
+    ret = read_view_from_handle(vol, &vol->handles[handle], max_count, &bytes, count, &is_pinned);
+
+    lock_cache(vol);
+    if (ret < 0 || *count == 0) {
+        /* End of file reached, there is nothing to release */
+        vol->views[i].is_used = false;
+    } else {
+        vol->views[i].data = bytes;
+        vol->views[i].is_pinned = is_pinned;
+    }
+    unlock_cache(vol);
+
+    if (ret < 0)
+        return -1;
+
+    *data = bytes;
+    return 0;
+}
+
+int fat16_vol_read_view(struct fat16_volume *vol, uint8_t handle, uint32_t max_count, const void **data, uint32_t *count)
+{
+    int ret;
+
+    if (!lock_file(vol, handle))
+        return -1;
+    ret = read_file_view(vol, handle, max_count, data, count);
+    unlock_file(vol, handle);
+
+    return ret;
+}
+
+static int release_file_view(struct fat16_volume *vol, const void *data)
+{
+    bool is_pinned = false;
+    uint8_t i;
+
+    if (!check_volume(vol))
+        return -1;
+
+    lock_cache(vol);
+    for (i = 0; i < FAT16_VIEW_COUNT; ++i) {
+        if (vol->views[i].is_used && vol->views[i].data == data)
+            break;
+    }
+    if (i < FAT16_VIEW_COUNT) {
+        is_pinned = vol->views[i].is_pinned;
+        vol->views[i].is_used = false;
+        vol->views[i].data = NULL;
+    }
+    unlock_cache(vol);
+    if (i == FAT16_VIEW_COUNT) {
+        FAT16DBG("FAT16: fat16_release_view: Invalid view.\n");
+        return -1;
+    }
+
+    if (is_pinned)
+        cache_unpin_sector(vol, data);
+
+    return 0;
+}
+
+int fat16_vol_release_view(struct fat16_volume *vol, const void *data)
+{
+    int ret;
+
+    if (!lock_volume(vol, false))
+        return -1;
+    ret = release_file_view(vol, data);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int pread_file(struct fat16_volume *vol, uint8_t handle, void *buffer, uint32_t count, uint32_t offset)
+{
+    struct entry_handle h;
+
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_pread: Invalid handle.\n");
+        return -1;
+    }
+
+    if (vol->handles[handle].mode != 'r') {
+        FAT16DBG("FAT16: fat16_pread: Cannot read with handle in write mode.\n");
+        return -1;
+    }
+
+    if (buffer == NULL) {
+        FAT16DBG("FAT16: fat16_pread: Cannot read using null buffer.\n");
+        return -1;
+    }
+
+    /* Work on a copy, it shares the extent map of the handle */
+    h = vol->handles[handle];
+    h.readahead = NULL;
+    if (move_handle(vol, &h, offset) < 0) {
+        FAT16DBG("FAT16: fat16_pread: Cannot read past the end of the file.\n");
+        return -1;
+    }
+
+    if (count == 0)
+        return 0;
+
+    return read_from_handle(vol, &h, buffer, count);
+}
+
+int fat16_vol_pread(struct fat16_volume *vol, uint8_t handle, void *buffer, uint32_t count, uint32_t offset)
+{
+    int ret;
+
+    if (!lock_file(vol, handle))
+        return -1;
+    ret = pread_file(vol, handle, buffer, count, offset);
+    unlock_file(vol, handle);
+
+    return ret;
+}
+
+static int pwrite_file(struct fat16_volume *vol, uint8_t handle, const void *buffer, uint32_t count, uint32_t offset)
+{
+    struct entry_handle h;
+    int ret;
+
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_pwrite: Invalid handle.\n");
+        return -1;
+    }
+
+    if (vol->handles[handle].mode == 'r') {
+        FAT16DBG("FAT16: fat16_pwrite: Cannot write with handle in read mode.\n");
+        return -1;
+    }
+
+    if (buffer == NULL) {
+        FAT16DBG("FAT16: fat16_pwrite: Cannot write using null buffer.\n");
+        return -1;
+    }
+
+    /* In append mode, data is always written at the end of the file */
+    if (vol->handles[handle].mode == 'a')
+        offset = vol->handles[handle].size;
+
+    /* Work on a copy, it shares the extent map of the handle */
+    h = vol->handles[handle];
+    if (move_handle(vol, &h, offset) < 0) {
+        FAT16DBG("FAT16: fat16_pwrite: Cannot write past the end of the file.\n");
+        return -1;
+    }
+
+    if (count == 0)
+        return 0;
+
+    ret = write_from_handle(vol, &h, buffer, count);
+
+    /* The file may have grown or received its first cluster */
+    vol->handles[handle].size = h.size;
+    vol->handles[handle].entry_size = h.entry_size;
+    vol->handles[handle].starting_cluster = h.starting_cluster;
+    vol->handles[handle].has_reserved_clusters = h.has_reserved_clusters;
+    if (vol->handles[handle].cluster == 0)
+        vol->handles[handle].cluster = h.starting_cluster;
+
+    return ret;
+}
+
+int fat16_vol_pwrite(struct fat16_volume *vol, uint8_t handle, const void *buffer, uint32_t count, uint32_t offset)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = pwrite_file(vol, handle, buffer, count, offset);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int32_t seek_file(struct fat16_volume *vol, uint8_t handle, int32_t offset, uint8_t whence)
+{
+    struct entry_handle *h;
+    uint32_t position;
+
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_seek: Invalid handle.\n");
+        return -1;
+    }
+
+    if (has_pending_request(vol, handle)) {
+        FAT16DBG("FAT16: fat16_seek: Asynchronous requests are not complete.\n");
+        return -1;
+    }
+
+    h = &vol->handles[handle];
+    switch (whence) {
+    case FAT16_SEEK_SET:
+        position = 0;
+        break;
+    case FAT16_SEEK_CUR:
+        position = h->position;
+        break;
+    case FAT16_SEEK_END:
+        position = h->size;
+        break;
+    default:
+        FAT16DBG("FAT16: fat16_seek: Invalid origin.\n");
+        return -1;
+    }
+
+    /*
+     * Check the bounds before adding offset, so that the new position does
+     * not overflow. -(offset + 1) is representable even for INT32_MIN.
+     */
+    if (offset < 0) {
+        if ((uint32_t)-(offset + 1) >= position) {
+            FAT16DBG("FAT16: fat16_seek: Cannot move before the start of the file.\n");
+            return -1;
+        }
+        position -= (uint32_t)-(offset + 1) + 1;
+    } else {
+        if ((uint32_t)offset > h->size - position) {
+            FAT16DBG("FAT16: fat16_seek: Cannot move past the end of the file.\n");
+            return -1;
+        }
+        position += offset;
+    }
+
+    if (move_handle(vol, h, position) < 0) {
+        FAT16DBG("FAT16: fat16_seek: Cannot move past the end of the file.\n");
+        return -1;
+    }
+
+    return position;
+}
+
+int32_t fat16_vol_seek(struct fat16_volume *vol, uint8_t handle, int32_t offset, uint8_t whence)
+{
+    int32_t ret;
+
+    if (!lock_file(vol, handle))
+        return -1;
+    ret = seek_file(vol, handle, offset, whence);
+    unlock_file(vol, handle);
+
+    return ret;
+}
+
+static int32_t tell_file(struct fat16_volume *vol, uint8_t handle)
+{
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_tell: Invalid handle.\n");
+        return -1;
+    }
+
+    return vol->handles[handle].position;
+}
+
+int32_t fat16_vol_tell(struct fat16_volume *vol, uint8_t handle)
+{
+    int32_t ret;
+
+    if (!lock_file(vol, handle))
+        return -1;
+    ret = tell_file(vol, handle);
+    unlock_file(vol, handle);
+
+    return ret;
+}
+
+static int fallocate_file(struct fat16_volume *vol, uint8_t handle, uint32_t size)
+{
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_fallocate: Invalid handle.\n");
+        return -1;
+    }
+
+    if (vol->handles[handle].mode == 'r') {
+        FAT16DBG("FAT16: fat16_fallocate: Cannot reserve space with handle in read mode.\n");
+        return -1;
+    }
+
+    return reserve_clusters(vol, &vol->handles[handle], size);
+}
+
+int fat16_vol_fallocate(struct fat16_volume *vol, uint8_t handle, uint32_t size)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = fallocate_file(vol, handle, size);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int flush_file(struct fat16_volume *vol, uint8_t handle)
+{
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_flush: Invalid handle.\n");
+        return -1;
+    }
+
+    if (vol->handles[handle].mode == 'r')
+        return 0;
+
+    if (write_size_file(vol, &vol->handles[handle]) < 0)
+        return -1;
+
+    return flush_all(vol);
+}
+
+int fat16_vol_flush(struct fat16_volume *vol, uint8_t handle)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = flush_file(vol, handle);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int sync_volume(struct fat16_volume *vol)
+{
+    uint8_t i;
+
+    if (!check_volume(vol))
+        return -1;
+
+    for (i = 0; i < HANDLE_COUNT; ++i) {
+        if (vol->handles[i].mode == 0 || vol->handles[i].mode == 'r')
+            continue;
+
+        if (write_size_file(vol, &vol->handles[i]) < 0)
+            return -1;
+    }
+
+    return flush_all(vol);
+}
+
+int fat16_vol_sync(struct fat16_volume *vol)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = sync_volume(vol);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int close_file(struct fat16_volume *vol, uint8_t handle)
+{
+    if (check_handle(vol, handle) == false) {
+        FAT16DBG("FAT16: fat16_write: Invalid handle.\n");
+        return -1;
+    }
+
+    if (has_pending_request(vol, handle)) {
+        FAT16DBG("FAT16: fat16_close: Asynchronous requests are not complete.\n");
+        return -1;
+    }
+
+    if (vol->handles[handle].mode != 'r') {
+        /* The handle stays open until the file is written back, close can be retried */
+        if (write_size_file(vol, &vol->handles[handle]) < 0
+        ||  release_unused_clusters(vol, &vol->handles[handle]) < 0
+        ||  flush_all(vol) < 0)
+            return -1;
+
+        remove_handle(vol, handle);
+        return 0;
+    }
+
+#if FAT16_READAHEAD_COUNT > 0
+    if (vol->handles[handle].readahead != NULL)
+        vol->handles[handle].readahead->is_used = false;
+#endif
+
+    remove_handle(vol, handle);
+    return 0;
+}
+
+int fat16_vol_close(struct fat16_volume *vol, uint8_t handle)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = close_file(vol, handle);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int remove_file(struct fat16_volume *vol, const char *filepath)
+{
+    char filename[11];
+    struct entry_handle h, dir_handle, *dir = NULL;
+
+    if (!check_volume(vol))
+        return -1;
+
+    if (filepath == NULL) {
+        FAT16DBG("FAT16: Cannot open a file with a null path string.\n");
+        return -1;
+    }
+
+    if (is_in_root(filepath)) {
+        if (to_short_filename(filename, filepath) < 0)
+            return -1;
+    } else {
+        if (navigate_to_subdir(vol, &dir_handle, filename, filepath) < 0)
+            return -1;
+        dir = &dir_handle;
+    }
+
+    /* The entry and the clusters of an open file are still used by its handles */
+    if (open_file_entry(vol, &h, dir, filename, 'r') < 0)
+        return -1;
+
+    if (!can_open_file(vol, h.pos_entry, 'w')) {
+        FAT16DBG("FAT16: fat16_rm: File is open.\n");
+        return -1;
+    }
+
+    if (delete_file_entry(vol, dir, filename) < 0)
+        return -1;
+
+    return flush_all(vol);
+}
+
+int fat16_vol_rm(struct fat16_volume *vol, const char *filepath)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = remove_file(vol, filepath);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+/**
+ * @brief Open a directory other than the root directory
+ *
+ * @param[in] vol
+ * @param[out] handle
+ * @param[in] dirpath
+ * @return 0 if successful, -1 otherwise
+ */
+static int open_directory(struct fat16_volume *vol, struct entry_handle *handle, const char *dirpath)
+{
+    char dirname[11];
+
+    if (is_in_root(dirpath)) {
+        if (to_short_filename(dirname, dirpath) < 0)
+            return -1;
+
+        return open_directory_in_root(vol, handle, dirname);
+    }
+
+    if (navigate_to_subdir(vol, handle, dirname, dirpath) < 0)
+        return -1;
+
+    return open_directory_in_subdir(vol, handle, dirname);
+}
+
+/**
+ * @brief Convert the name of a directory entry to a filename
+ *
+ * @param[out] filename An array of 13 characters is sufficient
+ * @param[in] name 8.3 short name
+ */
+static void format_filename(char *filename, const char *name)
+{
+    uint8_t name_length = 0, ext_length = 0;
+
+    /* Special case for . and .. entries */
+    if (name[0] == '.' && name[1] == ' ') {
+        filename[0] = '.';
+        filename[1] = '\0';
+        return;
+    } else if (name[0] == '.' && name[1] == '.' && name[2] == ' ') {
+        filename[0] = '.';
+        filename[1] = '.';
+        filename[2] = '\0';
+        return;
+    }
+
+    /*
+     * Reformat filename:
+     *   - Trim name
+     *   - Add '.' to separate name and extension
+     *   - Trim extension
+     *   - Add null terminated
+     */
+    for (name_length = 0; name_length < 8; ++name_length) {
+        char c = name[name_length];
+        if (c == ' ')
+            break;
+
+        filename[name_length] = c;
+    }
+
+    filename[name_length] = '.';
+
+    for (ext_length = 0; ext_length < 3; ++ext_length) {
+        char c = name[8 + ext_length];
+        if (c == ' ')
+            break;
+        filename[name_length + 1 + ext_length] = c;
+    }
+
+    filename[name_length + 1 + ext_length] = '\0';
+}
+
+static int list_directory(struct fat16_volume *vol, uint32_t *index, char *filename, const char *dirpath)
+{
+    int ret;
+    char name[11];
+
+    if (!check_volume(vol))
+        return -1;
+
+    if (index == NULL || filename == NULL)
+        return -1;
+
+    if (dirpath == NULL || dirpath[0] != '/')
+        return -1;
+
+    if (dirpath[1] == '\0') {
+        ret = ls_in_root(vol, index, name);
+    } else {
+        struct entry_handle handle;
+
+        if (open_directory(vol, &handle, dirpath) < 0)
+            return -1;
+
+        ret = ls_in_subdir(vol, index, name, &handle);
+    }
+
+    if (ret == 1)
+        format_filename(filename, name);
+
+    return ret;
+}
+
+int fat16_vol_ls(struct fat16_volume *vol, uint32_t *index, char *filename, const char *dirpath)
+{
+    int ret;
+
+    if (!lock_volume(vol, false))
+        return -1;
+    ret = list_directory(vol, index, filename, dirpath);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int open_dir_iterator(struct fat16_volume *vol, const char *dirpath)
+{
+    uint16_t starting_cluster = 0;
+    uint8_t i;
+
+    if (!check_volume(vol))
+        return -1;
+
+    if (dirpath == NULL || dirpath[0] != '/') {
+        FAT16DBG("FAT16: fat16_opendir: Invalid path.\n");
+        return -1;
+    }
+
+    if (dirpath[1] != '\0') {
+        struct entry_handle handle;
+
+        if (open_directory(vol, &handle, dirpath) < 0)
+            return -1;
+        starting_cluster = handle.starting_cluster;
+    }
+
+    /* Readers of other directories share the table of directory handles */
+    lock_cache(vol);
+    for (i = 0; i < FAT16_DIR_COUNT; ++i) {
+        if (!vol->dirs[i].is_used)
+            break;
+    }
+    if (i < FAT16_DIR_COUNT)
+        vol->dirs[i].is_used = true;
+    unlock_cache(vol);
+    if (i == FAT16_DIR_COUNT) {
+        FAT16DBG("FAT16: fat16_opendir: Too many open directories.\n");
+        return -1;
+    }
+
+    init_dir_iterator(vol, &vol->dirs[i], starting_cluster);
+    return i;
+}
+
+int fat16_vol_opendir(struct fat16_volume *vol, const char *dirpath)
+{
+    int ret;
+
+    if (!lock_volume(vol, false))
+        return -1;
+    ret = open_dir_iterator(vol, dirpath);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static bool check_dir(struct fat16_volume *vol, uint8_t dir)
+{
+    return check_volume(vol)
+        && dir < FAT16_DIR_COUNT
+        && vol->dirs[dir].is_used;
+}
+
+static int read_directory(struct fat16_volume *vol, uint8_t dir, char *filename)
+{
+    struct dir_entry entry;
+    int ret;
+
+    if (!check_dir(vol, dir)) {
+        FAT16DBG("FAT16: fat16_readdir: Invalid directory handle.\n");
+        return -1;
+    }
+
+    if (filename == NULL)
+        return -1;
+
+    ret = read_dir_iterator(vol, &vol->dirs[dir], &entry);
+    if (ret == 1)
+        format_filename(filename, entry.name);
+
+    return ret;
+}
+
+int fat16_vol_readdir(struct fat16_volume *vol, uint8_t dir, char *filename)
+{
+    int ret;
+
+    if (!lock_volume(vol, false))
+        return -1;
+    ret = read_directory(vol, dir, filename);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+/**
+ * @param[in] entry
+ * @param[in] filter Combination of FAT16_DIR_FILTER flags
+ * @return True if the entry must be skipped
+ */
+static bool is_filtered(const struct dir_entry *entry, uint8_t filter)
+{
+    if (entry->attribute & VOLUME)
+        return filter & FAT16_SKIP_VOLUME;
+
+    if ((entry->attribute & HIDDEN) && (filter & FAT16_SKIP_HIDDEN))
+        return true;
+
+    if (entry->attribute & SUBDIR)
+        return filter & FAT16_SKIP_DIRECTORIES;
+
+    return filter & FAT16_SKIP_FILES;
+}
+
+static int read_directory_batch(struct fat16_volume *vol, uint8_t dir, struct fat16_dirent *entries, uint32_t count, uint8_t filter)
+{
+    uint32_t i = 0;
+
+    if (!check_dir(vol, dir)) {
+        FAT16DBG("FAT16: fat16_readdir_batch: Invalid directory handle.\n");
+        return -1;
+    }
+
+    if (entries == NULL)
+        return -1;
+
+    while (i < count) {
+        struct dir_entry entry;
+        int ret = read_dir_iterator(vol, &vol->dirs[dir], &entry);
+        if (ret < 0)
+            return -1;
+        if (ret == 0)
+            break;
+
+        if (is_filtered(&entry, filter))
+            continue;
+
+        format_filename(entries[i].name, entry.name);
+        entries[i].attribute = entry.attribute;
+        entries[i].size = entry.size;
+        entries[i].starting_cluster = entry.starting_cluster;
+        entries[i].time = entry.time[0] | (entry.time[1] << 8);
+        entries[i].date = entry.date[0] | (entry.date[1] << 8);
+        ++i;
+    }
+
+    return i;
+}
+
+int fat16_vol_readdir_batch(struct fat16_volume *vol, uint8_t dir, struct fat16_dirent *entries, uint32_t count, uint8_t filter)
+{
+    int ret;
+
+    if (!lock_volume(vol, false))
+        return -1;
+    ret = read_directory_batch(vol, dir, entries, count, filter);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int close_dir_iterator(struct fat16_volume *vol, uint8_t dir)
+{
+    if (!check_dir(vol, dir)) {
+        FAT16DBG("FAT16: fat16_closedir: Invalid directory handle.\n");
+        return -1;
+    }
+
+    lock_cache(vol);
+    vol->dirs[dir].is_used = false;
+    unlock_cache(vol);
+
+    return 0;
+}
+
+int fat16_vol_closedir(struct fat16_volume *vol, uint8_t dir)
+{
+    int ret;
+
+    if (!lock_volume(vol, false))
+        return -1;
+    ret = close_dir_iterator(vol, dir);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int make_directory(struct fat16_volume *vol, const char *dirpath)
+{
+    char dirname[11];
+
+    if (!check_volume(vol))
+        return -1;
+
+    if (is_in_root(dirpath)) {
+        if (to_short_filename(dirname, dirpath) < 0)
+            return -1;
+
+        if (create_directory_in_root(vol, dirname) < 0)
+            return -1;
+    } else {
+        struct entry_handle handle;
+
+        if (navigate_to_subdir(vol, &handle, dirname, dirpath) < 0)
+            return -1;
+
+        if (create_directory_in_subdir(vol, &handle, dirname) < 0)
+            return -1;
+    }
+
+    return flush_all(vol);
+}
+
+int fat16_vol_mkdir(struct fat16_volume *vol, const char *dirpath)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = make_directory(vol, dirpath);
+    unlock_volume(vol);
+
+    return ret;
+}
+
+static int remove_directory(struct fat16_volume *vol, const char *dirpath)
+{
+    char dirname[11];
+    struct entry_handle handle, dir_handle;
+    bool in_root = is_in_root(dirpath);
+
+    if (!check_volume(vol))
+        return -1;
+
+    if (in_root) {
+        if (to_short_filename(dirname, dirpath) < 0)
+            return -1;
+
+        if (open_directory_in_root(vol, &handle, dirname) < 0)
+            return -1;
+    } else {
+        if (navigate_to_subdir(vol, &dir_handle, dirname, dirpath) < 0)
+            return -1;
+
+        handle = dir_handle;
+        if (open_directory_in_subdir(vol, &handle, dirname) < 0)
+            return -1;
+    }
+
+    if (!is_subdir_empty(vol, &handle))
+        return -1;
+
+    if (in_root) {
+        if (delete_directory_in_root(vol, dirname) < 0)
+            return -1;
+    } else {
+        if (delete_directory_in_subdir(vol, &dir_handle, dirname) < 0)
+            return -1;
+    }
+    path_cache_remove(vol, handle.starting_cluster);
+
+    return flush_all(vol);
+}
+
+int fat16_vol_rmdir(struct fat16_volume *vol, const char *dirpath)
+{
+    int ret;
+
+    if (!lock_volume(vol, true))
+        return -1;
+    ret = remove_directory(vol, dirpath);
+    unlock_volume(vol);
+
+    return ret;
 }
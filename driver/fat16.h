@@ -35,9 +35,125 @@ enum FAT_ERROR {
     INVALID_RESERVED_SECTOR_COUNT,
     INVALID_ROOT_ENTRY_COUNT,
     INVALID_SECTOR_COUNT,
-    INVALID_FAT_TYPE
+    INVALID_FAT_TYPE,
+    INVALID_DEVICE_SECTOR_SIZE
 };
 
+enum FAT16_SEEK_ORIGIN {
+    FAT16_SEEK_SET,     /**< Offset is relative to the start of the file */
+    FAT16_SEEK_CUR,     /**< Offset is relative to the current position */
+    FAT16_SEEK_END      /**< Offset is relative to the end of the file */
+};
+
+/**
+ * Attribute bits of a directory entry.
+ */
+enum FAT16_ATTRIBUTE {
+    FAT16_ATTR_READ_ONLY    = 0x01,
+    FAT16_ATTR_HIDDEN       = 0x02,
+    FAT16_ATTR_SYSTEM       = 0x04,
+    FAT16_ATTR_VOLUME       = 0x08,     /**< Volume label, neither a file nor a directory */
+    FAT16_ATTR_SUBDIR       = 0x10,
+    FAT16_ATTR_ARCHIVE      = 0x20
+};
+
+/**
+ * Entries skipped by fat16_readdir_batch, can be combined. For instance,
+ * FAT16_SKIP_DIRECTORIES | FAT16_SKIP_VOLUME only returns files.
+ */
+enum FAT16_DIR_FILTER {
+    FAT16_SKIP_FILES        = 0x01,
+    FAT16_SKIP_DIRECTORIES  = 0x02,     /**< Including . and .. entries */
+    FAT16_SKIP_HIDDEN       = 0x04,
+    FAT16_SKIP_VOLUME       = 0x08
+};
+
+/**
+ * Directory entry returned by fat16_readdir_batch.
+ */
+struct fat16_dirent {
+    char        name[13];           /**< Null-terminated name, as given by fat16_readdir */
+    uint8_t     attribute;          /**< Combination of FAT16_ATTRIBUTE bits */
+    uint32_t    size;               /**< Size in bytes, 0 for a directory */
+    uint16_t    starting_cluster;   /**< First cluster, 0 for an empty file */
+    uint16_t    time;               /**< Time of last write: hours << 11 | minutes << 5 | seconds / 2 */
+    uint16_t    date;               /**< Date of last write: (year - 1980) << 9 | month << 5 | day */
+};
+
+/**
+ * Buffer used by fat16_readv and fat16_writev.
+ */
+struct fat16_iovec {
+    void        *base;      /**< Start of the buffer */
+    uint32_t    length;     /**< Size of the buffer in bytes */
+};
+
+/*
+ * Maximum number of views returned by fat16_read_view which can be held at
+ * the same time.
+ */
+#ifndef FAT16_VIEW_COUNT
+#define FAT16_VIEW_COUNT    (4)
+#endif
+
+/*
+ * Maximum number of directories opened by fat16_opendir which can be read at
+ * the same time. Each of them holds a buffer of FAT16_MAX_SECTOR_SIZE bytes.
+ */
+#ifndef FAT16_DIR_COUNT
+#define FAT16_DIR_COUNT     (2)
+#endif
+
+/*
+ * Maximum number of requests started by fat16_read_async and
+ * fat16_write_async which can be in progress at the same time.
+ */
+#ifndef FAT16_ASYNC_COUNT
+#define FAT16_ASYNC_COUNT   (4)
+#endif
+
+/*
+ * Number of readahead buffers, shared by files opened in read mode. A file
+ * opened when all of them are used is read without readahead. Readahead is
+ * disabled by default.
+ */
+#ifndef FAT16_READAHEAD_COUNT
+#define FAT16_READAHEAD_COUNT   (0)
+#endif
+
+/*
+ * Size in bytes of each readahead buffer. Readahead is only used on volumes
+ * whose clusters are at most half this size, so that a refill always reads
+ * the next cluster ahead.
+ */
+#ifndef FAT16_READAHEAD_SIZE
+#define FAT16_READAHEAD_SIZE    (8192)
+#endif
+
+/**
+ * Function called when an asynchronous request completes.
+ *
+ * @param[in] request Number returned by fat16_read_async or fat16_write_async.
+ * @param[in] result Number of bytes transferred, -1 if an error happened.
+ * @param[in] context Pointer given when the request was started.
+ */
+typedef void (*fat16_callback_t)(int request, int result, void *context);
+
+/*
+ * Maximum number of volumes which can be mounted at the same time, including
+ * the one mounted by fat16_init or fat16_init_block. Each volume has its own
+ * cache, FAT and handles, so only one is available by default. Raise it to
+ * mount other partitions with fat16_mount.
+ */
+#ifndef FAT16_VOLUME_COUNT
+#define FAT16_VOLUME_COUNT  (1)
+#endif
+
+/**
+ * State of a mounted FAT16 partition, returned by fat16_mount.
+ */
+struct fat16_volume;
+
 struct storage_dev_t {
     int (*read)(void *buffer, uint32_t length);
     int (*read_byte)(void *data);
@@ -45,12 +161,78 @@ struct storage_dev_t {
     int (*seek)(uint32_t offset);
 };
 
+/**
+ * Transfer of sectors submitted in a batch to a block device.
+ */
+struct block_request {
+    uint32_t    lba;        /**< Index of the first sector */
+    uint32_t    count;      /**< Number of sectors */
+    void        *buffer;    /**< Data to write or buffer to fill */
+    uint8_t     is_write;   /**< 1 to write sectors, 0 to read them */
+};
+
+/**
+ * Sector-granular block device.
+ *
+ * The driver only transfers whole sectors through this interface. Both
+ * callbacks must return 0 if successful, a negative value otherwise. Every
+ * callback receives the context of the device as first argument, so that
+ * the same functions can serve several devices.
+ */
+struct block_dev_t {
+    uint16_t sector_size;   /**< Size of a sector in bytes, must be a power of two */
+    int (*read_sectors)(void *context, uint32_t lba, uint32_t count, void *buffer);
+    int (*write_sectors)(void *context, uint32_t lba, uint32_t count, const void *buffer);
+
+    /**
+     * Optional, can be NULL. If the device is mapped in memory, return a
+     * pointer to the content of count sectors starting at lba, which stays
+     * valid as long as the device is used. Otherwise, return NULL.
+     */
+    const void *(*map_sectors)(void *context, uint32_t lba, uint32_t count);
+
+    /**
+     * Optional, can be NULL. Called once the driver has written all modified
+     * sectors, so that a device which buffers writes can make them durable.
+     */
+    int (*sync)(void *context);
+
+    /**
+     * Optional, can be NULL. Perform count independent transfers, in any
+     * order, and return once all of them are complete. Otherwise, batches
+     * are performed one transfer at a time with read_sectors and
+     * write_sectors.
+     */
+    int (*submit_batch)(void *context, struct block_request *requests, uint32_t count);
+
+    /**
+     * Optional, can be NULL. Start count independent transfers and return
+     * without waiting for them, the requests stay valid until they complete.
+     * Used by asynchronous requests, so that transfers overlap with the
+     * caller. Otherwise, their batches are performed before fat16_poll
+     * returns.
+     */
+    int (*start_batch)(void *context, struct block_request *requests, uint32_t count);
+
+    /**
+     * Required if start_batch is set. Return 1 once all transfers of the
+     * last batch started are complete, 0 while some are in progress, a
+     * negative value if any of them failed. It must not block.
+     */
+    int (*poll_batch)(void *context);
+
+    void *context;          /**< Passed to every callback */
+};
+
 /**
  * @brief Initialise the FAT16 driver.
  *
  * It reads the BPB, initialises internal variables.
  * It must be called before doing any other operations.
  *
+ * The byte-oriented device is accessed through a shim exposing it as a block
+ * device with 512 bytes sectors.
+ *
  * @param[in] dev
  * @param[in] offset Absolute position of the first byte which belongs to a FAT16 partition
  *                   (obtained by reading the MBR, can be 0 if reading from a FAT16 image).
@@ -58,6 +240,25 @@ struct storage_dev_t {
  */
 int __attribute__((visibility("default"))) fat16_init(struct storage_dev_t dev, uint32_t offset);
 
+/**
+ * @brief Initialise the FAT16 driver with a block device.
+ *
+ * Same as fat16_init, except that the driver only issues whole sector
+ * transfers to the device.
+ *
+ * The partition is mounted as the volume used by all functions which do not
+ * take a volume. Calling it again mounts another partition in its place,
+ * after writing back the files open for writing and the cache of the
+ * previous one, as fat16_sync does. It fails if they cannot be written, and
+ * the previous partition then stays mounted.
+ *
+ * @param[in] dev
+ * @param[in] first_sector Index of the first sector of the FAT16 partition
+ *                         (obtained by reading the MBR, can be 0 if reading from a FAT16 image).
+ * @return 0 if successful, -1 otherwise
+ */
+int __attribute__((visibility("default"))) fat16_init_block(struct block_dev_t dev, uint32_t first_sector);
+
 /**
  * @brief Open a file.
  *
@@ -91,17 +292,230 @@ int __attribute__((visibility("default"))) fat16_read(uint8_t handle, void *buff
 /**
  * @brief Write data to file.
  *
+ * Data might stay in the sector cache, and the new size of the file in the
+ * handle, until the handle is flushed or closed.
+ *
  * @param[in] handle Positive number returned by fat16_open.
  * @param[in] buffer Pointer to a buffer.
  * @param[in] Number of bytes to read.
- * @return Number of bytes written to file. The return value might be less than
- * count if there is no space left.
+ * @return Number of bytes written to file, -1 if an error happened, including
+ * when no cluster is left for the data.
  */
 int __attribute__((visibility("default"))) fat16_write(uint8_t handle, const void *buffer, uint32_t count);
 
+/**
+ * @brief Read data from file into several buffers.
+ *
+ * Buffers are filled one after the other, as if fat16_read was called for
+ * each of them.
+ *
+ * @param[in] handle Positive number returned by fat16_open.
+ * @param[in] iov Array of buffers.
+ * @param[in] iov_count Number of buffers.
+ * @return Number of bytes read from file, -1 if an error happened. The return
+ * value might be less than the total length of the buffers because the end of
+ * the file is reached.
+ */
+int __attribute__((visibility("default"))) fat16_readv(uint8_t handle, const struct fat16_iovec *iov, uint8_t iov_count);
+
+/**
+ * @brief Write data from several buffers to file.
+ *
+ * Buffers are written one after the other. Clusters are allocated for all of
+ * them at once and the size of the file is updated once.
+ *
+ * @param[in] handle Positive number returned by fat16_open.
+ * @param[in] iov Array of buffers.
+ * @param[in] iov_count Number of buffers.
+ * @return Number of bytes written to file, -1 if an error happened, including
+ * when no cluster is left for the data.
+ */
+int __attribute__((visibility("default"))) fat16_writev(uint8_t handle, const struct fat16_iovec *iov, uint8_t iov_count);
+
+/**
+ * @brief Start reading data from file.
+ *
+ * The request is only queued, it progresses each time fat16_poll is called.
+ * Requests are performed in the order they were started, and each step of a
+ * request transfers at most FAT16_BATCH_SIZE runs of contiguous clusters.
+ * The buffer must not be used until the request completes. Until then,
+ * reading, writing, seeking or closing the handle fails, but other
+ * asynchronous requests can be queued on it.
+ *
+ * @param[in] handle Positive number returned by fat16_open in read mode.
+ * @param[out] buffer Pointer to a buffer.
+ * @param[in] count Number of bytes to read.
+ * @param[in] callback Function called when the request completes. If NULL,
+ * the result must be retrieved with fat16_get_result.
+ * @param[in] context Pointer passed to callback.
+ * @return Request number, -1 if an error happened.
+ */
+int __attribute__((visibility("default"))) fat16_read_async(uint8_t handle, void *buffer, uint32_t count, fat16_callback_t callback, void *context);
+
+/**
+ * @brief Start writing data to file.
+ *
+ * Same as fat16_read_async. Clusters are allocated for the whole request
+ * when its first step is performed, and the size of the file is updated
+ * after the data of each step has been transferred.
+ *
+ * @param[in] handle Positive number returned by fat16_open in write or append mode.
+ * @param[in] buffer Pointer to a buffer.
+ * @param[in] count Number of bytes to write.
+ * @param[in] callback Function called when the request completes. If NULL,
+ * the result must be retrieved with fat16_get_result.
+ * @param[in] context Pointer passed to callback.
+ * @return Request number, -1 if an error happened.
+ */
+int __attribute__((visibility("default"))) fat16_write_async(uint8_t handle, const void *buffer, uint32_t count, fat16_callback_t callback, void *context);
+
+/**
+ * @brief Make asynchronous requests progress.
+ *
+ * Check if the transfers of the current request are complete and, if so,
+ * start its next step or complete it and invoke its callback. This function
+ * only blocks if the device does not provide start_batch.
+ *
+ * @return Number of requests which are not complete yet.
+ */
+int __attribute__((visibility("default"))) fat16_poll(void);
+
+/**
+ * @brief Get the result of an asynchronous request started without callback.
+ *
+ * Once the result is returned, the request number can be reused.
+ *
+ * @param[in] request Number returned by fat16_read_async or fat16_write_async.
+ * @param[out] result Number of bytes transferred, -1 if an error happened.
+ * @return 1 if the request is complete, 0 if it is still in progress, -1 if
+ * the request number is invalid.
+ */
+int __attribute__((visibility("default"))) fat16_get_result(int request, int *result);
+
+/**
+ * @brief Read data from file without copying it.
+ *
+ * On success, data points to up to max_count bytes of the file, read from
+ * the current position of the handle, and the handle is moved after them.
+ * The bytes are either in the sector cache or, if the device is mapped in
+ * memory, in device memory. Fewer bytes than requested can be returned, even
+ * if the end of the file is not reached.
+ *
+ * The view must be released with fat16_release_view. Up to FAT16_VIEW_COUNT
+ * views can be held at the same time. Views in the sector cache pin it, so
+ * at least one slot of the cache stays available for other accesses.
+ *
+ * @param[in] handle Positive number returned by fat16_open in read mode.
+ * @param[in] max_count Maximum number of bytes in the view.
+ * @param[out] data Pointer to the bytes.
+ * @param[out] count Number of bytes in the view, 0 if the end of the file is reached.
+ * @return 0 if successful, -1 otherwise
+ */
+int __attribute__((visibility("default"))) fat16_read_view(uint8_t handle, uint32_t max_count, const void **data, uint32_t *count);
+
+/**
+ * @brief Release a view returned by fat16_read_view.
+ *
+ * @param[in] data Pointer returned by fat16_read_view.
+ * @return 0 if successful, -1 otherwise
+ */
+int __attribute__((visibility("default"))) fat16_release_view(const void *data);
+
+/**
+ * @brief Read data from file at a given position.
+ *
+ * The position of the handle is not modified.
+ *
+ * @param[in] handle Positive number returned by fat16_open in read mode.
+ * @param[out] buffer Pointer to a buffer.
+ * @param[in] count Number of bytes to read.
+ * @param[in] offset Position in bytes from the start of the file, must not be greater than the size of the file.
+ * @return Number of bytes read from file, -1 if an error happened. The return
+ * value might be less than count because the end of the file is reached.
+ */
+int __attribute__((visibility("default"))) fat16_pread(uint8_t handle, void *buffer, uint32_t count, uint32_t offset);
+
+/**
+ * @brief Write data to file at a given position.
+ *
+ * The position of the handle is not modified. In append mode, data is
+ * written at the end of the file whatever the offset.
+ *
+ * @param[in] handle Positive number returned by fat16_open in write or append mode.
+ * @param[in] buffer Pointer to a buffer.
+ * @param[in] count Number of bytes to write.
+ * @param[in] offset Position in bytes from the start of the file, must not be greater than the size of the file.
+ * @return Number of bytes written to file, -1 if an error happened, including
+ * when no cluster is left for the data.
+ */
+int __attribute__((visibility("default"))) fat16_pwrite(uint8_t handle, const void *buffer, uint32_t count, uint32_t offset);
+
+/**
+ * @brief Move the position of a handle in its file.
+ *
+ * The position cannot be moved before the start or past the end of the file.
+ * In append mode, data is always written at the end of the file whatever the
+ * position of the handle.
+ *
+ * @param[in] handle Positive number returned by fat16_open.
+ * @param[in] offset Number of bytes to move, relative to whence.
+ * @param[in] whence FAT16_SEEK_SET, FAT16_SEEK_CUR or FAT16_SEEK_END
+ * @return New position in bytes from the start of the file, -1 if an error happened.
+ */
+int32_t __attribute__((visibility("default"))) fat16_seek(uint8_t handle, int32_t offset, uint8_t whence);
+
+/**
+ * @brief Get the position of a handle in its file.
+ *
+ * @param[in] handle Positive number returned by fat16_open.
+ * @return Position in bytes from the start of the file, -1 if an error happened.
+ */
+int32_t __attribute__((visibility("default"))) fat16_tell(uint8_t handle);
+
+/**
+ * @brief Reserve space for a file.
+ *
+ * Clusters are allocated, contiguous if possible, so that the file can hold
+ * size bytes. Subsequent calls to fat16_write then fill these clusters
+ * without allocating any. The size of the file is not modified.
+ *
+ * Reserved clusters which are not filled when the handle is closed are
+ * released.
+ *
+ * @param[in] handle Positive number returned by fat16_open in write or append mode.
+ * @param[in] size Number of bytes the file must be able to hold.
+ * @return 0 if successful, -1 otherwise
+ */
+int __attribute__((visibility("default"))) fat16_fallocate(uint8_t handle, uint32_t size);
+
+/**
+ * @brief Write the size of the file and all cached sectors to the device.
+ *
+ * Nothing is done for a handle in read mode.
+ *
+ * @param[in] handle Positive number returned by fat16_open
+ * @return 0 if successful, -1 otherwise
+ */
+int __attribute__((visibility("default"))) fat16_flush(uint8_t handle);
+
+/**
+ * @brief Write the size of all files opened for writing and all cached
+ * sectors to the device.
+ *
+ * Content of files is written first, then the FAT and finally directory
+ * entries, with a device sync after each step.
+ *
+ * @return 0 if successful, -1 otherwise
+ */
+int __attribute__((visibility("default"))) fat16_sync(void);
+
 /**
  * @brief Release the handle.
  *
+ * If the file was opened in write or append mode, all cached sectors are
+ * written to the device. It fails if asynchronous requests of the handle
+ * are not complete. If it fails, the handle is not released.
+ *
  * @param[in] handle Positive number returned by fat16_open
  * @return 0 if successful, -1 otherwise
  */
@@ -142,6 +556,76 @@ int __attribute__((visibility("default"))) fat16_rm(const char *filepath);
  */
 int __attribute__((visibility("default"))) fat16_ls(uint32_t *index, char *filename, const char *dirpath);
 
+/**
+ * @brief Open a directory to read its entries.
+ *
+ * Unlike fat16_ls, the directory handle remembers where the next entry is,
+ * so listing a directory reads each of its sectors once:
+ *
+ * @code{.c}
+ * char filename[13];
+ * int dir = fat16_opendir("/");
+ * while(dir >= 0 && fat16_readdir(dir, filename) == 1) {
+ *      printf("%s\n", filename);
+ * }
+ * fat16_closedir(dir);
+ * @endcode
+ *
+ * Do not modify the directory (creating/deleting files) while it is open.
+ *
+ * @param[in] dirpath
+ * @return A handle of the directory (positive integer) if it could open it.
+ * Otherwise, a negative value is returned.
+ */
+int __attribute__((visibility("default"))) fat16_opendir(const char *dirpath);
+
+/**
+ * @brief Gives the name of the next entry of a directory.
+ *
+ * Deleted entries and VFAT entries are skipped.
+ *
+ * @param[in] dir Positive number returned by fat16_opendir.
+ * @param[out] filename Name An array of 13 characters is sufficient
+ * @retval 1 if a filename was retrieved with success
+ * @retval 0 if the end of the file list was reached
+ * @retval -1 if an error occurs
+ */
+int __attribute__((visibility("default"))) fat16_readdir(uint8_t dir, char *filename);
+
+/**
+ * @brief Read the next entries of a directory.
+ *
+ * Entries which do not pass the filter are skipped while the directory is
+ * read, so that a directory can be indexed without opening its files:
+ *
+ * @code{.c}
+ * struct fat16_dirent entries[16];
+ * int count, i;
+ * int dir = fat16_opendir("/DATA");
+ * while(dir >= 0 && (count = fat16_readdir_batch(dir, entries, 16, FAT16_SKIP_DIRECTORIES)) > 0) {
+ *      for (i = 0; i < count; ++i)
+ *          printf("%s %lu\n", entries[i].name, (unsigned long)entries[i].size);
+ * }
+ * fat16_closedir(dir);
+ * @endcode
+ *
+ * @param[in] dir Positive number returned by fat16_opendir.
+ * @param[out] entries Array of count entries.
+ * @param[in] count Maximum number of entries to read.
+ * @param[in] filter Combination of FAT16_DIR_FILTER flags, 0 to get all entries.
+ * @return Number of entries read, 0 if the end of the directory was reached,
+ * -1 if an error occurs.
+ */
+int __attribute__((visibility("default"))) fat16_readdir_batch(uint8_t dir, struct fat16_dirent *entries, uint32_t count, uint8_t filter);
+
+/**
+ * @brief Release a directory handle.
+ *
+ * @param[in] dir Positive number returned by fat16_opendir.
+ * @return 0 if successful, -1 otherwise
+ */
+int __attribute__((visibility("default"))) fat16_closedir(uint8_t dir);
+
 /**
  * @brief Create a directory
  *
@@ -160,6 +644,64 @@ int __attribute__((visibility("default"))) fat16_mkdir(const char *dirpath);
  */
 int __attribute__((visibility("default"))) fat16_rmdir(const char *dirpath);
 
+/**
+ * @brief Mount a FAT16 partition stored on a block device.
+ *
+ * Each volume has its own cache, FAT, handles and requests. Handles and
+ * requests of a volume can only be used with the fat16_vol_ functions of
+ * this volume.
+ *
+ * @param[out] volume Set to the mounted volume if successful.
+ * @param[in] dev
+ * @param[in] first_sector Index of the first sector of the FAT16 partition
+ *                         (obtained by reading the MBR, can be 0 if reading from a FAT16 image).
+ * @return 0 if successful, a negative value otherwise
+ */
+int __attribute__((visibility("default"))) fat16_mount(struct fat16_volume **volume, struct block_dev_t dev, uint32_t first_sector);
+
+/**
+ * @brief Write back all modified sectors and release a volume.
+ *
+ * All handles and views of the volume must be closed first.
+ *
+ * @param[in] volume
+ * @return 0 if successful, -1 otherwise
+ */
+int __attribute__((visibility("default"))) fat16_unmount(struct fat16_volume *volume);
+
+/*
+ * Same as the functions above, on a volume mounted by fat16_mount. The
+ * functions above work on the volume mounted by fat16_init or
+ * fat16_init_block.
+ */
+int __attribute__((visibility("default"))) fat16_vol_open(struct fat16_volume *volume, const char *filepath, char mode);
+int __attribute__((visibility("default"))) fat16_vol_read(struct fat16_volume *volume, uint8_t handle, void *buffer, uint32_t count);
+int __attribute__((visibility("default"))) fat16_vol_write(struct fat16_volume *volume, uint8_t handle, const void *buffer, uint32_t count);
+int __attribute__((visibility("default"))) fat16_vol_readv(struct fat16_volume *volume, uint8_t handle, const struct fat16_iovec *iov, uint8_t iov_count);
+int __attribute__((visibility("default"))) fat16_vol_writev(struct fat16_volume *volume, uint8_t handle, const struct fat16_iovec *iov, uint8_t iov_count);
+int __attribute__((visibility("default"))) fat16_vol_read_async(struct fat16_volume *volume, uint8_t handle, void *buffer, uint32_t count, fat16_callback_t callback, void *context);
+int __attribute__((visibility("default"))) fat16_vol_write_async(struct fat16_volume *volume, uint8_t handle, const void *buffer, uint32_t count, fat16_callback_t callback, void *context);
+int __attribute__((visibility("default"))) fat16_vol_poll(struct fat16_volume *volume);
+int __attribute__((visibility("default"))) fat16_vol_get_result(struct fat16_volume *volume, int request, int *result);
+int __attribute__((visibility("default"))) fat16_vol_read_view(struct fat16_volume *volume, uint8_t handle, uint32_t max_count, const void **data, uint32_t *count);
+int __attribute__((visibility("default"))) fat16_vol_release_view(struct fat16_volume *volume, const void *data);
+int __attribute__((visibility("default"))) fat16_vol_pread(struct fat16_volume *volume, uint8_t handle, void *buffer, uint32_t count, uint32_t offset);
+int __attribute__((visibility("default"))) fat16_vol_pwrite(struct fat16_volume *volume, uint8_t handle, const void *buffer, uint32_t count, uint32_t offset);
+int32_t __attribute__((visibility("default"))) fat16_vol_seek(struct fat16_volume *volume, uint8_t handle, int32_t offset, uint8_t whence);
+int32_t __attribute__((visibility("default"))) fat16_vol_tell(struct fat16_volume *volume, uint8_t handle);
+int __attribute__((visibility("default"))) fat16_vol_fallocate(struct fat16_volume *volume, uint8_t handle, uint32_t size);
+int __attribute__((visibility("default"))) fat16_vol_flush(struct fat16_volume *volume, uint8_t handle);
+int __attribute__((visibility("default"))) fat16_vol_sync(struct fat16_volume *volume);
+int __attribute__((visibility("default"))) fat16_vol_close(struct fat16_volume *volume, uint8_t handle);
+int __attribute__((visibility("default"))) fat16_vol_rm(struct fat16_volume *volume, const char *filepath);
+int __attribute__((visibility("default"))) fat16_vol_ls(struct fat16_volume *volume, uint32_t *index, char *filename, const char *dirpath);
+int __attribute__((visibility("default"))) fat16_vol_opendir(struct fat16_volume *volume, const char *dirpath);
+int __attribute__((visibility("default"))) fat16_vol_readdir(struct fat16_volume *volume, uint8_t dir, char *filename);
+int __attribute__((visibility("default"))) fat16_vol_readdir_batch(struct fat16_volume *volume, uint8_t dir, struct fat16_dirent *entries, uint32_t count, uint8_t filter);
+int __attribute__((visibility("default"))) fat16_vol_closedir(struct fat16_volume *volume, uint8_t dir);
+int __attribute__((visibility("default"))) fat16_vol_mkdir(struct fat16_volume *volume, const char *dirpath);
+int __attribute__((visibility("default"))) fat16_vol_rmdir(struct fat16_volume *volume, const char *dirpath);
+
 #ifdef __cplusplus
 }
 #endif
@@ -20,16 +20,31 @@
 
 #include <stddef.h>
 #include <stdio.h>
+#include <string.h>
+#include "blockdev.h"
+#include "cache.h"
 #include "debug.h"
+#include "extent.h"
 #include "fat16.h"
 #include "fat16_priv.h"
+#include "fat_table.h"
 #include "path.h"
 #include "rootdir.h"
 #include "subdir.h"
 
-extern struct storage_dev_t dev;
-extern struct fat16_layout layout;
-extern struct fat16_bpb bpb;
+/* No limit on the number of runs transferred by read_bytes and write_bytes */
+#define ALL_RUNS        (0xFFFFFFFF)
+
+/*
+ * Reads of whole sectors are batched, unless several threads can read at the
+ * same time: the queue of the device would then have to be locked until it is
+ * submitted.
+ */
+#ifdef FAT16_THREAD_SAFE
+#define IS_READ_QUEUED  (false)
+#else
+#define IS_READ_QUEUED  (true)
+#endif
 
 void dump_dir_entry(struct dir_entry e)
 {
@@ -57,261 +72,1045 @@ void dump_dir_entry(struct dir_entry e)
 
 }
 
-uint32_t move_to_data_region(uint16_t cluster, uint16_t offset)
+uint32_t get_data_pos(struct fat16_volume *vol, uint16_t cluster, uint16_t offset)
 {
     uint32_t tmp = cluster - 2;
 
-    tmp *= bpb.sectors_per_cluster;
-    tmp *= bpb.bytes_per_sector;
-    uint32_t pos = layout.start_data_region;
-    pos += layout.offset;
+    tmp *= vol->bpb.sectors_per_cluster;
+    tmp *= vol->bpb.bytes_per_sector;
+    uint32_t pos = vol->layout.start_data_region;
     pos += tmp;
     pos += offset;
-    FAT16DBG("FAT16: Moving to %08X\n", pos);
-    dev.seek(pos);
     return pos;
 }
 
-uint32_t move_to_root_directory_region(uint16_t entry_index)
+uint32_t get_root_entry_pos(struct fat16_volume *vol, uint16_t entry_index)
 {
-    uint32_t pos = layout.start_root_directory_region;
-    pos += layout.offset;
+    uint32_t pos = vol->layout.start_root_directory_region;
     pos += entry_index * 32;
-    FAT16DBG("FAT16: Moving to %08X\n", pos);
-    dev.seek(pos);
     return pos;
 }
 
-uint32_t move_to_fat_region(uint16_t cluster)
+uint32_t get_fat_entry_pos(struct fat16_volume *vol, uint16_t cluster)
 {
-    uint32_t pos = layout.start_fat_region;
-    pos += layout.offset;
+    uint32_t pos = vol->layout.start_fat_region;
     pos += cluster * 2;
-    FAT16DBG("FAT16: Moving to %08X\n", pos);
-    dev.seek(pos);
     return pos;
 }
 
-int allocate_cluster(uint16_t *new_cluster, uint16_t cluster)
+int allocate_clusters(struct fat16_volume *vol, uint16_t *first_cluster, uint16_t *count, uint16_t cluster)
 {
-    uint16_t next_cluster = FIRST_CLUSTER_INDEX_IN_FAT;
+    uint16_t i;
 
-    /*
-     * Find an empty location in the FAT, skip first 3 entries in the FAT,
-     * because they are reserved.
-     */
-    move_to_fat_region(next_cluster);
-    for (; next_cluster < layout.data_cluster_count - FIRST_CLUSTER_INDEX_IN_FAT; ++next_cluster) {
-        uint16_t fat_entry;
-        dev.read(&fat_entry, sizeof(fat_entry));
-
-        /* Mark it as end of file */
-        if (fat_entry == 0) {
-            fat_entry = 0xFFFF;
-            move_to_fat_region(next_cluster);
-            dev.write(&fat_entry, sizeof(fat_entry));
-            break;
-        }
-    }
-
-    if (next_cluster == layout.data_cluster_count) {
-        FAT16DBG("FAT16: Could not find an available cluster.\n");
+    if (find_free_clusters(vol, first_cluster, count) < 0)
         return -1;
+
+    /* Link the whole run and mark its last cluster as end of file */
+    for (i = 0; i < *count - 1; ++i) {
+        if (write_fat_entry(vol, *first_cluster + i, *first_cluster + i + 1) < 0)
+            return -1;
     }
+    if (write_fat_entry(vol, *first_cluster + *count - 1, 0xFFFF) < 0)
+        return -1;
 
-    /* Update current cluster to point to next one */
+    /* Update current cluster to point to the run */
     if (cluster != 0) {
-        move_to_fat_region(cluster);
-        dev.write(&next_cluster, sizeof(next_cluster));
+        if (write_fat_entry(vol, cluster, *first_cluster) < 0)
+            return -1;
     }
 
-    *new_cluster = next_cluster;
     return 0;
 }
 
-void free_cluster_chain(uint16_t cluster)
+int allocate_cluster(struct fat16_volume *vol, uint16_t *new_cluster, uint16_t cluster)
+{
+    uint16_t count = 1;
+
+    return allocate_clusters(vol, new_cluster, &count, cluster);
+}
+
+int free_cluster_chain(struct fat16_volume *vol, uint16_t cluster)
 {
     /*
      * If the file is empty, the starting cluster variable is equal to 0.
      * No need to iterate through the FAT.
      */
     if (cluster == 0)
-        return;
+        return 0;
 
     /* Mark all clusters in the FAT as available */
     do {
-        uint16_t free_cluster = 0;
         uint16_t next_cluster;
-        uint32_t pos_cluster = move_to_fat_region(cluster);
-        dev.read(&next_cluster, sizeof(next_cluster));
 
-        dev.seek(pos_cluster);
-        dev.write(&free_cluster, sizeof(free_cluster));
+        if (read_fat_entry(vol, cluster, &next_cluster) < 0
+        ||  write_fat_entry(vol, cluster, 0) < 0)
+            return -1;
 
         if (next_cluster >= 0xFFF8)
             break;
+
+        /* A free or reserved cluster cannot be part of a chain */
+        if (next_cluster < 2) {
+            FAT16DBG("FAT16: Invalid cluster %u in chain.\n", next_cluster);
+            return -1;
+        }
         cluster = next_cluster;
     } while (1);
+
+    return 0;
+}
+
+int get_next_cluster(struct fat16_volume *vol, uint16_t *next_cluster, uint16_t cluster)
+{
+    return read_fat_entry(vol, cluster, next_cluster);
 }
 
-int get_next_cluster(uint16_t *next_cluster, uint16_t cluster)
+/**
+ * @brief Count clusters of a chain which follow each other in the data region
+ *
+ * @param[in] vol
+ * @param[in] cluster First cluster of the run
+ * @param[in] max_count Stop counting after max_count clusters
+ * @return Number of clusters in the run, including the first one
+ */
+static uint32_t get_contiguous_cluster_count(struct fat16_volume *vol, uint16_t cluster, uint32_t max_count)
+{
+    uint32_t count = 1;
+
+    while (count < max_count) {
+        uint16_t next_cluster;
+        if (get_next_cluster(vol, &next_cluster, cluster) < 0
+        ||  next_cluster != cluster + 1)
+            break;
+
+        cluster = next_cluster;
+        ++count;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Get the index in its file of the current cluster of a handle
+ *
+ * @param[in] vol
+ * @param[in] handle
+ * @return Index of the cluster
+ */
+static uint32_t get_cluster_index(struct fat16_volume *vol, struct entry_handle *handle)
+{
+    uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+
+    return (handle->position - handle->offset) / cluster_size;
+}
+
+/**
+ * @brief Find a cluster of the file opened by a handle
+ *
+ * Without an extent map, the chain is walked from the current cluster of the
+ * handle, so index must not be lower than the index of the current cluster.
+ * This is also done past the end of a full extent map, so that reading a
+ * file with more extents than the map can hold stays linear.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[out] cluster
+ * @param[out] run_length Number of contiguous clusters known to belong to the file from cluster
+ * @param[in] index Index of the cluster in the file
+ * @param[in] max_run_length Stop counting contiguous clusters after max_run_length clusters
+ * @return 0 if successful, -1 if the chain is too short or an error occurred
+ */
+static int find_handle_cluster(struct fat16_volume *vol, struct entry_handle *handle, uint16_t *cluster, uint32_t *run_length, uint32_t index, uint32_t max_run_length)
 {
-    move_to_fat_region(cluster);
-    dev.read(next_cluster, sizeof(cluster));
+    uint32_t current_index = get_cluster_index(vol, handle);
+
+#if FAT16_EXTENT_COUNT > 0
+    if (handle->extents != NULL
+    &&  (index < current_index || !is_past_full_extent_map(handle->extents, current_index))) {
+        if (find_cluster_in_extent_map(vol, handle->extents, cluster, run_length, index) < 0)
+            return -1;
+
+        /* Clusters past the end of the map are looked up in the FAT */
+        if (*run_length == 1)
+            *run_length = get_contiguous_cluster_count(vol, *cluster, max_run_length);
+        return 0;
+    }
+#endif
+
+    *cluster = handle->cluster;
+    while (current_index < index) {
+        if (get_next_cluster(vol, cluster, *cluster) < 0
+        ||  *cluster >= 0xFFF8)
+            return -1;
+        ++current_index;
+    }
+    *run_length = get_contiguous_cluster_count(vol, *cluster, max_run_length);
 
     return 0;
 }
 
-int read_from_handle(struct entry_handle *handle, void *buffer, uint32_t count)
+/**
+ * @brief Change the first cluster of the file opened by a handle
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[in] cluster
+ * @return 0 if successful, -1 otherwise
+ */
+static int set_starting_cluster(struct fat16_volume *vol, struct entry_handle *handle, uint16_t cluster)
 {
-    uint32_t bytes_read_count = 0;
-    uint8_t *bytes = (uint8_t *)buffer;
+    handle->starting_cluster = cluster;
+#if FAT16_EXTENT_COUNT > 0
+    if (handle->extents != NULL)
+        init_extent_map(handle->extents, cluster);
+#endif
+
+    if (dev_write(vol, handle->pos_entry + offsetof(struct dir_entry, starting_cluster), &cluster, sizeof(cluster), ENTRY_SECTOR) < 0)
+        return -1;
+
+    dentry_update(vol, handle->pos_entry, cluster, handle->entry_size);
+    return 0;
+}
+
+/**
+ * @brief Move a handle forward in clusters which follow each other in the data region
+ *
+ * The handle stays in the last cluster if it ends on its boundary.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[in] count Number of bytes
+ */
+static void advance_handle(struct fat16_volume *vol, struct entry_handle *handle, uint32_t count)
+{
+    uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+    uint32_t end_offset = handle->offset + count;
+
+    handle->cluster += (end_offset - 1) / cluster_size;
+    handle->offset = (end_offset - 1) % cluster_size + 1;
+    handle->position += count;
+}
+
+/**
+ * @brief Transfer as many bytes as possible from the current position of a
+ * handle with a single device access
+ *
+ * The transfer spans all clusters which follow the current one in the data
+ * region. The handle is moved to the last byte transferred.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[in|out] bytes
+ * @param[in] count Must not be greater than the number of bytes left in the chain
+ * @param[in] is_write
+ * @param[in] is_deferred If true, transfers of whole sectors are queued
+ * @return Number of bytes transferred, -1 if an error occurred
+ */
+static int32_t transfer_run(struct fat16_volume *vol, struct entry_handle *handle, uint8_t *bytes, uint32_t count, bool is_write, bool is_deferred)
+{
+    uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+    uint32_t cluster_count;
+    uint16_t cluster;
+    int ret;
 
-    /* Check if we reach end of file */
-    if (handle->remaining_bytes == 0)
+    if (find_handle_cluster(vol, handle, &cluster, &cluster_count, get_cluster_index(vol, handle),
+                            (handle->offset + count + cluster_size - 1) / cluster_size) < 0)
+        return -1;
+    if (count > cluster_count * cluster_size - handle->offset)
+        count = cluster_count * cluster_size - handle->offset;
+
+    if (is_write)
+        ret = dev_write_deferred(vol, get_data_pos(vol, handle->cluster, handle->offset), bytes, count, DATA_SECTOR);
+    else if (is_deferred)
+        ret = dev_read_deferred(vol, get_data_pos(vol, handle->cluster, handle->offset), bytes, count);
+    else
+        ret = dev_read(vol, get_data_pos(vol, handle->cluster, handle->offset), bytes, count);
+    if (ret < 0)
+        return -1;
+
+    advance_handle(vol, handle, count);
+
+    return count;
+}
+
+/**
+ * @brief Move a read handle to the next cluster if it reached the end of the current one
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @return 0 if successful, -1 otherwise
+ */
+static int move_to_next_cluster(struct fat16_volume *vol, struct entry_handle *handle)
+{
+    uint16_t next_cluster;
+    uint32_t run_length;
+
+    if (handle->offset < vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector)
         return 0;
 
+    if (find_handle_cluster(vol, handle, &next_cluster, &run_length, get_cluster_index(vol, handle) + 1, 1) < 0)
+        return -1;
+
+    handle->cluster = next_cluster;
+    handle->offset = 0;
+
+    return 0;
+}
+
+/**
+ * @brief Read bytes at the current position of a handle
+ *
+ * If is_deferred is true, transfers of whole sectors are queued and the buffer
+ * must not be used before dev_submit is called.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[out] bytes
+ * @param[in] count
+ * @param[in] max_run_count Maximum number of runs of contiguous clusters to read
+ * @param[in] is_deferred
+ * @return number of bytes read, -1 if an error happened
+ */
+static int32_t read_bytes(struct fat16_volume *vol, struct entry_handle *handle, uint8_t *bytes, uint32_t count, uint32_t max_run_count, bool is_deferred)
+{
+    uint32_t bytes_read_count = 0;
+
     /* Check that cluster is valid */
     if (handle->cluster == 0)
         return 0;
 
-    move_to_data_region(handle->cluster, handle->offset);
-
     /* Read in chunk until count is 0 or end of file is reached */
-    while (count > 0) {
-        uint32_t chunk_length = count, bytes_remaining_in_cluster = 0;
+    while (count > 0 && handle->position < handle->size && max_run_count-- > 0) {
+        uint32_t remaining_bytes = handle->size - handle->position;
+        int32_t chunk_length;
 
-        /* Check if we reach end of file */
-        if (handle->remaining_bytes == 0)
-            return bytes_read_count;
-
-        /* Check that we read within the boundary of the current cluster */
-        bytes_remaining_in_cluster = bpb.sectors_per_cluster * bpb.bytes_per_sector - handle->offset;
-        if (chunk_length > bytes_remaining_in_cluster)
-            chunk_length = bytes_remaining_in_cluster;
+        /* Look for the next cluster in the FAT if we reached the end of the current one */
+        if (move_to_next_cluster(vol, handle) < 0)
+            return -1;
 
         /* Check that we do not read past the end of file */
-        if (chunk_length > handle->remaining_bytes)
-            chunk_length = handle->remaining_bytes;
+        chunk_length = transfer_run(vol, handle, &bytes[bytes_read_count],
+                                    count < remaining_bytes ? count : remaining_bytes,
+                                    false, is_deferred);
+        if (chunk_length < 0)
+            return -1;
+
+        count -= chunk_length;
+        bytes_read_count += chunk_length;
+    }
+
+    return bytes_read_count;
+}
 
-        dev.read(&bytes[bytes_read_count], chunk_length);
+/**
+ * @brief Read bytes at the current position of a handle from the device
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[out] bytes
+ * @param[in] count
+ * @return number of bytes read, -1 if an error happened
+ */
+static int32_t read_direct(struct fat16_volume *vol, struct entry_handle *handle, uint8_t *bytes, uint32_t count)
+{
+    int32_t ret = read_bytes(vol, handle, bytes, count, ALL_RUNS, IS_READ_QUEUED);
+
+    /* Queued transfers must be performed even if an error happened */
+    if (IS_READ_QUEUED && dev_submit(vol) < 0)
+        return -1;
+
+    return ret;
+}
+
+#if FAT16_READAHEAD_COUNT > 0
+
+void init_readahead(struct readahead *readahead, uint32_t position)
+{
+    readahead->position = position;
+    readahead->length = 0;
+    readahead->window = 0;
+    readahead->next_position = position;
+}
+
+/**
+ * @brief Move a handle forward without reading anything
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[in] count Must not be greater than the number of bytes left in the file
+ * @return 0 if successful, -1 otherwise
+ */
+static int skip_bytes(struct fat16_volume *vol, struct entry_handle *handle, uint32_t count)
+{
+    uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+
+    while (count > 0) {
+        uint32_t chunk_length;
+
+        if (move_to_next_cluster(vol, handle) < 0)
+            return -1;
+
+        chunk_length = cluster_size - handle->offset;
+        if (chunk_length > count)
+            chunk_length = count;
 
-        handle->remaining_bytes -= chunk_length;
         handle->offset += chunk_length;
-        if (handle->offset == bpb.sectors_per_cluster * bpb.bytes_per_sector) {
-            handle->offset = 0;
+        handle->position += chunk_length;
+        count -= chunk_length;
+    }
 
-            /* Look for the next cluster in the FAT, unless we are already reading the last one */
-            if (handle->remaining_bytes != 0) {
-                uint16_t next_cluster;
-                if (get_next_cluster(&next_cluster, handle->cluster) < 0)
-                    return -1;
+    return 0;
+}
+
+/**
+ * @brief Get the number of bytes read by the next refill of a readahead buffer
+ *
+ * @param[in] vol
+ * @param[in] handle
+ * @return Bytes left in the current cluster, followed by the clusters of the window
+ */
+static uint32_t get_refill_length(struct fat16_volume *vol, struct entry_handle *handle)
+{
+    uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
 
-                handle->cluster = next_cluster;
+    return cluster_size - handle->position % cluster_size + handle->readahead->window * cluster_size;
+}
 
-                move_to_data_region(handle->cluster, handle->offset);
-            }
+/**
+ * @brief Fill the readahead buffer of a handle from its current position
+ *
+ * The chain is walked on a copy of the handle, which also brings the FAT
+ * entries linking the clusters read ahead in the cache.
+ *
+ * @param[in] vol
+ * @param[in] handle
+ * @return 0 if successful, -1 otherwise
+ */
+static int fill_readahead(struct fat16_volume *vol, struct entry_handle *handle)
+{
+    struct readahead *readahead = handle->readahead;
+    struct entry_handle copy = *handle;
+    int32_t ret;
+
+    readahead->position = handle->position;
+    readahead->length = 0;
+
+    ret = read_direct(vol, &copy, readahead->data, get_refill_length(vol, handle));
+    if (ret < 0)
+        return -1;
+
+    readahead->length = ret;
+    if (readahead->window * 2 < vol->readahead_clusters)
+        readahead->window *= 2;
+    else
+        readahead->window = vol->readahead_clusters - 1;
+
+    return 0;
+}
+
+int read_from_handle(struct fat16_volume *vol, struct entry_handle *handle, void *buffer, uint32_t count)
+{
+    struct readahead *readahead = handle->readahead;
+    uint8_t *bytes = (uint8_t *)buffer;
+    uint32_t bytes_read_count = 0;
+
+    if (readahead == NULL)
+        return read_direct(vol, handle, bytes, count);
+
+    /* The handle moved since the last read, do not read ahead anymore */
+    if (handle->position != readahead->next_position) {
+        readahead->length = 0;
+        readahead->window = 0;
+    } else if (readahead->window == 0) {
+        readahead->window = 1;
+    }
+
+    while (count > 0) {
+        uint32_t end = readahead->position + readahead->length;
+
+        if (handle->position >= readahead->position && handle->position < end) {
+            uint32_t chunk_length = end - handle->position;
+
+            if (chunk_length > count)
+                chunk_length = count;
+
+            memcpy(&bytes[bytes_read_count], &readahead->data[handle->position - readahead->position], chunk_length);
+            if (skip_bytes(vol, handle, chunk_length) < 0)
+                return -1;
+
+            count -= chunk_length;
+            bytes_read_count += chunk_length;
+        } else if (readahead->window == 0 || count >= get_refill_length(vol, handle)) {
+            /* Reads which are not sequential, or not smaller than a refill, are not buffered */
+            int32_t ret = read_direct(vol, handle, &bytes[bytes_read_count], count);
+            if (ret < 0)
+                return -1;
+
+            bytes_read_count += ret;
+            break;
+        } else {
+            if (fill_readahead(vol, handle) < 0)
+                return -1;
+
+            /* End of file */
+            if (readahead->length == 0)
+                break;
         }
-        count -= chunk_length;
-        bytes_read_count += chunk_length;
     }
 
+    readahead->next_position = handle->position;
+
     return bytes_read_count;
 }
 
-static void update_size_file(uint32_t pos_entry, uint32_t bytes_written_count)
+#else
+
+int read_from_handle(struct fat16_volume *vol, struct entry_handle *handle, void *buffer, uint32_t count)
+{
+    return read_direct(vol, handle, (uint8_t *)buffer, count);
+}
+
+#endif
+
+int32_t queue_read_from_handle(struct fat16_volume *vol, struct entry_handle *handle, void *buffer, uint32_t count)
 {
-    uint32_t file_size = 0;
-    uint32_t pos = pos_entry;
+    /* Each run queues at most one transfer, so the queue never fills up */
+    return read_bytes(vol, handle, (uint8_t *)buffer, count, FAT16_BATCH_SIZE, true);
+}
+
+int read_view_from_handle(struct fat16_volume *vol, struct entry_handle *handle, uint32_t max_count, const uint8_t **data, uint32_t *count, bool *is_pinned)
+{
+    uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+    uint32_t remaining_bytes = handle->size - handle->position;
+    uint32_t cluster_count, pos;
+    uint16_t cluster;
+
+    *data = NULL;
+    *count = 0;
+    *is_pinned = false;
+    if (handle->cluster == 0 || remaining_bytes == 0 || max_count == 0)
+        return 0;
+
+    if (move_to_next_cluster(vol, handle) < 0)
+        return -1;
+
+    if (max_count > remaining_bytes)
+        max_count = remaining_bytes;
+
+    /* A mapped device can expose all clusters which follow each other */
+    if (find_handle_cluster(vol, handle, &cluster, &cluster_count, get_cluster_index(vol, handle),
+                            (handle->offset + max_count + cluster_size - 1) / cluster_size) < 0)
+        return -1;
+    if (max_count > cluster_count * cluster_size - handle->offset)
+        max_count = cluster_count * cluster_size - handle->offset;
+
+    pos = get_data_pos(vol, handle->cluster, handle->offset);
+    *data = (const uint8_t *)dev_map(vol, pos, max_count);
+    if (*data == NULL) {
+        /* Otherwise, the view is limited to one cached sector */
+        uint16_t sector_size = get_sector_size(vol);
+        uint16_t offset = pos % sector_size;
+
+        if (max_count > (uint32_t)(sector_size - offset))
+            max_count = sector_size - offset;
+
+        *data = cache_pin_sector(vol, pos / sector_size);
+        if (*data == NULL)
+            return -1;
+        *data += offset;
+        *is_pinned = true;
+    }
+
+    *count = max_count;
+    advance_handle(vol, handle, max_count);
+
+    return 0;
+}
+
+void update_size_file(struct fat16_volume *vol, struct entry_handle *handle)
+{
+    /* Nothing to do if existing bytes were overwritten */
+    if (handle->position <= handle->size)
+        return;
+
+    handle->size = handle->position;
+
+#if FAT16_SIZE_UPDATE_THRESHOLD > 0
+    if (handle->size - handle->entry_size >= FAT16_SIZE_UPDATE_THRESHOLD)
+        write_size_file(vol, handle);
+#else
+    (void)vol;
+#endif
+}
+
+int write_size_file(struct fat16_volume *vol, struct entry_handle *handle)
+{
+    uint32_t pos = handle->pos_entry;
     pos += offsetof(struct dir_entry, size);
 
-    dev.seek(pos);
-    dev.read(&file_size, sizeof(file_size));
+    if (handle->size == handle->entry_size)
+        return 0;
 
-    file_size += bytes_written_count;
+    if (dev_write(vol, pos, &handle->size, sizeof(handle->size), ENTRY_SECTOR) < 0)
+        return -1;
 
-    dev.seek(pos);
-    dev.write(&file_size, sizeof(file_size));
+    handle->entry_size = handle->size;
+    dentry_update(vol, handle->pos_entry, handle->starting_cluster, handle->size);
+    return 0;
 }
 
-int write_from_handle(struct entry_handle *handle, const void *buffer, uint32_t count)
+int read_vector_from_handle(struct fat16_volume *vol, struct entry_handle *handle, const struct fat16_iovec *iov, uint8_t iov_count)
 {
-    uint32_t bytes_written_count = 0;
-    const uint8_t *bytes = (const uint8_t *)buffer;
+    uint32_t bytes_read_count = 0;
+    bool has_failed = false;
+    uint8_t i;
 
-    /* If the file is not empty, move position to the end of file */
-    if (handle->cluster != 0)
-    move_to_data_region(handle->cluster, handle->offset);
+    for (i = 0; i < iov_count; ++i) {
+        int32_t ret = read_bytes(vol, handle, (uint8_t *)iov[i].base, iov[i].length, ALL_RUNS, IS_READ_QUEUED);
+        if (ret < 0) {
+            has_failed = true;
+            break;
+        }
 
-    /* Write in chunk until count is 0 or no clusters can be allocated */
-    while (count > 0) {
-        uint32_t chunk_length = count;
-        uint32_t bytes_remaining_in_cluster = bpb.sectors_per_cluster * bpb.bytes_per_sector - handle->offset;
+        bytes_read_count += ret;
 
-        /* Check if we need to allocate a new cluster */
+        /* Stop at the end of the file */
+        if ((uint32_t)ret < iov[i].length)
+            break;
+    }
+
+    /* All segments are transferred in as few batches as possible */
+    if ((IS_READ_QUEUED && dev_submit(vol) < 0)
+    ||  (has_failed && bytes_read_count == 0))
+        return -1;
+
+    return bytes_read_count;
+}
+
+/**
+ * @brief Write bytes at the current position of a handle
+ *
+ * The size of the file is not updated.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[in] bytes
+ * @param[in] count
+ * @param[in] pending_count Number of bytes which will be written right after, clusters allocated for count bytes are also allocated for them.
+ * @param[in] max_run_count Maximum number of runs of contiguous clusters to write
+ * @return number of bytes written, -1 if an error happened
+ */
+static int32_t write_bytes(struct fat16_volume *vol, struct entry_handle *handle, const uint8_t *bytes, uint32_t count, uint32_t pending_count, uint32_t max_run_count)
+{
+    uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+    uint32_t bytes_written_count = 0;
+
+    /* Write in chunk until count is 0 */
+    while (count > 0 && max_run_count-- > 0) {
+        int32_t chunk_length;
+
+        /* Move to the next cluster, allocate clusters if needed */
         if (handle->cluster == 0
-            || bytes_remaining_in_cluster == 0) {
-            uint16_t new_cluster = 0;
-            if (allocate_cluster(&new_cluster, handle->cluster) < 0)
+            || handle->offset == cluster_size) {
+            uint16_t next_cluster = 0xFFFF;
+
+            if (handle->cluster != 0
+            &&  get_next_cluster(vol, &next_cluster, handle->cluster) < 0)
                 return -1;
 
-            /* If the file was empty, update cluster in root directory entry */
-            if (handle->cluster == 0) {
-                dev.seek(handle->pos_entry + offsetof(struct dir_entry, starting_cluster));
-                dev.write(&new_cluster, sizeof(new_cluster));
+            if (next_cluster >= 0xFFF8) {
+                /* Reserve contiguous clusters for the rest of the data */
+                uint32_t wanted_count = (count + pending_count + cluster_size - 1) / cluster_size;
+                uint16_t cluster_count = wanted_count > 0xFFFF ? 0xFFFF : wanted_count;
+
+                if (allocate_clusters(vol, &next_cluster, &cluster_count, handle->cluster) < 0)
+                    return -1;
+
+                /* If the file was empty, update cluster in directory entry */
+                if (handle->cluster == 0
+                &&  set_starting_cluster(vol, handle, next_cluster) < 0)
+                    return -1;
             }
 
-            handle->cluster = new_cluster;
+            handle->cluster = next_cluster;
             handle->offset = 0;
-
-            move_to_data_region(new_cluster, 0);
-            bytes_remaining_in_cluster = bpb.sectors_per_cluster * bpb.bytes_per_sector;
         }
 
-        /* Check that we write within the boundary of the current cluster */
-        if (chunk_length > bytes_remaining_in_cluster)
-            chunk_length = bytes_remaining_in_cluster;
-
-        dev.write(&bytes[bytes_written_count], chunk_length);
+        chunk_length = transfer_run(vol, handle, (uint8_t *)&bytes[bytes_written_count], count, true, true);
+        if (chunk_length < 0)
+            return -1;
 
         count -= chunk_length;
         bytes_written_count += chunk_length;
-        handle->offset += chunk_length;
     }
 
-    /* Update size of file in root directory entry */
-    update_size_file(handle->pos_entry, bytes_written_count);
+    return bytes_written_count;
+}
+
+int write_from_handle(struct fat16_volume *vol, struct entry_handle *handle, const void *buffer, uint32_t count)
+{
+    int32_t bytes_written_count = write_bytes(vol, handle, (const uint8_t *)buffer, count, 0, ALL_RUNS);
+
+    /* Clusters allocated for the data may not have been written */
+    if (bytes_written_count < 0)
+        handle->has_reserved_clusters = true;
+
+    /* Queued transfers must be performed even if an error happened */
+    if (dev_submit(vol) < 0
+    ||  bytes_written_count <= 0)
+        return -1;
+
+    /* Update size of file in directory entry */
+    update_size_file(vol, handle);
 
     return bytes_written_count;
 }
 
-int navigate_to_subdir(struct entry_handle *handle, char *entry_name, const char *path)
+int32_t queue_write_from_handle(struct fat16_volume *vol, struct entry_handle *handle, const void *buffer, uint32_t count)
 {
-    int ret;
-    char subdir_name[13];
-    uint16_t index = 0;
+    /* Each run queues at most one transfer, so the queue never fills up */
+    int32_t ret = write_bytes(vol, handle, (const uint8_t *)buffer, count, 0, FAT16_BATCH_SIZE);
+
+    if (ret < 0)
+        handle->has_reserved_clusters = true;
+
+    return ret;
+}
+
+int write_vector_from_handle(struct fat16_volume *vol, struct entry_handle *handle, const struct fat16_iovec *iov, uint8_t iov_count)
+{
+    uint32_t bytes_written_count = 0, pending_count = 0;
+    bool has_failed = false;
+    uint8_t i;
+
+    for (i = 0; i < iov_count; ++i)
+        pending_count += iov[i].length;
+
+    /* Segments follow each other in the file, the size is updated once */
+    for (i = 0; i < iov_count; ++i) {
+        int32_t ret;
+
+        pending_count -= iov[i].length;
+        ret = write_bytes(vol, handle, (const uint8_t *)iov[i].base, iov[i].length, pending_count, ALL_RUNS);
+        if (ret < 0) {
+            /* Clusters allocated for the next segments are not written */
+            handle->has_reserved_clusters = true;
+            has_failed = true;
+            break;
+        }
+
+        bytes_written_count += ret;
+    }
+
+    /* All segments are transferred in as few batches as possible */
+    if (dev_submit(vol) < 0
+    ||  has_failed
+    ||  bytes_written_count == 0)
+        return -1;
+
+    update_size_file(vol, handle);
+
+    return bytes_written_count;
+}
+
+int move_handle(struct fat16_volume *vol, struct entry_handle *handle, uint32_t position)
+{
+    uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+    uint32_t index, run_length;
+    uint16_t cluster;
 
-    ret = get_subdir(subdir_name, &index, path);
-    if (ret < 0) {
+    if (position > handle->size)
         return -1;
+
+    if (position == 0) {
+        handle->cluster = handle->starting_cluster;
+        handle->offset = 0;
+        handle->position = 0;
+        return 0;
     }
 
-    if (to_short_filename(entry_name, subdir_name) < 0)
+    /* A position on a cluster boundary belongs to the previous cluster */
+    index = (position - 1) / cluster_size;
+
+    /* Without extent map, the chain can only be walked forward */
+    if (handle->extents == NULL && index < get_cluster_index(vol, handle)) {
+        handle->cluster = handle->starting_cluster;
+        handle->offset = 0;
+        handle->position = 0;
+    }
+
+    if (find_handle_cluster(vol, handle, &cluster, &run_length, index, 1) < 0)
         return -1;
 
-    if (open_directory_in_root(handle, entry_name) < 0)
+    handle->cluster = cluster;
+    handle->offset = (position - 1) % cluster_size + 1;
+    handle->position = position;
+
+    return 0;
+}
+
+int get_cluster_at(struct fat16_volume *vol, uint16_t *cluster, uint16_t *offset, uint16_t starting_cluster, uint32_t position)
+{
+    uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+    uint32_t hop_count;
+
+    *cluster = starting_cluster;
+    *offset = 0;
+    if (position == 0)
+        return 0;
+
+    /* A position on a cluster boundary belongs to the previous cluster */
+    hop_count = (position - 1) / cluster_size;
+    while (hop_count > 0) {
+        if (get_next_cluster(vol, cluster, *cluster) < 0
+        ||  *cluster >= 0xFFF8)
+            return -1;
+        --hop_count;
+    }
+    *offset = (position - 1) % cluster_size + 1;
+
+    return 0;
+}
+
+int get_handle_cluster_at(struct fat16_volume *vol, struct entry_handle *handle, uint16_t *cluster, uint16_t *offset, uint32_t position)
+{
+#if FAT16_EXTENT_COUNT > 0
+    if (handle->extents != NULL) {
+        uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+        uint32_t run_length;
+
+        *cluster = handle->starting_cluster;
+        *offset = 0;
+        if (position == 0)
+            return 0;
+
+        /* A position on a cluster boundary belongs to the previous cluster */
+        if (find_cluster_in_extent_map(vol, handle->extents, cluster, &run_length, (position - 1) / cluster_size) < 0)
+            return -1;
+        *offset = (position - 1) % cluster_size + 1;
+
+        return 0;
+    }
+#endif
+
+    return get_cluster_at(vol, cluster, offset, handle->starting_cluster, position);
+}
+
+/**
+ * @brief Find the last cluster of a chain
+ *
+ * @param[in] vol
+ * @param[out] last_cluster
+ * @param[out] cluster_count Number of clusters in the chain
+ * @param[in] cluster First cluster of the chain, 0 if the chain is empty
+ * @return 0 if successful, -1 otherwise
+ */
+static int get_last_cluster(struct fat16_volume *vol, uint16_t *last_cluster, uint32_t *cluster_count, uint16_t cluster)
+{
+    *last_cluster = cluster;
+    *cluster_count = 0;
+
+    while (cluster != 0 && cluster < 0xFFF8) {
+        *last_cluster = cluster;
+        ++*cluster_count;
+        if (get_next_cluster(vol, &cluster, cluster) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+int reserve_clusters(struct fat16_volume *vol, struct entry_handle *handle, uint32_t size)
+{
+    uint32_t cluster_size = vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+    uint32_t wanted_count = (size + cluster_size - 1) / cluster_size;
+    uint32_t cluster_count;
+    uint16_t last_cluster;
+    struct dir_entry entry;
+
+    if (dev_read(vol, handle->pos_entry, &entry, sizeof(entry)) < 0)
         return -1;
 
-    while (1) {
-        ret = get_subdir(subdir_name, &index, path);
-        if (to_short_filename(entry_name, &path[index]) < 0)
+    if (get_last_cluster(vol, &last_cluster, &cluster_count, entry.starting_cluster) < 0)
+        return -1;
+
+    while (cluster_count < wanted_count) {
+        uint16_t first_cluster;
+        uint16_t count = wanted_count - cluster_count > 0xFFFF ? 0xFFFF : wanted_count - cluster_count;
+
+        if (allocate_clusters(vol, &first_cluster, &count, last_cluster) < 0)
+            return -1;
+
+        handle->has_reserved_clusters = true;
+
+        /* If the file was empty, update cluster in directory entry and handle */
+        if (last_cluster == 0) {
+            if (set_starting_cluster(vol, handle, first_cluster) < 0)
+                return -1;
+            handle->cluster = first_cluster;
+            handle->offset = 0;
+        }
+
+        last_cluster = first_cluster + count - 1;
+        cluster_count += count;
+    }
+
+    return 0;
+}
+
+int release_unused_clusters(struct fat16_volume *vol, struct entry_handle *handle)
+{
+    uint16_t last_cluster, next_cluster, offset;
+    struct dir_entry entry;
+
+    /* Otherwise, the chain of the file ends with its last byte */
+    if (!handle->has_reserved_clusters)
+        return 0;
+
+    if (dev_read(vol, handle->pos_entry, &entry, sizeof(entry)) < 0)
+        return -1;
+
+    if (entry.starting_cluster == 0) {
+        handle->has_reserved_clusters = false;
+        return 0;
+    }
+
+    if (entry.size == 0) {
+        if (free_cluster_chain(vol, entry.starting_cluster) < 0)
             return -1;
+        handle->cluster = 0;
+        handle->offset = 0;
+        handle->position = 0;
+        handle->has_reserved_clusters = false;
+        return set_starting_cluster(vol, handle, 0);
+    }
+
+    if (get_handle_cluster_at(vol, handle, &last_cluster, &offset, entry.size) < 0
+    ||  get_next_cluster(vol, &next_cluster, last_cluster) < 0)
+        return -1;
+
+    if (next_cluster >= 0xFFF8) {
+        handle->has_reserved_clusters = false;
+        return 0;
+    }
+
+    if (write_fat_entry(vol, last_cluster, 0xFFFF) < 0
+    ||  free_cluster_chain(vol, next_cluster) < 0)
+        return -1;
+
+    handle->has_reserved_clusters = false;
+
+    /* Freed clusters may be part of the extent map */
+#if FAT16_EXTENT_COUNT > 0
+    if (handle->extents != NULL)
+        init_extent_map(handle->extents, handle->starting_cluster);
+#endif
+
+    return 0;
+}
+
+void init_dir_iterator(struct fat16_volume *vol, struct dir_iterator *it, uint16_t starting_cluster)
+{
+    it->is_done = false;
+    it->cluster = starting_cluster;
+    if (starting_cluster == 0) {
+        it->pos = get_root_entry_pos(vol, 0);
+        it->end = get_root_entry_pos(vol, vol->bpb.root_entry_count);
+    } else {
+        it->pos = get_data_pos(vol, starting_cluster, 0);
+        it->end = it->pos + vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+    }
+    it->buffer_pos = 0;
+    it->buffer_length = 0;
+}
 
-        if (ret < 0)
+int read_dir_iterator(struct fat16_volume *vol, struct dir_iterator *it, struct dir_entry *entry)
+{
+    while (!it->is_done) {
+        /* Move to the next cluster of a subdirectory */
+        if (it->pos == it->end) {
+            uint16_t next_cluster;
+
+            if (it->cluster == 0
+            ||  get_next_cluster(vol, &next_cluster, it->cluster) < 0
+            ||  next_cluster >= 0xFFF8) {
+                it->is_done = true;
+                break;
+            }
+
+            it->cluster = next_cluster;
+            it->pos = get_data_pos(vol, next_cluster, 0);
+            it->end = it->pos + vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector;
+        }
+
+        /* Refill the buffer, without reading past the end of the cluster */
+        if (it->pos < it->buffer_pos || it->pos >= it->buffer_pos + it->buffer_length) {
+            uint32_t length = it->end - it->pos;
+            if (length > sizeof(it->buffer))
+                length = sizeof(it->buffer);
+
+            if (dev_read(vol, it->pos, it->buffer, length) < 0)
+                return -1;
+            it->buffer_pos = it->pos;
+            it->buffer_length = length;
+        }
+
+        memcpy(entry, &it->buffer[it->pos - it->buffer_pos], sizeof(struct dir_entry));
+        it->pos += sizeof(struct dir_entry);
+
+        /* Check if we reached end of entry list */
+        if (entry->name[0] == 0) {
+            it->is_done = true;
             break;
+        }
 
-        open_directory_in_subdir(handle, entry_name);
+        if ((uint8_t)(entry->name[0]) == AVAILABLE_DIR_ENTRY)
+            continue;
+
+        if ((entry->attribute & VFAT_DIR_ENTRY) == VFAT_DIR_ENTRY)
+            continue;
+
+        return 1;
     }
 
     return 0;
 }
+
+int navigate_to_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *entry_name, const char *path)
+{
+    int ret;
+    char subdir_name[13];
+    uint16_t index, cached_index;
+
+    index = path_cache_find(vol, handle, path);
+    cached_index = index;
+    if (index == 0) {
+        ret = get_subdir(subdir_name, &index, path);
+        if (ret < 0) {
+            return -1;
+        }
+
+        if (to_short_filename(entry_name, subdir_name) < 0)
+            return -1;
+
+        if (open_directory_in_root(vol, handle, entry_name) < 0)
+            return -1;
+    }
+
+    while ((ret = get_subdir(subdir_name, &index, path)) == 0) {
+        if (to_short_filename(entry_name, subdir_name) < 0)
+            return -1;
+
+        if (open_directory_in_subdir(vol, handle, entry_name) < 0)
+            return -1;
+    }
+
+    /* Check that the path ends with a valid name */
+    if (ret != -2)
+        return -1;
+
+    if (index != cached_index)
+        path_cache_add(vol, handle, path, index);
+
+    return to_short_filename(entry_name, &path[index]);
+}
@@ -23,15 +23,34 @@
 
 #include <stdbool.h>
 #include <stdint.h>
+#include "blockdev.h"
+#include "cache.h"
+#include "dentry.h"
+#include "extent.h"
+#include "fat16.h"
+#include "fat_table.h"
+#include "open_file.h"
+#include "path_cache.h"
 
 #define FIRST_CLUSTER_INDEX_IN_FAT     (3)
 #define MAX_BYTES_PER_CLUSTER           (32768LU)
 #define VFAT_DIR_ENTRY                  (0x0F)
 #define AVAILABLE_DIR_ENTRY             (0xE5)
 
+/*
+ * The size of a file written to is kept in its handle and only written to
+ * its directory entry by fat16_flush and fat16_close, or once the file grew
+ * by this number of bytes. 0 means no threshold.
+ */
+#ifndef FAT16_SIZE_UPDATE_THRESHOLD
+#define FAT16_SIZE_UPDATE_THRESHOLD     (0)
+#endif
+
+#if FAT16_READAHEAD_COUNT > 0 && FAT16_READAHEAD_SIZE == 0
+#error "FAT16_READAHEAD_SIZE must not be 0"
+#endif
 
 struct fat16_layout {
-    uint32_t offset;                        /**< offset in bytes of the FAT16 partition */
     uint32_t start_fat_region;              /**< offset in bytes of first FAT */
     uint32_t start_root_directory_region;   /**< offset in bytes of root directory */
     uint32_t start_data_region;             /**< offset in bytes of data region */
@@ -55,11 +74,46 @@ struct fat16_bpb {
 struct entry_handle {
     char        mode;               /**< 'r' read from file, 'w' write to file, 'a' append to file */
     uint32_t    pos_entry;          /**< Absolute position of file entry in its directory */
+    uint8_t     file;               /**< Index of the file in the table of open files */
     uint16_t    cluster;            /**< Current cluster reading/writing */
     uint16_t    offset;             /**< Offset in bytes in cluster */
-    uint32_t    remaining_bytes;    /**< Remaining bytes to be read in bytes in the file, only used in read mode */
+    uint32_t    size;               /**< Size of the file in bytes */
+    uint32_t    entry_size;         /**< Size of the file in its directory entry */
+    uint16_t    starting_cluster;   /**< First cluster of the file, 0 if the file is empty */
+    uint32_t    position;           /**< Position in bytes from the start of the file */
+    struct extent_map *extents;     /**< Clusters of the file already walked, NULL if not used */
+    struct readahead *readahead;    /**< Bytes read ahead of the position, NULL if not used */
+    bool        has_reserved_clusters;  /**< True if clusters may be allocated past the end of the file */
 };
 
+#if FAT16_READAHEAD_COUNT > 0
+
+/*
+ * Bytes of a file read ahead by fat16_read. A refill reads the rest of the
+ * current cluster and the window, a number of whole clusters after it. The
+ * window starts at one cluster when reads follow each other, doubles each
+ * time the buffer is refilled, and collapses to 0 as soon as a read does not
+ * start where the previous one ended.
+ */
+struct readahead {
+    bool        is_used;            /**< True if the buffer is attached to a handle */
+    uint32_t    position;           /**< Position in the file of the first byte of data */
+    uint32_t    length;             /**< Number of valid bytes in data */
+    uint32_t    window;             /**< Number of clusters read after the current one by the next refill, 0 if reads are not sequential */
+    uint32_t    next_position;      /**< Position where the next read is expected to start */
+    uint8_t     data[FAT16_READAHEAD_SIZE];
+};
+
+/**
+ * @brief Reset a readahead buffer
+ *
+ * @param[out] readahead
+ * @param[in] position Current position of the handle
+ */
+void init_readahead(struct readahead *readahead, uint32_t position);
+
+#endif
+
 struct __attribute__((packed)) dir_entry {
     char        name[11];
     uint8_t     attribute;
@@ -79,6 +133,95 @@ enum FILE_ATTRIBUTE {
     ARCHIVE     = 0x20
 };
 
+struct view {
+    const uint8_t   *data;      /**< Start of the view */
+    bool            is_used;    /**< False if the slot is free */
+    bool            is_pinned;  /**< True if the view is in a pinned cache sector */
+};
+
+/*
+ * Position of a directory handle returned by fat16_opendir. Entries are
+ * copied from the device a buffer at a time, so that listing a directory
+ * reads each of its sectors once.
+ */
+struct dir_iterator {
+    bool        is_used;        /**< False if the slot is free */
+    bool        is_done;        /**< True once the end of the entry list has been reached */
+    uint16_t    cluster;        /**< Current cluster, 0 in the root directory */
+    uint32_t    pos;            /**< Absolute position of the next entry */
+    uint32_t    end;            /**< Absolute position of the end of the cluster or of the root directory */
+    uint32_t    buffer_pos;     /**< Absolute position of the first byte of buffer */
+    uint16_t    buffer_length;  /**< Number of valid bytes in buffer */
+    uint8_t     buffer[FAT16_MAX_SECTOR_SIZE];
+};
+
+enum ASYNC_STATE {
+    ASYNC_FREE,         /**< Slot is available */
+    ASYNC_QUEUED,       /**< Waiting for its next step */
+    ASYNC_RUNNING,      /**< Transfers of the current step are in progress */
+    ASYNC_DONE          /**< Complete, waiting for fat16_get_result */
+};
+
+struct async_request {
+    uint8_t             state;
+    uint8_t             handle;
+    bool                is_write;
+    bool                has_failed;
+    uint8_t             *buffer;
+    uint32_t            count;          /**< Number of bytes to transfer */
+    uint32_t            done_count;     /**< Number of bytes transferred by completed steps */
+    uint32_t            step_count;     /**< Number of bytes transferred by the current step */
+    uint32_t            sequence;       /**< Requests are performed in increasing order */
+    int                 result;         /**< Set once the request is complete */
+    fat16_callback_t    callback;
+    void                *context;
+};
+
+/*
+ * State of a mounted FAT16 partition. Every function of the driver works on
+ * the volume passed as its first argument, so that volumes do not share
+ * anything but the code.
+ */
+struct fat16_volume {
+    bool                    is_mounted;
+#ifdef FAT16_THREAD_SAFE
+    uint8_t                 index;                      /**< Position in the table of volumes, locks are found with it */
+#endif
+
+    /* Device, see blockdev.c */
+    struct block_dev_t      dev;
+    uint32_t                first_sector;
+    struct block_request    batch[FAT16_BATCH_SIZE];    /**< Transfers queued by dev_read_deferred and dev_write_deferred */
+    uint32_t                batch_count;
+    bool                    is_batch_running;           /**< Set while the device performs the batch started by dev_start */
+    int                     batch_status;               /**< Result of the last batch started by dev_start */
+    bool                    is_sync_needed;             /**< Set when sectors are written, cleared by dev_sync */
+
+    struct cache            cache;
+    struct fat_table        fat_table;
+
+    struct fat16_bpb        bpb;
+    struct fat16_layout     layout;
+
+    struct entry_handle     handles[HANDLE_COUNT];
+    struct open_file_table  open_files;
+#if FAT16_DENTRY_COUNT > 0
+    struct dentry           dentries[FAT16_DENTRY_COUNT];
+#endif
+    struct path_cache       path_cache;
+#if FAT16_EXTENT_COUNT > 0
+    struct extent_map       extent_maps[HANDLE_COUNT];
+#endif
+#if FAT16_READAHEAD_COUNT > 0
+    struct readahead        readaheads[FAT16_READAHEAD_COUNT];
+    uint32_t                readahead_clusters;         /**< Clusters held by a readahead buffer, 0 if it cannot hold two of them */
+#endif
+    struct view             views[FAT16_VIEW_COUNT];
+    struct dir_iterator     dirs[FAT16_DIR_COUNT];
+    struct async_request    async_requests[FAT16_ASYNC_COUNT];
+    uint32_t                async_sequence;
+};
+
 /**
  * @brief Print content of dir_entry
  *
@@ -90,83 +233,309 @@ enum FILE_ATTRIBUTE {
 void dump_dir_entry(struct dir_entry e);
 
 /**
- * @brief Move cursor to a specific byte in data region.
+ * @brief Get position of a specific byte in data region.
  *
+ * @param[in] vol
  * @param[in] cluster Index of the cluster
  * @param[in] offset Offset in bytes from the start of the cluster.
  * @return Position in the fat partition
  */
-uint32_t move_to_data_region(uint16_t cluster, uint16_t offset);
+uint32_t get_data_pos(struct fat16_volume *vol, uint16_t cluster, uint16_t offset);
 
 /**
- * @brief Move cursor to an entry in the root directory.
+ * @brief Get position of an entry in the root directory.
  *
+ * @param[in] vol
  * @param[in] entry_index Index of the entry, must not be greater than bpb.root_entry_count
  * @return Position in the fat partition
  */
-uint32_t move_to_root_directory_region(uint16_t entry_index);
+uint32_t get_root_entry_pos(struct fat16_volume *vol, uint16_t entry_index);
 
 /**
- * @brief Move cursor to a location in the first FAT.
+ * @brief Get position of a cluster entry in the first FAT.
  *
+ * @param[in] vol
  * @param[in] cluster Index of the cluster.
  * @return Position in the fat partition
  */
-uint32_t move_to_fat_region(uint16_t cluster);
+uint32_t get_fat_entry_pos(struct fat16_volume *vol, uint16_t cluster);
+
+/**
+ * @brief Allocate a run of contiguous clusters in the FAT
+ *
+ * The clusters are linked together and the last one is marked as end of
+ * chain. If there is no free run of count clusters, the longest free run is
+ * allocated instead.
+ *
+ * @param[in] vol
+ * @param[out] first_cluster First cluster of the run
+ * @param[in|out] count Number of clusters wanted, number of clusters allocated
+ * @param[in] cluster Cluster to link to the run, 0 if the run starts a new chain
+ * @return 0 if successful, -1 otherwise
+ */
+int allocate_clusters(struct fat16_volume *vol, uint16_t *first_cluster, uint16_t *count, uint16_t cluster);
 
 /**
  * @brief Mark a cluster in the FAT as used
  *
+ * @param[in] vol
  * @param[out] new_cluster
  * @param[in] cluster
  * @return 0 if successful, -1 otherwise
  */
-int allocate_cluster(uint16_t *new_cluster, uint16_t cluster);
+int allocate_cluster(struct fat16_volume *vol, uint16_t *new_cluster, uint16_t cluster);
 
 /**
  * @brief Mark a cluster chain as free in the FAT
  *
- * @param[in] cluster First cluster in the chain
+ * @param[in] vol
+ * @param[in] cluster First cluster in the chain, 0 if there is none
+ * @return 0 if successful, -1 otherwise
  */
-void free_cluster_chain(uint16_t cluster);
+int free_cluster_chain(struct fat16_volume *vol, uint16_t cluster);
 
 /**
  * @brief Get next cluster
  *
+ * @param[in] vol
  * @param[out] next_cluster
  * @param[in] cluster
  * @return 0 if successful, -1 otherwise
  */
-int get_next_cluster(uint16_t *next_cluster, uint16_t cluster);
+int get_next_cluster(struct fat16_volume *vol, uint16_t *next_cluster, uint16_t cluster);
 
 /**
  * @brief Read bytes from file/directory using handle
  *
+ * If the handle has a readahead buffer, small sequential reads are served
+ * from it.
+ *
+ * @param[in] vol
  * @param[in] handle
  * @param[in] buffer
  * @param[in] count
  * @return number of bytes read, -1 if an error happened
  */
-int read_from_handle(struct entry_handle *handle, void *buffer, uint32_t count);
+int read_from_handle(struct fat16_volume *vol, struct entry_handle *handle, void *buffer, uint32_t count);
+
+/**
+ * @brief Queue reads from file using handle, without performing them
+ *
+ * At most FAT16_BATCH_SIZE runs of contiguous clusters are read. Partial
+ * sectors are copied from the cache, transfers of whole sectors are queued
+ * and the buffer must not be used before they are performed.
+ *
+ * @param[in] vol
+ * @param[in] handle
+ * @param[out] buffer
+ * @param[in] count
+ * @return number of bytes read or queued, -1 if an error happened
+ */
+int32_t queue_read_from_handle(struct fat16_volume *vol, struct entry_handle *handle, void *buffer, uint32_t count);
+
+/**
+ * @brief Read bytes from file without copying them
+ *
+ * The handle is moved after the bytes. The bytes are either in device memory
+ * or in a pinned cache sector which must be unpinned once they are not needed
+ * anymore.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[in] max_count Maximum number of bytes
+ * @param[out] data Pointer to the bytes
+ * @param[out] count Number of bytes, 0 if the end of file is reached
+ * @param[out] is_pinned True if the bytes are in a pinned cache sector
+ * @return 0 if successful, -1 otherwise
+ */
+int read_view_from_handle(struct fat16_volume *vol, struct entry_handle *handle, uint32_t max_count, const uint8_t **data, uint32_t *count, bool *is_pinned);
 
 /**
  * @brief Write bytes to file/directory using handle
  *
+ * @param[in] vol
  * @param[in] handle
  * @param[in] buffer
  * @param[in] count
  * @return number of bytes written, -1 if an error happened
  */
-int write_from_handle(struct entry_handle *handle, const void *buffer, uint32_t count);
+int write_from_handle(struct fat16_volume *vol, struct entry_handle *handle, const void *buffer, uint32_t count);
+
+/**
+ * @brief Queue writes to file using handle, without performing them
+ *
+ * Clusters are allocated for count bytes but at most FAT16_BATCH_SIZE runs
+ * of contiguous clusters are written. The size of the file is not updated,
+ * call update_size_file once the queued transfers are performed.
+ *
+ * @param[in] vol
+ * @param[in] handle
+ * @param[in] buffer
+ * @param[in] count
+ * @return number of bytes written or queued, -1 if an error happened
+ */
+int32_t queue_write_from_handle(struct fat16_volume *vol, struct entry_handle *handle, const void *buffer, uint32_t count);
+
+/**
+ * @brief Grow the file if the handle moved past its end
+ *
+ * The new size is only kept in the handle, until write_size_file is called
+ * or the file grew by FAT16_SIZE_UPDATE_THRESHOLD bytes since its directory
+ * entry was last written.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ */
+void update_size_file(struct fat16_volume *vol, struct entry_handle *handle);
+
+/**
+ * @brief Write the size of the file in its directory entry if it changed
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @return 0 if successful, -1 otherwise
+ */
+int write_size_file(struct fat16_volume *vol, struct entry_handle *handle);
+
+/**
+ * @brief Move a handle to a position in its file
+ *
+ * If the handle has no extent map, the chain is walked from the current
+ * cluster of the handle when the target is ahead of it, from the first
+ * cluster of the file otherwise.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[in] position Position in bytes from the start of the file, must not be greater than the size of the file
+ * @return 0 if successful, -1 otherwise
+ */
+int move_handle(struct fat16_volume *vol, struct entry_handle *handle, uint32_t position);
+
+/**
+ * @brief Read bytes from file using handle into several buffers
+ *
+ * @param[in] vol
+ * @param[in] handle
+ * @param[in] iov Buffers filled one after the other
+ * @param[in] iov_count Number of buffers
+ * @return number of bytes read, -1 if an error happened
+ */
+int read_vector_from_handle(struct fat16_volume *vol, struct entry_handle *handle, const struct fat16_iovec *iov, uint8_t iov_count);
+
+/**
+ * @brief Write bytes from several buffers to file using handle
+ *
+ * Clusters are allocated for all buffers at once and the size of the file
+ * is only updated after the last buffer.
+ *
+ * @param[in] vol
+ * @param[in] handle
+ * @param[in] iov Buffers written one after the other
+ * @param[in] iov_count Number of buffers
+ * @return number of bytes written, -1 if an error happened
+ */
+int write_vector_from_handle(struct fat16_volume *vol, struct entry_handle *handle, const struct fat16_iovec *iov, uint8_t iov_count);
+
+/**
+ * @brief Find the cluster holding a position in a file
+ *
+ * A position on a cluster boundary is located at the end of the previous
+ * cluster.
+ *
+ * @param[in] vol
+ * @param[out] cluster
+ * @param[out] offset Offset in bytes in cluster
+ * @param[in] starting_cluster First cluster of the file
+ * @param[in] position Position in bytes from the start of the file
+ * @return 0 if successful, -1 if the chain is too short
+ */
+int get_cluster_at(struct fat16_volume *vol, uint16_t *cluster, uint16_t *offset, uint16_t starting_cluster, uint32_t position);
+
+/**
+ * @brief Find the cluster holding a position in the file opened by a handle
+ *
+ * The extent map of the handle is used if there is one.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[out] cluster
+ * @param[out] offset Offset in bytes in cluster
+ * @param[in] position Position in bytes from the start of the file
+ * @return 0 if successful, -1 if the chain is too short
+ */
+int get_handle_cluster_at(struct fat16_volume *vol, struct entry_handle *handle, uint16_t *cluster, uint16_t *offset, uint32_t position);
+
+/**
+ * @brief Extend the cluster chain of a file
+ *
+ * Clusters are allocated so that the file can hold size bytes. The size of
+ * the file is not changed.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @param[in] size Number of bytes
+ * @return 0 if successful, -1 otherwise
+ */
+int reserve_clusters(struct fat16_volume *vol, struct entry_handle *handle, uint32_t size);
+
+/**
+ * @brief Free clusters past the end of a file
+ *
+ * Only clusters reserved by reserve_clusters, or allocated by a write which
+ * failed, can be past the end of a file. The chain is not walked if the
+ * handle has none.
+ *
+ * @param[in] vol
+ * @param[in|out] handle
+ * @return 0 if successful, -1 otherwise
+ */
+int release_unused_clusters(struct fat16_volume *vol, struct entry_handle *handle);
+
+/**
+ * @brief Start reading the entries of a directory
+ *
+ * @param[in] vol
+ * @param[out] it
+ * @param[in] starting_cluster First cluster of the directory, 0 for the root directory
+ */
+void init_dir_iterator(struct fat16_volume *vol, struct dir_iterator *it, uint16_t starting_cluster);
+
+/**
+ * @brief Read the next entry of a directory
+ *
+ * Available entries and VFAT entries are skipped.
+ *
+ * @param[in] vol
+ * @param[in|out] it
+ * @param[out] entry
+ * @retval 1 if an entry was read
+ * @retval 0 if the end of the entry list was reached
+ * @retval -1 if an error occurred
+ */
+int read_dir_iterator(struct fat16_volume *vol, struct dir_iterator *it, struct dir_entry *entry);
 
 /**
  * @brief Navigate to subdirectory
  *
- * @param[out] handle
- * @param[out] entry_name 8.3 short name
+ * The walk starts from the deepest directory of the path found in the path
+ * cache, and the directory reached is added to it.
+ *
+ * @param[in] vol
+ * @param[out] handle Directory which contains the last component of the path
+ * @param[out] entry_name 8.3 short name of the last component of the path
  * @param[in] path
  * @return 0 if successful, -1 otherwise
  */
-int navigate_to_subdir(struct entry_handle *handle, char *entry_name, const char *path);
+int navigate_to_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *entry_name, const char *path);
+
+/**
+ * @brief Read the BPB of a partition and reset the state of a volume
+ *
+ * @param[out] vol
+ * @param[in] dev
+ * @param[in] first_sector
+ * @return 0 if successful, a negative value otherwise
+ */
+int mount_volume(struct fat16_volume *vol, struct block_dev_t dev, uint32_t first_sector);
 
 #endif
@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include "blockdev.h"
+#include "cache.h"
+#include "debug.h"
+#include "fat16_priv.h"
+#include "fat_table.h"
+
+int fat_table_init(struct fat16_volume *vol)
+{
+    struct fat_table *table = &vol->fat_table;
+
+    table->fat_copy_size = vol->bpb.fat_size;
+    table->fat_copy_size *= vol->bpb.bytes_per_sector;
+
+#ifdef FAT16_FAT_IN_RAM
+    table->fat_byte_count = vol->layout.data_cluster_count + 2;
+    table->fat_byte_count *= 2;
+
+    table->chunk_size = FAT_CHUNK_SIZE;
+    if (table->chunk_size < get_sector_size(vol))
+        table->chunk_size = get_sector_size(vol);
+
+    memset(table->dirty_chunks, 0, sizeof(table->dirty_chunks));
+
+    /* Load the whole FAT with one read */
+    if (dev_read(vol, vol->layout.start_fat_region, table->fat, table->fat_byte_count) < 0) {
+        FAT16DBG("FAT16: Failed to load FAT in memory.\n");
+        return -1;
+    }
+#else
+    /*
+     * Sectors of the first FAT are written to the other copies by the cache
+     * when they are written back. This needs FATs aligned on device sectors,
+     * otherwise each entry is written to every copy.
+     */
+    table->is_copied_by_entry = vol->layout.start_fat_region % get_sector_size(vol) != 0
+                      || table->fat_copy_size % get_sector_size(vol) != 0;
+    if (!table->is_copied_by_entry && vol->bpb.num_fats > 1)
+        cache_set_fat_copies(vol, vol->layout.start_fat_region / get_sector_size(vol),
+                             table->fat_copy_size / get_sector_size(vol),
+                             vol->bpb.num_fats - 1);
+#endif
+
+#ifdef FAT16_FREE_CLUSTER_BITMAP
+    {
+        uint32_t cluster;
+
+        memset(table->used_clusters, 0xFF, sizeof(table->used_clusters));
+        for (cluster = FIRST_CLUSTER_INDEX_IN_FAT; cluster < vol->layout.data_cluster_count + 2; ++cluster) {
+            uint16_t value;
+            if (read_fat_entry(vol, cluster, &value) < 0)
+                return -1;
+
+            if (value == 0)
+                table->used_clusters[cluster / 8] &= ~(1 << (cluster % 8));
+        }
+    }
+#endif
+
+    table->free_cluster_hint = FIRST_CLUSTER_INDEX_IN_FAT;
+
+    return 0;
+}
+
+int read_fat_entry(struct fat16_volume *vol, uint16_t cluster, uint16_t *value)
+{
+#ifdef FAT16_FAT_IN_RAM
+    *value = vol->fat_table.fat[cluster];
+    return 0;
+#else
+    return dev_read(vol, get_fat_entry_pos(vol, cluster), value, sizeof(*value));
+#endif
+}
+
+int write_fat_entry(struct fat16_volume *vol, uint16_t cluster, uint16_t value)
+{
+    struct fat_table *table = &vol->fat_table;
+
+#ifdef FAT16_FREE_CLUSTER_BITMAP
+    if (value == 0)
+        table->used_clusters[cluster / 8] &= ~(1 << (cluster % 8));
+    else
+        table->used_clusters[cluster / 8] |= 1 << (cluster % 8);
+#endif
+
+#ifdef FAT16_FAT_IN_RAM
+    {
+        uint32_t chunk = cluster;
+
+        chunk *= 2;
+        chunk /= table->chunk_size;
+
+        table->fat[cluster] = value;
+        table->dirty_chunks[chunk / 8] |= 1 << (chunk % 8);
+    }
+    return 0;
+#else
+    {
+        uint32_t pos = get_fat_entry_pos(vol, cluster);
+        uint8_t i;
+
+        if (dev_write(vol, pos, &value, sizeof(value), FAT_SECTOR) < 0)
+            return -1;
+
+        if (table->is_copied_by_entry) {
+            for (i = 1; i < vol->bpb.num_fats; ++i) {
+                if (dev_write(vol, pos + i * table->fat_copy_size, &value, sizeof(value), FAT_SECTOR) < 0)
+                    return -1;
+            }
+        }
+    }
+    return 0;
+#endif
+}
+
+/**
+ *
+ * @param[in] vol
+ * @retval 1 if the cluster is free
+ * @retval 0 if the cluster is used
+ * @retval -1 if an error occurred
+ */
+static int is_cluster_free(struct fat16_volume *vol, uint32_t cluster)
+{
+#ifdef FAT16_FREE_CLUSTER_BITMAP
+    return (vol->fat_table.used_clusters[cluster / 8] & (1 << (cluster % 8))) == 0;
+#else
+    uint16_t value;
+
+    if (read_fat_entry(vol, cluster, &value) < 0)
+        return -1;
+
+    return value == 0;
+#endif
+}
+
+int find_free_clusters(struct fat16_volume *vol, uint16_t *first_cluster, uint16_t *count)
+{
+    struct fat_table *table = &vol->fat_table;
+    uint32_t last_cluster = vol->layout.data_cluster_count + 1;
+    uint32_t remaining = last_cluster - FIRST_CLUSTER_INDEX_IN_FAT + 1;
+    uint32_t cluster = table->free_cluster_hint;
+    uint32_t run_start = 0, run_length = 0;
+    uint32_t best_start = 0, best_length = 0;
+
+    while (remaining > 0 && best_length < *count) {
+        int ret;
+
+        /* A run cannot wrap around */
+        if (cluster > last_cluster) {
+            cluster = FIRST_CLUSTER_INDEX_IN_FAT;
+            run_length = 0;
+        }
+
+#ifdef FAT16_FREE_CLUSTER_BITMAP
+        /* Skip 8 used clusters at once */
+        if (cluster % 8 == 0
+        &&  cluster + 8 <= last_cluster + 1
+        &&  remaining >= 8
+        &&  table->used_clusters[cluster / 8] == 0xFF) {
+            cluster += 8;
+            remaining -= 8;
+            run_length = 0;
+            continue;
+        }
+#endif
+
+        ret = is_cluster_free(vol, cluster);
+        if (ret < 0)
+            return -1;
+
+        if (ret) {
+            if (run_length == 0)
+                run_start = cluster;
+            ++run_length;
+
+            if (run_length > best_length) {
+                best_start = run_start;
+                best_length = run_length;
+            }
+        } else {
+            run_length = 0;
+        }
+
+        ++cluster;
+        --remaining;
+    }
+
+    if (best_length == 0) {
+        FAT16DBG("FAT16: Could not find an available cluster.\n");
+        return -1;
+    }
+
+    *first_cluster = best_start;
+    *count = best_length;
+    table->free_cluster_hint = best_start + best_length;
+    return 0;
+}
+
+int fat_table_flush(struct fat16_volume *vol)
+{
+#ifdef FAT16_FAT_IN_RAM
+    struct fat_table *table = &vol->fat_table;
+    uint32_t chunk, start = vol->layout.start_fat_region;
+    uint8_t i;
+
+    /* Contiguous dirty chunks of each copy are merged in a single request */
+    for (i = 0; i < vol->bpb.num_fats; ++i, start += table->fat_copy_size) {
+        for (chunk = 0; chunk * table->chunk_size < table->fat_byte_count; ++chunk) {
+            uint32_t offset = chunk * table->chunk_size;
+            uint32_t length = table->chunk_size;
+
+            if ((table->dirty_chunks[chunk / 8] & (1 << (chunk % 8))) == 0)
+                continue;
+
+            if (offset + length > table->fat_byte_count)
+                length = table->fat_byte_count - offset;
+
+            /* Chunks are sent to the device in batches */
+            if (write_bytes_deferred(vol, start + offset, (uint8_t *)table->fat + offset, length, FAT_SECTOR) < 0) {
+                dev_submit(vol);
+                return -1;
+            }
+        }
+    }
+
+    /* Chunks stay dirty if they may not have been written */
+    if (dev_submit(vol) < 0)
+        return -1;
+
+    memset(table->dirty_chunks, 0, sizeof(table->dirty_chunks));
+    return 0;
+#else
+    (void)vol;
+    return 0;
+#endif
+}
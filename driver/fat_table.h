@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FAT16_FAT_TABLE_H__
+#define __FAT16_FAT_TABLE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fat16.h"
+
+/*
+ * If FAT16_FAT_IN_RAM is defined, the first FAT is loaded in memory by
+ * fat16_init (up to 128KiB). Cluster chains are then walked and modified in
+ * memory and only modified parts of the FAT are written back to the device
+ * by fat_table_flush.
+ *
+ * If FAT16_FREE_CLUSTER_BITMAP is defined, fat16_init builds a bitmap of used
+ * clusters (8KiB) which is kept up to date by write_fat_entry. Free clusters
+ * are then found without reading the FAT.
+ */
+
+#define MAX_FAT_ENTRY_COUNT     (65536LU)
+
+#ifdef FAT16_FAT_IN_RAM
+
+/*
+ * Dirty parts of the FAT are tracked in chunks of FAT_CHUNK_SIZE bytes,
+ * or in device sectors if they are larger.
+ */
+#define FAT_CHUNK_SIZE          (512)
+#define MAX_FAT_CHUNK_COUNT     ((MAX_FAT_ENTRY_COUNT * 2) / FAT_CHUNK_SIZE)
+
+#endif
+
+/* State of the FAT of a volume */
+struct fat_table {
+#ifdef FAT16_FAT_IN_RAM
+    uint16_t    fat[MAX_FAT_ENTRY_COUNT];
+    uint8_t     dirty_chunks[MAX_FAT_CHUNK_COUNT / 8];
+    uint32_t    chunk_size;
+    uint32_t    fat_byte_count;
+#else
+    bool        is_copied_by_entry;     /**< Set if the cache cannot write copies of the FAT (see fat_table_init) */
+#endif
+
+#ifdef FAT16_FREE_CLUSTER_BITMAP
+    uint8_t     used_clusters[MAX_FAT_ENTRY_COUNT / 8];    /**< One bit per cluster, set if the cluster is used or reserved */
+#endif
+
+    uint16_t    free_cluster_hint;      /**< Free clusters are searched from this cluster (next-fit) */
+    uint32_t    fat_copy_size;          /**< Size of a FAT in bytes, the copies follow the first FAT */
+};
+
+/**
+ * @brief Prepare access to the FAT
+ *
+ * Must be called once the layout of the file system is known.
+ *
+ * @param[in] vol
+ * @return 0 if successful, -1 otherwise
+ */
+int fat_table_init(struct fat16_volume *vol);
+
+/**
+ * @brief Read an entry of the FAT
+ *
+ * @param[in] vol
+ * @param[in] cluster
+ * @param[out] value
+ * @return 0 if successful, -1 otherwise
+ */
+int read_fat_entry(struct fat16_volume *vol, uint16_t cluster, uint16_t *value);
+
+/**
+ * @brief Modify an entry of the FAT
+ *
+ * @param[in] vol
+ * @param[in] cluster
+ * @param[in] value
+ * @return 0 if successful, -1 otherwise
+ */
+int write_fat_entry(struct fat16_volume *vol, uint16_t cluster, uint16_t value);
+
+/**
+ * @brief Find a run of contiguous free clusters
+ *
+ * The search starts after the last run found by this function and wraps
+ * around at the end of the FAT (next-fit). It stops at the first run of count
+ * clusters. If there is none, the longest run is returned. The clusters are
+ * not marked as used.
+ *
+ * @param[in] vol
+ * @param[out] first_cluster
+ * @param[in|out] count Number of clusters wanted, length of the run found
+ * @return 0 if successful, -1 if there is no free cluster or an error occurred
+ */
+int find_free_clusters(struct fat16_volume *vol, uint16_t *first_cluster, uint16_t *count);
+
+/**
+ * @brief Write modified parts of the FAT to the device
+ *
+ * Does nothing unless the FAT is kept in memory. Like cache_flush, it does
+ * not lock the cache, so that it can be called when a sector is evicted.
+ *
+ * @param[in] vol
+ * @return 0 if successful, -1 otherwise
+ */
+int fat_table_flush(struct fat16_volume *vol);
+
+#endif
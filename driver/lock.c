@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef FAT16_THREAD_SAFE
+
+/* pthread_rwlock_t is not part of C89 */
+#define _POSIX_C_SOURCE 200112L
+
+#include <pthread.h>
+#include <stddef.h>
+#include "fat16_priv.h"
+#include "lock.h"
+
+/*
+ * Locks are kept here rather than in struct fat16_volume so that the rest of
+ * the driver does not depend on pthreads. Locks of a volume are found with
+ * its position in the table of volumes.
+ */
+static pthread_once_t locks_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t storage_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t volume_locks[FAT16_VOLUME_COUNT];
+static pthread_mutex_t file_locks[FAT16_VOLUME_COUNT][HANDLE_COUNT];
+static pthread_mutex_t cache_locks[FAT16_VOLUME_COUNT];
+
+static void init_locks(void)
+{
+    uint8_t i, j;
+
+    for (i = 0; i < FAT16_VOLUME_COUNT; ++i) {
+        pthread_rwlock_init(&volume_locks[i], NULL);
+        for (j = 0; j < HANDLE_COUNT; ++j)
+            pthread_mutex_init(&file_locks[i][j], NULL);
+        pthread_mutex_init(&cache_locks[i], NULL);
+    }
+}
+
+void lock_volume_table(void)
+{
+    pthread_once(&locks_once, init_locks);
+    pthread_mutex_lock(&table_lock);
+}
+
+void unlock_volume_table(void)
+{
+    pthread_mutex_unlock(&table_lock);
+}
+
+bool lock_volume(struct fat16_volume *vol, bool is_exclusive)
+{
+    if (vol == NULL)
+        return false;
+
+    if (is_exclusive)
+        pthread_rwlock_wrlock(&volume_locks[vol->index]);
+    else
+        pthread_rwlock_rdlock(&volume_locks[vol->index]);
+
+    return true;
+}
+
+void unlock_volume(struct fat16_volume *vol)
+{
+    pthread_rwlock_unlock(&volume_locks[vol->index]);
+}
+
+bool lock_file(struct fat16_volume *vol, uint8_t handle)
+{
+    if (handle >= HANDLE_COUNT || !lock_volume(vol, false))
+        return false;
+
+    pthread_mutex_lock(&file_locks[vol->index][handle]);
+    return true;
+}
+
+void unlock_file(struct fat16_volume *vol, uint8_t handle)
+{
+    pthread_mutex_unlock(&file_locks[vol->index][handle]);
+    unlock_volume(vol);
+}
+
+void lock_cache(struct fat16_volume *vol)
+{
+    pthread_mutex_lock(&cache_locks[vol->index]);
+}
+
+void unlock_cache(struct fat16_volume *vol)
+{
+    pthread_mutex_unlock(&cache_locks[vol->index]);
+}
+
+void lock_storage(void)
+{
+    pthread_mutex_lock(&storage_lock);
+}
+
+void unlock_storage(void)
+{
+    pthread_mutex_unlock(&storage_lock);
+}
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FAT16_LOCK_H__
+#define __FAT16_LOCK_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fat16.h"
+
+/*
+ * If FAT16_THREAD_SAFE is defined, volumes can be used by several threads.
+ *
+ * Functions which modify a volume lock it exclusively. Functions which only
+ * read from it share the volume lock, and lock the file they access so that
+ * reads of different files run in parallel. The cache lock protects the
+ * cache, the queue of the device and views while the volume is shared.
+ *
+ * Locks must be taken in this order: table of volumes, volume, file, cache.
+ * Without FAT16_THREAD_SAFE, these functions do nothing.
+ */
+#ifdef FAT16_THREAD_SAFE
+
+/**
+ * @brief Lock the table of volumes, while a volume is mounted or unmounted
+ */
+void lock_volume_table(void);
+
+void unlock_volume_table(void);
+
+/**
+ * @brief Lock a volume
+ *
+ * @param[in] vol
+ * @param[in] is_exclusive False if the caller does not modify the volume
+ * @return False if vol is null
+ */
+bool lock_volume(struct fat16_volume *vol, bool is_exclusive);
+
+void unlock_volume(struct fat16_volume *vol);
+
+/**
+ * @brief Share the lock of a volume and lock one of its open files
+ *
+ * @param[in] vol
+ * @param[in] handle
+ * @return False if vol is null or handle is out of range
+ */
+bool lock_file(struct fat16_volume *vol, uint8_t handle);
+
+void unlock_file(struct fat16_volume *vol, uint8_t handle);
+
+/**
+ * @brief Lock the cache, the device queue and views of a volume
+ *
+ * @param[in] vol
+ */
+void lock_cache(struct fat16_volume *vol);
+
+void unlock_cache(struct fat16_volume *vol);
+
+/**
+ * @brief Lock the device wrapped by storage_dev_to_block_dev
+ *
+ * Its position is changed by each transfer, they must not be interleaved.
+ */
+void lock_storage(void);
+
+void unlock_storage(void);
+
+#else
+
+#define lock_volume_table()
+#define unlock_volume_table()
+#define lock_volume(vol, is_exclusive)  ((vol) != NULL)
+#define unlock_volume(vol)
+#define lock_file(vol, handle)          ((vol) != NULL)
+#define unlock_file(vol, handle)
+#define lock_cache(vol)
+#define unlock_cache(vol)
+#define lock_storage()
+#define unlock_storage()
+
+#endif
+
+#endif
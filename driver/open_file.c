@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "debug.h"
+#include "fat16_priv.h"
+#include "open_file.h"
+
+/** @return List of the file, directory entries are 32 bytes apart */
+static uint8_t get_bucket(uint32_t pos_entry)
+{
+    return (pos_entry / sizeof(struct dir_entry)) & (FAT16_OPEN_FILE_BUCKET_COUNT - 1);
+}
+
+/** @return Index of the open file, INVALID_HANDLE if the file is not open */
+static uint8_t find_open_file(struct open_file_table *table, uint32_t pos_entry)
+{
+    uint8_t i = table->buckets[get_bucket(pos_entry)];
+
+    while (i != INVALID_HANDLE && table->files[i].pos_entry != pos_entry)
+        i = table->files[i].next;
+
+    return i;
+}
+
+void init_open_files(struct fat16_volume *vol)
+{
+    struct open_file_table *table = &vol->open_files;
+    uint8_t i;
+
+    /* Lowest handles are given first */
+    for (i = 0; i < HANDLE_COUNT; ++i) {
+        table->free_handles[i] = HANDLE_COUNT - 1 - i;
+        table->free_files[i] = HANDLE_COUNT - 1 - i;
+        vol->handles[i].mode = 0;
+    }
+    table->free_handle_count = HANDLE_COUNT;
+    table->free_file_count = HANDLE_COUNT;
+
+    for (i = 0; i < FAT16_OPEN_FILE_BUCKET_COUNT; ++i)
+        table->buckets[i] = INVALID_HANDLE;
+}
+
+bool has_free_handle(struct fat16_volume *vol)
+{
+    return vol->open_files.free_handle_count > 0;
+}
+
+uint8_t count_open_handles(struct fat16_volume *vol)
+{
+    return HANDLE_COUNT - vol->open_files.free_handle_count;
+}
+
+bool can_open_file(struct fat16_volume *vol, uint32_t pos_entry, char mode)
+{
+    struct open_file_table *table = &vol->open_files;
+    uint8_t i = find_open_file(table, pos_entry);
+
+    if (i == INVALID_HANDLE)
+        return true;
+
+    if (mode == 'r')
+        return table->files[i].writer_count == 0;
+
+    return false;
+}
+
+int add_handle(struct fat16_volume *vol, const struct entry_handle *handle)
+{
+    struct open_file_table *table = &vol->open_files;
+    uint8_t i, h;
+
+    if (!has_free_handle(vol)) {
+        FAT16DBG("FAT16: No available handle found.\n");
+        return -1;
+    }
+
+    if (!can_open_file(vol, handle->pos_entry, handle->mode)) {
+        FAT16DBG("FAT16: File is already open.\n");
+        return -1;
+    }
+
+    /* There are as many slots of open files as handles */
+    i = find_open_file(table, handle->pos_entry);
+    if (i == INVALID_HANDLE) {
+        uint8_t bucket = get_bucket(handle->pos_entry);
+
+        i = table->free_files[--table->free_file_count];
+        table->files[i].pos_entry = handle->pos_entry;
+        table->files[i].reader_count = 0;
+        table->files[i].writer_count = 0;
+        table->files[i].next = table->buckets[bucket];
+        table->buckets[bucket] = i;
+    }
+
+    if (handle->mode == 'r')
+        ++table->files[i].reader_count;
+    else
+        ++table->files[i].writer_count;
+
+    h = table->free_handles[--table->free_handle_count];
+    vol->handles[h] = *handle;
+    vol->handles[h].file = i;
+
+    return h;
+}
+
+void remove_handle(struct fat16_volume *vol, uint8_t handle)
+{
+    struct open_file_table *table = &vol->open_files;
+    uint8_t i = vol->handles[handle].file;
+    struct open_file *file = &table->files[i];
+
+    if (vol->handles[handle].mode == 'r')
+        --file->reader_count;
+    else
+        --file->writer_count;
+    vol->handles[handle].mode = 0;
+    table->free_handles[table->free_handle_count++] = handle;
+
+    if (file->reader_count > 0 || file->writer_count > 0)
+        return;
+
+    /* Unlink the file from its list */
+    {
+        uint8_t *link = &table->buckets[get_bucket(file->pos_entry)];
+
+        while (*link != i)
+            link = &table->files[*link].next;
+        *link = file->next;
+    }
+    table->free_files[table->free_file_count++] = i;
+}
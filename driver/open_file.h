@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __FAT16_OPEN_FILE_H__
+#define __FAT16_OPEN_FILE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fat16.h"
+
+/*
+ * Number of handles of each volume, which is the maximum number of files
+ * open at the same time. Handles are returned as uint8_t and 255 is not a
+ * valid handle.
+ */
+#ifndef FAT16_HANDLE_COUNT
+#define FAT16_HANDLE_COUNT              (16)
+#endif
+
+/*
+ * Number of lists in the hash table of open files, must be a power of 2.
+ * Finding an open file costs the length of its list.
+ */
+#ifndef FAT16_OPEN_FILE_BUCKET_COUNT
+#define FAT16_OPEN_FILE_BUCKET_COUNT    (16)
+#endif
+
+#if FAT16_HANDLE_COUNT < 1 || FAT16_HANDLE_COUNT > 254
+#error "FAT16_HANDLE_COUNT must be between 1 and 254"
+#endif
+
+#if FAT16_OPEN_FILE_BUCKET_COUNT < 1 || (FAT16_OPEN_FILE_BUCKET_COUNT & (FAT16_OPEN_FILE_BUCKET_COUNT - 1)) != 0
+#error "FAT16_OPEN_FILE_BUCKET_COUNT must be a power of 2"
+#endif
+
+#define HANDLE_COUNT        (FAT16_HANDLE_COUNT)
+#define INVALID_HANDLE      (255)
+
+struct entry_handle;
+
+/*
+ * A file opened by one or several handles. Files are found by the position
+ * of their directory entry, which cannot change while they are open.
+ */
+struct open_file {
+    uint32_t    pos_entry;          /**< Absolute position of file entry in its directory */
+    uint8_t     reader_count;       /**< Number of handles in read mode */
+    uint8_t     writer_count;       /**< Number of handles in write or append mode, at most 1 */
+    uint8_t     next;               /**< Next file in the same list, INVALID_HANDLE at the end */
+};
+
+/*
+ * Available handles and slots of open files are kept in stacks, so that
+ * opening and closing a file does not depend on the number of handles.
+ */
+struct open_file_table {
+    uint8_t             free_handles[HANDLE_COUNT];
+    uint8_t             free_handle_count;
+    struct open_file    files[HANDLE_COUNT];
+    uint8_t             free_files[HANDLE_COUNT];
+    uint8_t             free_file_count;
+    uint8_t             buckets[FAT16_OPEN_FILE_BUCKET_COUNT];  /**< First file of each list */
+};
+
+/**
+ * @brief Mark all handles of a volume as available
+ *
+ * @param[in] vol
+ */
+void init_open_files(struct fat16_volume *vol);
+
+/**
+ * @param[in] vol
+ * @return True if a file can be opened
+ */
+bool has_free_handle(struct fat16_volume *vol);
+
+/**
+ * @param[in] vol
+ * @return Number of handles in use
+ */
+uint8_t count_open_handles(struct fat16_volume *vol);
+
+/**
+ * @brief Check if a file can be opened in a mode
+ *
+ * A file can be opened by several handles in read mode, or by a single
+ * handle in write or append mode.
+ *
+ * @param[in] vol
+ * @param[in] pos_entry Position of the directory entry of the file
+ * @param[in] mode
+ * @return True if the file is not open in a conflicting mode
+ */
+bool can_open_file(struct fat16_volume *vol, uint32_t pos_entry, char mode);
+
+/**
+ * @brief Give a handle to an open file
+ *
+ * @param[in] vol
+ * @param[in] handle Opened file, its mode and pos_entry are used
+ * @return Handle, -1 if none is available or if the file is open in a conflicting mode
+ */
+int add_handle(struct fat16_volume *vol, const struct entry_handle *handle);
+
+/**
+ * @brief Make a handle available again
+ *
+ * @param[in] vol
+ * @param[in] handle Must be in use
+ */
+void remove_handle(struct fat16_volume *vol, uint8_t handle);
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "fat16_priv.h"
+#include "lock.h"
+#include "path_cache.h"
+
+#if FAT16_PATH_CACHE_COUNT > 0
+
+void path_cache_init(struct fat16_volume *vol)
+{
+    memset(&vol->path_cache, 0, sizeof(vol->path_cache));
+}
+
+uint16_t path_cache_find(struct fat16_volume *vol, struct entry_handle *handle, const char *path)
+{
+    struct path_cache_entry *best = NULL;
+    uint8_t i;
+    uint16_t length = 0;
+
+    lock_cache(vol);
+    for (i = 0; i < FAT16_PATH_CACHE_COUNT; ++i) {
+        struct path_cache_entry *e = &vol->path_cache.entries[i];
+
+        /* The rest of the path must start with a slash */
+        if (e->is_valid
+        &&  e->length > length
+        &&  strncmp(e->path, path, e->length) == 0
+        &&  path[e->length] == '/') {
+            best = e;
+            length = e->length;
+        }
+    }
+
+    if (best != NULL) {
+        best->last_use = ++vol->path_cache.use_counter;
+
+        /* Same handle as the one given by open_directory_in_subdir */
+        handle->mode = 'r';
+        handle->pos_entry = best->pos_entry;
+        handle->cluster = best->starting_cluster;
+        handle->offset = 0;
+        handle->size = 0;
+        handle->entry_size = 0;
+        handle->starting_cluster = best->starting_cluster;
+        handle->position = 0;
+        handle->extents = NULL;
+        handle->readahead = NULL;
+        handle->has_reserved_clusters = false;
+    }
+    unlock_cache(vol);
+
+    return length;
+}
+
+void path_cache_add(struct fat16_volume *vol, const struct entry_handle *handle, const char *path, uint16_t length)
+{
+    struct path_cache_entry *e = &vol->path_cache.entries[0];
+    uint8_t i;
+
+    if (length >= FAT16_PATH_CACHE_LENGTH)
+        return;
+
+    lock_cache(vol);
+    for (i = 1; i < FAT16_PATH_CACHE_COUNT && e->is_valid; ++i) {
+        struct path_cache_entry *candidate = &vol->path_cache.entries[i];
+        if (!candidate->is_valid || candidate->last_use < e->last_use)
+            e = candidate;
+    }
+
+    e->is_valid = true;
+    memcpy(e->path, path, length);
+    e->path[length] = '\0';
+    e->length = length;
+    e->pos_entry = handle->pos_entry;
+    e->starting_cluster = handle->starting_cluster;
+    e->last_use = ++vol->path_cache.use_counter;
+    unlock_cache(vol);
+}
+
+void path_cache_remove(struct fat16_volume *vol, uint16_t starting_cluster)
+{
+    uint8_t i;
+
+    lock_cache(vol);
+    for (i = 0; i < FAT16_PATH_CACHE_COUNT; ++i) {
+        if (vol->path_cache.entries[i].starting_cluster == starting_cluster)
+            vol->path_cache.entries[i].is_valid = false;
+    }
+    unlock_cache(vol);
+}
+
+#else
+
+void path_cache_init(struct fat16_volume *vol)
+{
+    (void)vol;
+}
+
+uint16_t path_cache_find(struct fat16_volume *vol, struct entry_handle *handle, const char *path)
+{
+    (void)vol;
+    (void)handle;
+    (void)path;
+    return 0;
+}
+
+void path_cache_add(struct fat16_volume *vol, const struct entry_handle *handle, const char *path, uint16_t length)
+{
+    (void)vol;
+    (void)handle;
+    (void)path;
+    (void)length;
+}
+
+void path_cache_remove(struct fat16_volume *vol, uint16_t starting_cluster)
+{
+    (void)vol;
+    (void)starting_cluster;
+}
+
+#endif
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FAT16_PATH_CACHE_H__
+#define __FAT16_PATH_CACHE_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "fat16.h"
+
+/*
+ * Number of directories remembered by each volume with their path. Opening
+ * a file in one of them, or in one of their subdirectories, does not walk
+ * the path from the root directory. Set it to 0 to disable the cache.
+ */
+#ifndef FAT16_PATH_CACHE_COUNT
+#define FAT16_PATH_CACHE_COUNT          (4)
+#endif
+
+/* Length of the longest directory path which can be remembered */
+#ifndef FAT16_PATH_CACHE_LENGTH
+#define FAT16_PATH_CACHE_LENGTH         (64)
+#endif
+
+#if FAT16_PATH_CACHE_COUNT > 255
+#error "FAT16_PATH_CACHE_COUNT must not be greater than 255"
+#endif
+
+struct entry_handle;
+
+/*
+ * Directory found by walking a path. Directories do not move, so an entry
+ * stays valid until the directory is deleted.
+ */
+struct path_cache_entry {
+    bool        is_valid;
+    char        path[FAT16_PATH_CACHE_LENGTH];  /**< Path of the directory, without trailing slash */
+    uint16_t    length;                         /**< Number of characters in path */
+    uint32_t    pos_entry;                      /**< Absolute position of the directory entry */
+    uint16_t    starting_cluster;               /**< First cluster of the directory */
+    uint32_t    last_use;                       /**< Value of use_counter when the entry was last found */
+};
+
+struct path_cache {
+#if FAT16_PATH_CACHE_COUNT > 0
+    struct path_cache_entry entries[FAT16_PATH_CACHE_COUNT];
+#endif
+    uint32_t                use_counter;
+};
+
+/**
+ * @brief Forget all directories of a volume
+ *
+ * @param[in] vol
+ */
+void path_cache_init(struct fat16_volume *vol);
+
+/**
+ * @brief Find the deepest directory of a path which has already been walked
+ *
+ * @param[in] vol
+ * @param[out] handle Set to the directory if one is found
+ * @param[in] path
+ * @return Number of characters of the path leading to the directory, 0 if none is found
+ */
+uint16_t path_cache_find(struct fat16_volume *vol, struct entry_handle *handle, const char *path);
+
+/**
+ * @brief Remember a directory found by walking a path
+ *
+ * The directory which has not been found for the longest time is replaced.
+ * Paths which are too long are not remembered.
+ *
+ * @param[in] vol
+ * @param[in] handle Directory
+ * @param[in] path
+ * @param[in] length Number of characters of the path leading to the directory
+ */
+void path_cache_add(struct fat16_volume *vol, const struct entry_handle *handle, const char *path, uint16_t length);
+
+/**
+ * @brief Forget a directory
+ *
+ * It must be called when a directory is deleted.
+ *
+ * @param[in] vol
+ * @param[in] starting_cluster First cluster of the directory
+ */
+void path_cache_remove(struct fat16_volume *vol, uint16_t starting_cluster);
+
+#endif
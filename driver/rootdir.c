@@ -21,32 +21,27 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
+#include "blockdev.h"
 #include "debug.h"
 #include "fat16.h"
 #include "fat16_priv.h"
 #include "rootdir.h"
 
-extern struct storage_dev_t dev;
-extern struct fat16_layout layout;
-extern struct fat16_bpb bpb;
-
-static int find_available_entry_in_root_directory(uint16_t *entry_index)
+static int find_available_entry_in_root_directory(struct fat16_volume *vol, uint32_t *entry_pos)
 {
     uint16_t i = 0;
-    uint32_t pos = move_to_root_directory_region(0);
 
     do {
         uint8_t tmp;
-        dev.read(&tmp, sizeof(tmp));
+        if (dev_read(vol, get_root_entry_pos(vol, i), &tmp, sizeof(tmp)) < 0)
+            return -1;
 
         if (tmp == 0 || tmp == AVAILABLE_DIR_ENTRY) {
-            *entry_index = i;
+            *entry_pos = get_root_entry_pos(vol, i);
             return 0;
         }
         ++i;
-        pos += 32;
-        dev.seek(pos);
-    } while (i < bpb.root_entry_count);
+    } while (i < vol->bpb.root_entry_count);
 
     return -1;
 }
@@ -54,79 +49,93 @@ static int find_available_entry_in_root_directory(uint16_t *entry_index)
 /**
  * @brief Check if the entry is the last entry in the root directory.
  *
- * @param[in] entry_index
+ * @param[in] vol
+ * @param[in] entry_pos Absolute position of the entry
  * @return True if the entry is the last one.
  */
-static bool last_entry_in_root_directory(uint16_t entry_index)
+static bool last_entry_in_root_directory(struct fat16_volume *vol, uint32_t entry_pos)
 {
     uint8_t tmp = 0;
 
-    if (entry_index == (bpb.root_entry_count - 1))
+    if (entry_pos == get_root_entry_pos(vol, vol->bpb.root_entry_count - 1))
         return true;
 
     /* Check if the next entry is marked as being the end of the
      * root directory list.
      */
-    move_to_root_directory_region(entry_index + 1);
-    dev.read(&tmp, sizeof(tmp));
+    dev_read(vol, entry_pos + sizeof(struct dir_entry), &tmp, sizeof(tmp));
     return tmp == 0;
 }
 
-static void mark_root_entry_as_available(uint16_t entry_index)
+static void mark_root_entry_as_available(struct fat16_volume *vol, uint32_t entry_pos)
 {
     struct dir_entry entry;
     memset(&entry, 0, sizeof(entry));
 
-    if (!last_entry_in_root_directory(entry_index))
+    if (!last_entry_in_root_directory(vol, entry_pos))
         entry.name[0] = AVAILABLE_DIR_ENTRY;
 
-    move_to_root_directory_region(entry_index);
-    dev.write(&entry, sizeof(entry));
+    dev_write(vol, entry_pos, &entry, sizeof(entry), ENTRY_SECTOR);
 }
 
-static int find_root_directory_entry(uint16_t *entry_index, char *name)
+/**
+ * @brief Find an entry in the root directory
+ *
+ * The directory is only read if the name is not in the dentry cache.
+ *
+ * @param[in] vol
+ * @param[out] entry
+ * @param[out] entry_pos Absolute position of the entry
+ * @param[in] name 8.3 short name
+ * @return 0 if an entry with this name has been found, -1 otherwise
+ */
+static int find_root_directory_entry(struct fat16_volume *vol, struct dir_entry *entry, uint32_t *entry_pos, char *name)
 {
     uint16_t i = 0;
+    bool exists;
 
-    move_to_root_directory_region(0);
-    for (i = 0; i < bpb.root_entry_count; ++i) {
-        struct dir_entry e;
-        dev.read(&e, sizeof(struct dir_entry));
-        dump_dir_entry(e);
+    if (dentry_lookup(vol, ROOT_DIR_CLUSTER, name, entry, entry_pos, &exists))
+        return exists ? 0 : -1;
+
+    for (i = 0; i < vol->bpb.root_entry_count; ++i) {
+        if (dev_read(vol, get_root_entry_pos(vol, i), entry, sizeof(struct dir_entry)) < 0)
+            return -1;
+        dump_dir_entry(*entry);
 
         /* Skip available entry */
-        if ((uint8_t)(e.name[0]) == AVAILABLE_DIR_ENTRY)
+        if ((uint8_t)(entry->name[0]) == AVAILABLE_DIR_ENTRY)
             continue;
 
         /* Do not allow filename to start with a NULL character */
-        if (e.name[0] == 0)
+        if (entry->name[0] == 0)
             break;
 
         /* Ignore any VFAT entry */
-        if ((e.attribute & VFAT_DIR_ENTRY) == VFAT_DIR_ENTRY)
+        if ((entry->attribute & VFAT_DIR_ENTRY) == VFAT_DIR_ENTRY)
             continue;
 
-        if (memcmp(name, e.name, sizeof(e.name)) == 0) {
-            *entry_index = i;
+        if (memcmp(name, entry->name, sizeof(entry->name)) == 0) {
+            *entry_pos = get_root_entry_pos(vol, i);
+            dentry_add(vol, ROOT_DIR_CLUSTER, entry, *entry_pos);
             return 0;
         }
     }
 
+    dentry_add_missing(vol, ROOT_DIR_CLUSTER, name);
     FAT16DBG("FAT16: File %s not found.\n", name);
     return -1;
 }
 
-static int create_entry_in_root(char *name, uint8_t attribute)
+static int create_entry_in_root(struct fat16_volume *vol, uint32_t *entry_pos, char *name, uint8_t attribute)
 {
-    uint16_t entry_index;
     struct dir_entry entry;
 
     /* Do not allow muliple entries with same name */
-    if (find_root_directory_entry(&entry_index, name) == 0)
+    if (find_root_directory_entry(vol, &entry, entry_pos, name) == 0)
         return -1;
 
     /* Find a location in the root directory region */
-    if (find_available_entry_in_root_directory(&entry_index) < 0)
+    if (find_available_entry_in_root_directory(vol, entry_pos) < 0)
         return -1;
 
     memcpy(entry.name, name, sizeof(entry.name));
@@ -137,40 +146,37 @@ static int create_entry_in_root(char *name, uint8_t attribute)
     entry.starting_cluster = 0;
     entry.size = 0;
 
-    move_to_root_directory_region(entry_index);
-    dev.write(&entry, sizeof(struct dir_entry));
+    if (dev_write(vol, *entry_pos, &entry, sizeof(struct dir_entry), ENTRY_SECTOR) < 0)
+        return -1;
+
+    dentry_add(vol, ROOT_DIR_CLUSTER, &entry, *entry_pos);
     return 0;
 }
 
-int create_file_in_root(char *filename)
+int create_file_in_root(struct fat16_volume *vol, char *filename)
 {
-    return create_entry_in_root(filename, 0);
+    uint32_t entry_pos;
+
+    return create_entry_in_root(vol, &entry_pos, filename, 0);
 }
 
-int create_directory_in_root(char *dirname)
+int create_directory_in_root(struct fat16_volume *vol, char *dirname)
 {
-    struct dir_entry entry;
-    uint16_t entry_index;
+    uint32_t entry_pos;
+    uint16_t starting_cluster;
     uint32_t pos;
 
-    if (create_entry_in_root(dirname, SUBDIR) < 0)
+    if (create_entry_in_root(vol, &entry_pos, dirname, SUBDIR) < 0)
         return -1;
 
-    if (find_root_directory_entry(&entry_index, dirname) < 0)
+    if (allocate_cluster(vol, &starting_cluster, 0) < 0)
         return -1;
 
-    pos = move_to_root_directory_region(entry_index);
-    dev.read(&entry, sizeof(entry));
+    pos = entry_pos + offsetof(struct dir_entry, starting_cluster);
+    dev_write(vol, pos, &starting_cluster, sizeof(starting_cluster), ENTRY_SECTOR);
+    dentry_update(vol, entry_pos, starting_cluster, 0);
 
-    if (allocate_cluster(&entry.starting_cluster, 0) < 0)
-        return -1;
-
-    pos += offsetof(struct dir_entry, starting_cluster);
-    dev.seek(pos);
-    dev.write(&entry.starting_cluster, sizeof(entry.starting_cluster));
-
-
-    move_to_data_region(entry.starting_cluster, 0);
+    pos = get_data_pos(vol, starting_cluster, 0);
     /* Create "." entry */
     {
         struct dir_entry e;
@@ -179,8 +185,8 @@ int create_directory_in_root(char *dirname)
         e.name[0] = '.';
         memset(&e.name[1], ' ', sizeof(e.name) - 1);
         e.attribute = SUBDIR;
-        e.starting_cluster = entry.starting_cluster;
-        dev.write(&e, sizeof(e));
+        e.starting_cluster = starting_cluster;
+        dev_write(vol, pos, &e, sizeof(e), ENTRY_SECTOR);
     }
 
     /* Create ".." entry */
@@ -192,30 +198,26 @@ int create_directory_in_root(char *dirname)
         e.name[1] = '.';
         memset(&e.name[2], ' ', sizeof(e.name) - 2);
         e.attribute = SUBDIR;
-        dev.write(&e, sizeof(e));
+        dev_write(vol, pos + sizeof(e), &e, sizeof(e), ENTRY_SECTOR);
     }
 
     /* Add dummy entry to indicate end of entry list */
     {
         struct dir_entry e;
         memset(&e, 0, sizeof(e));
-        dev.write(&e, sizeof(e));
+        dev_write(vol, pos + 2 * sizeof(e), &e, sizeof(e), ENTRY_SECTOR);
     }
 
     return 0;
 }
 
-static int open_entry_in_root(struct entry_handle *handle, char *name, char mode, bool is_file)
+static int open_entry_in_root(struct fat16_volume *vol, struct entry_handle *handle, char *name, char mode, bool is_file)
 {
-    uint16_t entry_index;
     struct dir_entry entry;
 
-    if (find_root_directory_entry(&entry_index, name) < 0)
+    if (find_root_directory_entry(vol, &entry, &handle->pos_entry, name) < 0)
         return -1;
 
-    handle->pos_entry = move_to_root_directory_region(entry_index);
-    dev.read(&entry, sizeof(struct dir_entry));
-
     /* Check that we are opening a file and not something else */
     if (entry.attribute & VOLUME)
         return -1;
@@ -227,55 +229,45 @@ static int open_entry_in_root(struct entry_handle *handle, char *name, char mode
 
     handle->mode = mode;
 
+    handle->cluster = entry.starting_cluster;
+    handle->offset = 0;
+    handle->size = entry.size;
+    handle->entry_size = entry.size;
+    handle->starting_cluster = entry.starting_cluster;
+    handle->position = 0;
+    handle->extents = NULL;
+    handle->readahead = NULL;
+    handle->has_reserved_clusters = false;
+
     /*
      * In append mode, set the current position at the end of the file.
      * Otherwise, let's start at the beginning.
      */
-    if (mode == 'a') {
-        handle->cluster = entry.starting_cluster;
-        uint32_t offset = entry.size;
-        uint16_t next_cluster;
-        get_next_cluster(&next_cluster, handle->cluster);
-        while (next_cluster < 0xFFF8) {
-            handle->cluster = next_cluster;
-            offset -= bpb.sectors_per_cluster * bpb.bytes_per_sector;
-            get_next_cluster(&next_cluster, handle->cluster);
-        }
-        handle->offset = (uint16_t)offset;
-    } else {
-        handle->cluster = entry.starting_cluster;
-        handle->offset = 0;
-    }
-    if (mode == 'r')
-        handle->remaining_bytes = entry.size;
-    else
-        handle->remaining_bytes = 0;
+    if (mode == 'a')
+        return move_handle(vol, handle, entry.size);
 
     return 0;
 }
 
-int open_file_in_root(struct entry_handle *handle, char *filename, char mode)
+int open_file_in_root(struct fat16_volume *vol, struct entry_handle *handle, char *filename, char mode)
 {
-    return open_entry_in_root(handle, filename, mode, true);
+    return open_entry_in_root(vol, handle, filename, mode, true);
 }
 
-int open_directory_in_root(struct entry_handle *handle, char *dirname)
+int open_directory_in_root(struct fat16_volume *vol, struct entry_handle *handle, char *dirname)
 {
-    return open_entry_in_root(handle, dirname, 'r', false);
+    return open_entry_in_root(vol, handle, dirname, 'r', false);
 }
 
-static int delete_entry_in_root(char *name, bool is_file)
+static int delete_entry_in_root(struct fat16_volume *vol, char *name, bool is_file)
 {
-    uint16_t entry_index = 0;
+    uint32_t entry_pos;
     struct dir_entry entry;
 
     /* Find the entry in the root directory */
-    if (find_root_directory_entry(&entry_index, name) < 0)
+    if (find_root_directory_entry(vol, &entry, &entry_pos, name) < 0)
         return -1;
 
-    move_to_root_directory_region(entry_index);
-    dev.read(&entry, sizeof(entry));
-
     /* Check that we are deleting an entry of the right type */
     if (entry.attribute & VOLUME)
         return -1;
@@ -283,34 +275,33 @@ static int delete_entry_in_root(char *name, bool is_file)
     ||  (!is_file && !(entry.attribute & SUBDIR)))
         return -1;
 
-    mark_root_entry_as_available(entry_index);
-    free_cluster_chain(entry.starting_cluster);
-
-    return 0;
+    mark_root_entry_as_available(vol, entry_pos);
+    dentry_add_missing(vol, ROOT_DIR_CLUSTER, name);
+    return free_cluster_chain(vol, entry.starting_cluster);
 }
 
-int delete_file_in_root(char *filename)
+int delete_file_in_root(struct fat16_volume *vol, char *filename)
 {
-    return delete_entry_in_root(filename, true);
+    return delete_entry_in_root(vol, filename, true);
 }
 
-int delete_directory_in_root(char *dirname)
+int delete_directory_in_root(struct fat16_volume *vol, char *dirname)
 {
-    return delete_entry_in_root(dirname, false);
+    return delete_entry_in_root(vol, dirname, false);
 }
 
-int ls_in_root(uint32_t *index, char *filename)
+int ls_in_root(struct fat16_volume *vol, uint32_t *index, char *filename)
 {
     struct dir_entry entry;
 
-    if (*index == bpb.root_entry_count)
+    if (*index == vol->bpb.root_entry_count)
         return 0;
-    else if (*index > bpb.root_entry_count)
+    else if (*index > vol->bpb.root_entry_count)
         return -1;
 
-    move_to_root_directory_region(*index);
+    if (dev_read(vol, get_root_entry_pos(vol, *index), &entry, sizeof(entry)) < 0)
+        return -1;
 
-    dev.read(&entry, sizeof(entry));
     if (entry.name[0] == 0)
         return 0;
 
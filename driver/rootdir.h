@@ -24,39 +24,43 @@
 /**
  * @brief Create a file in the root directory
  *
+ * @param[in] vol
  * @param[in] filename 8.3 short name
  * @retval -1 if there is no available entry in the root directory,
  * @reval 0 if successful
  */
-int create_file_in_root(char *filename);
+int create_file_in_root(struct fat16_volume *vol, char *filename);
 
 /**
  * @brief Create a directory in the root directory
  *
+ * @param[in] vol
  * @param[in] dirname 8.3 short name
  * @retval -1 if there is no available entry in the root directory,
  * @reval 0 if successful
  */
-int create_directory_in_root(char *dirname);
+int create_directory_in_root(struct fat16_volume *vol, char *dirname);
 
 /**
  * @brief Open a file located in the root directory
  *
+ * @param[in] vol
  * @param[out] handle
  * @param[in] filename 8.3 short name
  * @param[in] mode
  * @return 0 if successful, -1 otherwise
  */
-int open_file_in_root(struct entry_handle *handle, char *filename, char mode);
+int open_file_in_root(struct fat16_volume *vol, struct entry_handle *handle, char *filename, char mode);
 
 /**
  * @brief Open a directory located in the root directory
  *
+ * @param[in] vol
  * @param[out] handle
  * @param[in] dirname 8.3 short name
  * @return 0 if successful, -1 otherwise
  */
-int open_directory_in_root(struct entry_handle *handle, char *dirname);
+int open_directory_in_root(struct fat16_volume *vol, struct entry_handle *handle, char *dirname);
 
 /**
  * @brief Delete a file.
@@ -64,19 +68,21 @@ int open_directory_in_root(struct entry_handle *handle, char *dirname);
  * Remove the entry from the and mark all clusters used by this file as
  * available. It does not clear the data region.
  *
+ * @param[in] vol
  * @param[in] filename 8.3 short name
  * @return 0 if successful, -1 otherwise
  */
-int delete_file_in_root(char *filename);
+int delete_file_in_root(struct fat16_volume *vol, char *filename);
 
 /**
  * @brief Delete a directory
  *
+ * @param[in] vol
  * @param dirname 8.3 short name
  * @return 0 if successful, -1 otherwise
  */
-int delete_directory_in_root(char *dirname);
+int delete_directory_in_root(struct fat16_volume *vol, char *dirname);
 
-int ls_in_root(uint32_t *index, char *filename);
+int ls_in_root(struct fat16_volume *vol, uint32_t *index, char *filename);
 
 #endif
@@ -19,42 +19,39 @@
 
 
 #include <string.h>
+#include "blockdev.h"
 #include "fat16.h"
 #include "fat16_priv.h"
 #include "subdir.h"
 
-extern struct storage_dev_t dev;
-extern struct fat16_layout layout;
-extern struct fat16_bpb bpb;
-
 /**
  * @brief Read an entry from subdir
  *
  * This functions modifies cluster/offset of the handle
  *
+ * @param[in] vol
  * @param[out] entry
  * @param[in|out] handle
  * @return 0 if successful, -1 otherwise
  */
-static int read_entry_from_subdir(struct dir_entry *entry, struct entry_handle *handle)
+static int read_entry_from_subdir(struct fat16_volume *vol, struct dir_entry *entry, struct entry_handle *handle)
 {
     /*
     * Check if we reach end of cluster.
     * We assume that cluster size is a multiple of dir_entry size
     */
-    if (handle->offset == bpb.sectors_per_cluster * bpb.bytes_per_sector) {
+    if (handle->offset == vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector) {
         uint16_t next_cluster;
-        get_next_cluster(&next_cluster, handle->cluster);
+        get_next_cluster(vol, &next_cluster, handle->cluster);
         if (next_cluster >= 0xFFF8)
             return -1;
 
-        move_to_data_region(next_cluster, 0);
         handle->cluster = next_cluster;
         handle->offset = 0;
     }
 
-    move_to_data_region(handle->cluster, handle->offset);
-    dev.read(entry, sizeof(struct dir_entry));
+    if (dev_read(vol, get_data_pos(vol, handle->cluster, handle->offset), entry, sizeof(struct dir_entry)) < 0)
+        return -1;
     handle->offset += sizeof(struct dir_entry);
     return 0;
 }
@@ -62,26 +59,39 @@ static int read_entry_from_subdir(struct dir_entry *entry, struct entry_handle *
 /**
  * @brief Find an entry in the subdirectory
  *
+ * The directory is only read if the name is not in the dentry cache.
+ *
+ * @param[in] vol
  * @param[out] entry
  * @param[out] entry_pos Absolute position of the entry
  * @param[in] handle Directory handle
  * @param[in] name 8.3 short name
  * @return 0 if an entry with this name has been found, -1 otherwise
  */
-static int find_entry_in_subdir(struct dir_entry *entry, uint32_t *entry_pos, struct entry_handle *handle, char *name)
+static int find_entry_in_subdir(struct fat16_volume *vol, struct dir_entry *entry, uint32_t *entry_pos, struct entry_handle *handle, char *name)
 {
     int ret = -1;
     uint32_t starting_cluster = handle->cluster;
+    uint32_t pos;
+    bool exists;
+
+    if (entry_pos == NULL)
+        entry_pos = &pos;
+
+    if (dentry_lookup(vol, starting_cluster, name, entry, entry_pos, &exists))
+        return exists ? 0 : -1;
 
-    while (read_entry_from_subdir(entry, handle) == 0) {
+    while (read_entry_from_subdir(vol, entry, handle) == 0) {
 
         /* Skip available entry */
         if ((uint8_t)(entry->name[0]) == AVAILABLE_DIR_ENTRY)
             continue;
 
         /* Check if we reached end of entry list */
-        if (entry->name[0] == 0)
+        if (entry->name[0] == 0) {
+            dentry_add_missing(vol, starting_cluster, name);
             break;
+        }
 
         /* Ignore any VFAT entry */
         if ((entry->attribute & VFAT_DIR_ENTRY) == VFAT_DIR_ENTRY)
@@ -93,9 +103,10 @@ static int find_entry_in_subdir(struct dir_entry *entry, uint32_t *entry_pos, st
         }
     }
 
-    if (ret == 0 && entry_pos != NULL) {
-        *entry_pos = move_to_data_region(handle->cluster, handle->offset);
+    if (ret == 0) {
+        *entry_pos = get_data_pos(vol, handle->cluster, handle->offset);
         *entry_pos -= sizeof(struct dir_entry);
+        dentry_add(vol, starting_cluster, entry, *entry_pos);
     }
 
     /* Restore state of handle */
@@ -105,14 +116,14 @@ static int find_entry_in_subdir(struct dir_entry *entry, uint32_t *entry_pos, st
     return ret;
 }
 
-static int find_available_entry_in_subdir(uint32_t *entry_pos, struct entry_handle *handle)
+static int find_available_entry_in_subdir(struct fat16_volume *vol, uint32_t *entry_pos, struct entry_handle *handle)
 {
     int ret = -1;
     struct dir_entry entry;
     uint32_t starting_cluster = handle->cluster;
 
     /* Check if there is some space in the entry list */
-    while (read_entry_from_subdir(&entry, handle) == 0) {
+    while (read_entry_from_subdir(vol, &entry, handle) == 0) {
         if (entry.name[0] == 0 || (uint8_t)entry.name[0] == AVAILABLE_DIR_ENTRY) {
             ret = 0;
             break;
@@ -120,7 +131,7 @@ static int find_available_entry_in_subdir(uint32_t *entry_pos, struct entry_hand
     }
 
     if (ret == 0 && entry_pos != NULL) {
-        *entry_pos = move_to_data_region(handle->cluster, handle->offset);
+        *entry_pos = get_data_pos(vol, handle->cluster, handle->offset);
         *entry_pos -= sizeof(entry);
     }
 
@@ -131,16 +142,15 @@ static int find_available_entry_in_subdir(uint32_t *entry_pos, struct entry_hand
     if (ret == 0 && entry.name[0] == 0) {
         struct dir_entry dummy_entry;
 
-        if (handle->offset == bpb.sectors_per_cluster * bpb.bytes_per_sector) {
+        if (handle->offset == vol->bpb.sectors_per_cluster * vol->bpb.bytes_per_sector) {
             uint16_t new_cluster;
-            if (allocate_cluster(&new_cluster, handle->cluster) < 0)
+            if (allocate_cluster(vol, &new_cluster, handle->cluster) < 0)
                 return -1;
             handle->cluster = new_cluster;
             handle->offset = 0;
         }
-        move_to_data_region(handle->cluster, handle->offset);
         memset(&dummy_entry, 0, sizeof(dummy_entry));
-        dev.write(&dummy_entry, sizeof(dummy_entry));
+        dev_write(vol, get_data_pos(vol, handle->cluster, handle->offset), &dummy_entry, sizeof(dummy_entry), ENTRY_SECTOR);
     }
 
     /* Restore previous state of handle */
@@ -150,37 +160,35 @@ static int find_available_entry_in_subdir(uint32_t *entry_pos, struct entry_hand
     return ret;
 }
 
-static bool last_entry_in_subdir(uint32_t entry_pos)
+static bool last_entry_in_subdir(struct fat16_volume *vol, uint32_t entry_pos)
 {
     uint8_t tmp;
-    dev.seek(entry_pos + sizeof(struct dir_entry));
-    dev.read(&tmp, sizeof(tmp));
+    dev_read(vol, entry_pos + sizeof(struct dir_entry), &tmp, sizeof(tmp));
     return tmp == 0;
 }
 
-static void mark_entry_as_available(uint32_t entry_pos)
+static void mark_entry_as_available(struct fat16_volume *vol, uint32_t entry_pos)
 {
     struct dir_entry entry;
     memset(&entry, 0, sizeof(entry));
 
-    if (!last_entry_in_subdir(entry_pos))
+    if (!last_entry_in_subdir(vol, entry_pos))
         entry.name[0] = AVAILABLE_DIR_ENTRY;
 
-    dev.seek(entry_pos);
-    dev.write(&entry, sizeof(entry));
+    dev_write(vol, entry_pos, &entry, sizeof(entry), ENTRY_SECTOR);
 }
 
-int create_file_in_subdir(struct entry_handle *handle, char *filename)
+int create_file_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *filename)
 {
     struct dir_entry entry;
     uint32_t entry_pos;
 
     /* Do not allow muliple entries with same name */
-    if (find_entry_in_subdir(&entry, NULL, handle, filename) == 0)
+    if (find_entry_in_subdir(vol, &entry, NULL, handle, filename) == 0)
         return -1;
 
     /* Try to find an available entry in the current entry list */
-    if (find_available_entry_in_subdir(&entry_pos, handle) < 0)
+    if (find_available_entry_in_subdir(vol, &entry_pos, handle) < 0)
         return -1;
 
     memcpy(entry.name, filename, sizeof(entry.name));
@@ -190,24 +198,27 @@ int create_file_in_subdir(struct entry_handle *handle, char *filename)
     memset(entry.date, 0, sizeof(entry.date));
     entry.starting_cluster = 0;
     entry.size = 0;
-    dev.seek(entry_pos);
-    dev.write(&entry, sizeof(entry));
 
+    if (dev_write(vol, entry_pos, &entry, sizeof(entry), ENTRY_SECTOR) < 0)
+        return -1;
+
+    dentry_add(vol, handle->cluster, &entry, entry_pos);
     return 0;
 }
 
-int create_directory_in_subdir(struct entry_handle *handle, char *dirname)
+int create_directory_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *dirname)
 {
     struct dir_entry entry;
-    uint32_t entry_pos;
+    uint32_t entry_pos, pos;
+    uint16_t starting_cluster;
     uint32_t parent_dir_starting_cluster = handle->cluster;
 
     /* Do not allow muliple entries with same name */
-    if (find_entry_in_subdir(&entry, NULL, handle, dirname) == 0)
+    if (find_entry_in_subdir(vol, &entry, NULL, handle, dirname) == 0)
         return -1;
 
     /* Try to find an available entry in the current entry list */
-    if (find_available_entry_in_subdir(&entry_pos, handle) < 0)
+    if (find_available_entry_in_subdir(vol, &entry_pos, handle) < 0)
         return -1;
 
     memcpy(entry.name, dirname, sizeof(entry.name));
@@ -215,14 +226,15 @@ int create_directory_in_subdir(struct entry_handle *handle, char *dirname)
     memset(entry.reserved, 0, sizeof(entry.reserved));
     memset(entry.time, 0, sizeof(entry.time));
     memset(entry.date, 0, sizeof(entry.date));
-    if (allocate_cluster(&entry.starting_cluster, 0) < 0) {
+    if (allocate_cluster(vol, &starting_cluster, 0) < 0) {
         return -1;
     }
+    entry.starting_cluster = starting_cluster;
     entry.size = 0;
-    dev.seek(entry_pos);
-    dev.write(&entry, sizeof(entry));
+    dev_write(vol, entry_pos, &entry, sizeof(entry), ENTRY_SECTOR);
+    dentry_add(vol, parent_dir_starting_cluster, &entry, entry_pos);
 
-    move_to_data_region(entry.starting_cluster, 0);
+    pos = get_data_pos(vol, starting_cluster, 0);
 
     /* Create "."" entry */
     {
@@ -231,9 +243,9 @@ int create_directory_in_subdir(struct entry_handle *handle, char *dirname)
 
         e.name[0] = '.';
         memset(&e.name[1], ' ', sizeof(e.name) - 1);
-        e.starting_cluster = entry.starting_cluster;
+        e.starting_cluster = starting_cluster;
         e.attribute = SUBDIR;
-        dev.write(&e, sizeof(e));
+        dev_write(vol, pos, &e, sizeof(e), ENTRY_SECTOR);
     }
 
     /* Create ".."" entry */
@@ -247,25 +259,25 @@ int create_directory_in_subdir(struct entry_handle *handle, char *dirname)
         e.starting_cluster = parent_dir_starting_cluster;
         e.attribute = SUBDIR;
 
-        dev.write(&e, sizeof(e));
+        dev_write(vol, pos + sizeof(e), &e, sizeof(e), ENTRY_SECTOR);
     }
 
     /* Add dummy entry to indicate end of entry list */
     {
         struct dir_entry e;
         memset(&e, 0, sizeof(e));
-        dev.write(&e, sizeof(e));
+        dev_write(vol, pos + 2 * sizeof(e), &e, sizeof(e), ENTRY_SECTOR);
     }
 
     return 0;
 }
 
-static int open_entry_in_subdir(struct entry_handle *handle, char *name, char mode, bool is_file)
+static int open_entry_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *name, char mode, bool is_file)
 {
     struct dir_entry entry;
     uint32_t entry_pos;
 
-    if (find_entry_in_subdir(&entry, &entry_pos, handle, name) < 0)
+    if (find_entry_in_subdir(vol, &entry, &entry_pos, handle, name) < 0)
         return -1;
 
     /* Check that we are opening a file or directory and not something else */
@@ -281,50 +293,43 @@ static int open_entry_in_subdir(struct entry_handle *handle, char *name, char mo
     handle->mode = mode;
     handle->pos_entry = entry_pos;
 
+    handle->cluster = entry.starting_cluster;
+    handle->offset = 0;
+    handle->size = entry.size;
+    handle->entry_size = entry.size;
+    handle->starting_cluster = entry.starting_cluster;
+    handle->position = 0;
+    handle->extents = NULL;
+    handle->readahead = NULL;
+    handle->has_reserved_clusters = false;
+
     /*
      * In append mode, set the current position at the end of the file.
      * Otherwise, let's start at the beginning.
      */
-    if (mode == 'a') {
-        handle->cluster = entry.starting_cluster;
-        uint32_t offset = entry.size;
-        uint16_t next_cluster;
-        get_next_cluster(&next_cluster, handle->cluster);
-        while (next_cluster < 0xFFF8) {
-            handle->cluster = next_cluster;
-            offset -= bpb.sectors_per_cluster * bpb.bytes_per_sector;
-            get_next_cluster(&next_cluster, handle->cluster);
-        }
-        handle->offset = (uint16_t)offset;
-    } else {
-        handle->cluster = entry.starting_cluster;
-        handle->offset = 0;
-    }
-    if (mode == 'r')
-        handle->remaining_bytes = entry.size;
-    else
-        handle->remaining_bytes = 0;
+    if (mode == 'a')
+        return move_handle(vol, handle, entry.size);
 
     return 0;
 }
 
-int open_file_in_subdir(struct entry_handle *handle, char *filename, char mode)
+int open_file_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *filename, char mode)
 {
-    return open_entry_in_subdir(handle, filename, mode, true);
+    return open_entry_in_subdir(vol, handle, filename, mode, true);
 }
 
-int open_directory_in_subdir(struct entry_handle *handle, char *dirname)
+int open_directory_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *dirname)
 {
-    return open_entry_in_subdir(handle, dirname, 'r', false);
+    return open_entry_in_subdir(vol, handle, dirname, 'r', false);
 }
 
-static int delete_entry_in_subdir(struct entry_handle *handle, char *name, bool is_file)
+static int delete_entry_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *name, bool is_file)
 {
     struct dir_entry entry;
     uint32_t entry_pos;
 
     /* Find the entry in the directory */
-    if (find_entry_in_subdir(&entry, &entry_pos, handle, name) < 0)
+    if (find_entry_in_subdir(vol, &entry, &entry_pos, handle, name) < 0)
         return -1;
 
     /* Check that we are deleting an entry of the right type */
@@ -334,29 +339,28 @@ static int delete_entry_in_subdir(struct entry_handle *handle, char *name, bool
     ||  (!is_file && !(entry.attribute & SUBDIR)))
         return -1;
 
-    mark_entry_as_available(entry_pos);
-    free_cluster_chain(entry.starting_cluster);
-
-    return 0;
+    mark_entry_as_available(vol, entry_pos);
+    dentry_add_missing(vol, handle->cluster, name);
+    return free_cluster_chain(vol, entry.starting_cluster);
 }
 
-int delete_file_in_subdir(struct entry_handle *handle, char *filename)
+int delete_file_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *filename)
 {
-    return delete_entry_in_subdir(handle, filename, true);
+    return delete_entry_in_subdir(vol, handle, filename, true);
 }
 
-int delete_directory_in_subdir(struct entry_handle *handle, char *dirname)
+int delete_directory_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *dirname)
 {
-    return delete_entry_in_subdir(handle, dirname, false);
+    return delete_entry_in_subdir(vol, handle, dirname, false);
 }
 
-bool is_subdir_empty(struct entry_handle *handle)
+bool is_subdir_empty(struct fat16_volume *vol, struct entry_handle *handle)
 {
     struct dir_entry entry;
     uint32_t starting_cluster = handle->cluster;
     bool is_empty = true;
 
-    while (read_entry_from_subdir(&entry, handle) == 0) {
+    while (read_entry_from_subdir(vol, &entry, handle) == 0) {
 
         /* Ignore . and .. entries */
         if (entry.name[0] == '.' && entry.name[1] == ' ')
@@ -381,19 +385,19 @@ bool is_subdir_empty(struct entry_handle *handle)
     return is_empty;
 }
 
-int ls_in_subdir(uint32_t *index, char *name, struct entry_handle *handle)
+int ls_in_subdir(struct fat16_volume *vol, uint32_t *index, char *name, struct entry_handle *handle)
 {
     struct dir_entry entry;
     uint32_t entry_index = *index;
 
     while (entry_index) {
-        if (read_entry_from_subdir(&entry, handle) < 0)
+        if (read_entry_from_subdir(vol, &entry, handle) < 0)
             return -1;
 
         --entry_index;
     }
 
-    if (read_entry_from_subdir(&entry, handle) < 0)
+    if (read_entry_from_subdir(vol, &entry, handle) < 0)
         return -1;
 
     if (entry.name[0] == 0)
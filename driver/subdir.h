@@ -28,20 +28,22 @@
  *
  * No other entries with this name must exist.
  *
+ * @param[in] vol
  * @param[in|out] handle
  * @param[in] filename 8.3 short name
  * @return 0 if successful, -1 otherwise
  */
-int create_file_in_subdir(struct entry_handle *handle, char *filename);
+int create_file_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *filename);
 
 /**
  * @brief Create a directory in a subdirectory
  *
+ * @param[in] vol
  * @param[in|out] handle
  * @param[in] dirname 8.3 short name
  * @return 0 if successful, -1 otherwise
  */
-int create_directory_in_subdir(struct entry_handle *handle, char *dirname);
+int create_directory_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *dirname);
 
 /**
  * @brief Open a file in a subdirectory
@@ -49,12 +51,13 @@ int create_directory_in_subdir(struct entry_handle *handle, char *dirname);
  * No file will be created by this function. It must already exist in the
  * directory
  *
+ * @param[in] vol
  * @param[in|out] handle
  * @param[in] filename 8.3 short name
  * @param[in] mode
  * @return 0 if successful, -1 otherwise
  */
-int open_file_in_subdir(struct entry_handle *handle, char *filename, char mode);
+int open_file_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *filename, char mode);
 
 /**
  * @brief Open a directory in a subdirectory
@@ -62,42 +65,47 @@ int open_file_in_subdir(struct entry_handle *handle, char *filename, char mode);
  * No directory will be created by this function. It must already
  * exist in the directory
  *
+ * @param[in] vol
  * @param[in|out] handle
  * @param[in] dirname 8.3 short name
  * @return 0 if successful, -1 otherwise
  */
-int open_directory_in_subdir(struct entry_handle *handle, char *dirname);
+int open_directory_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *dirname);
 
 /**
  * @brief Delete a file in a subdirectory
  *
+ * @param[in] vol
  * @param[in] handle
  * @param[in] filename 8.3 short name
  * @return 0 if successful, -1 otherwise
  */
-int delete_file_in_subdir(struct entry_handle *handle, char *filename);
+int delete_file_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *filename);
 
 /**
  * @brief Delete a directory in a subdirectory
  *
+ * @param[in] vol
  * @param[in] handle
  * @param[in] dirname 8.3 short name
  * @return 0 if successful, -1 otherwise
  */
-int delete_directory_in_subdir(struct entry_handle *handle, char *dirname);
+int delete_directory_in_subdir(struct fat16_volume *vol, struct entry_handle *handle, char *dirname);
 
 /**
  * @brief Check a directory is empty
  *
+ * @param[in] vol
  * @param[in] handle
  * @return True if empty, False otherwise
  */
-bool is_subdir_empty(struct entry_handle *handle);
+bool is_subdir_empty(struct fat16_volume *vol, struct entry_handle *handle);
 
 /**
  * @brief
  *
  *
+ * @param[in] vol
  * @param[in|out] index
  * @param[out] name
  * @param[in] dirpath
@@ -105,6 +113,6 @@ bool is_subdir_empty(struct entry_handle *handle);
  * @retval 0
  * @retval -1
  */
-int ls_in_subdir(uint32_t *index, char *name, struct entry_handle *handle);
+int ls_in_subdir(struct fat16_volume *vol, uint32_t *index, char *name, struct entry_handle *handle);
 
 #endif
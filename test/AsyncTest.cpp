@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include "Common.hpp"
+#include "AsyncTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define FILE_SIZE       (20000)
+
+namespace {
+    void on_complete(int, int result, void *context)
+    {
+        *static_cast<int *>(context) = result;
+    }
+}
+
+AsyncTest::AsyncTest():
+Test("AsyncTest")
+{
+}
+
+void AsyncTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool AsyncTest::run()
+{
+    char content[FILE_SIZE];
+    char buffer[FILE_SIZE + 1];
+
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    for (unsigned int i = 0; i < FILE_SIZE; ++i)
+        content[i] = i % 251;
+
+    {
+        int fd = fat16_open("HELLO.TXT", 'w');
+        if (fd < 0)
+            return false;
+
+        int first_result = -2;
+        int first = fat16_write_async(fd, content, FILE_SIZE / 2, on_complete, &first_result);
+        int second = fat16_write_async(fd, &content[FILE_SIZE / 2], FILE_SIZE / 2, NULL, NULL);
+        if (first < 0 || second < 0)
+            return false;
+
+        /* The handle is in use until all requests are complete */
+        if (fat16_close(fd) == 0
+        ||  fat16_write(fd, content, 1) >= 0
+        ||  fat16_seek(fd, 0, FAT16_SEEK_SET) >= 0)
+            return false;
+
+        while (fat16_poll() > 0)
+            ;
+
+        int result;
+        if (fat16_get_result(second, &result) != 1
+        ||  result != FILE_SIZE / 2
+        ||  first_result != FILE_SIZE / 2)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    {
+        int fd = fat16_open("HELLO.TXT", 'r');
+        if (fd < 0)
+            return false;
+
+        int request = fat16_read_async(fd, buffer, sizeof(buffer), NULL, NULL);
+        if (request < 0)
+            return false;
+
+        if (fat16_read(fd, buffer, 1) >= 0
+        ||  fat16_seek(fd, 0, FAT16_SEEK_END) >= 0)
+            return false;
+
+        /* Read stops at the end of the file */
+        int result;
+        while (fat16_get_result(request, &result) == 0)
+            fat16_poll();
+
+        if (result != FILE_SIZE
+        ||  memcmp(buffer, content, FILE_SIZE) != 0)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Common.hpp"
+#include "DentryCacheTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+DentryCacheTest::DentryCacheTest():
+Test("DentryCacheTest"),
+m_content("Names are looked up in the cache.")
+{
+}
+
+bool DentryCacheTest::check_content(const char *filepath)
+{
+    char buf[64];
+    int fd = fat16_open(filepath, 'r');
+    if (fd < 0)
+        return false;
+
+    if (fat16_read(fd, buf, sizeof(buf)) != (int)m_content.size())
+        return false;
+
+    if (fat16_close(fd) < 0)
+        return false;
+
+    return m_content == std::string(buf, m_content.size());
+}
+
+bool DentryCacheTest::run()
+{
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    if (fat16_mkdir("/DENTRY") < 0)
+        return false;
+
+    const char *paths[] = { "DENTRY.TXT", "/TMP/DENTRY.TXT", "/DENTRY/DENTRY.TXT" };
+    for (const char *path : paths) {
+        /* The name is remembered as missing */
+        if (fat16_open(path, 'r') >= 0)
+            return false;
+
+        int fd = fat16_open(path, 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_write(fd, m_content.data(), m_content.size()) != (int)m_content.size())
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+
+        /* Size and starting cluster are given by the cache */
+        if (!check_content(path))
+            return false;
+    }
+
+    /* The same entries are read from the directories */
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    for (const char *path : paths) {
+        if (!check_content(path))
+            return false;
+
+        if (fat16_rm(path) < 0)
+            return false;
+
+        if (fat16_open(path, 'r') >= 0)
+            return false;
+    }
+
+    if (fat16_rmdir("/DENTRY") < 0)
+        return false;
+
+    if (fat16_open("/DENTRY/DENTRY.TXT", 'r') >= 0)
+        return false;
+
+    /* Deleted entries are not found in the directories either */
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    for (const char *path : paths) {
+        if (fat16_open(path, 'r') >= 0)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "Common.hpp"
+#include "EvictionTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define SECTOR_COUNT    (64)
+#define BYTE_COUNT      (5000)
+
+EvictionTest::EvictionTest():
+Test("EvictionTest")
+{
+}
+
+void EvictionTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool EvictionTest::run()
+{
+    std::vector<char> content(SECTOR_COUNT * 512, 'e');
+
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    {
+        int fd = fat16_open("BIG.BIN", 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_write(fd, content.data(), content.size()) != (int)content.size())
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    /* Allocate clusters, the directory entry now points to them */
+    int fd = fat16_open("ORDER.TXT", 'w');
+    if (fd < 0)
+        return false;
+
+    if (fat16_write(fd, content.data(), BYTE_COUNT) != BYTE_COUNT)
+        return false;
+
+    /* Load other sectors in the cache until the directory entry is evicted */
+    {
+        int big_fd = fat16_open("BIG.BIN", 'r');
+        if (big_fd < 0)
+            return false;
+
+        for (unsigned int i = 0; i < SECTOR_COUNT; ++i) {
+            char c;
+            if (fat16_pread(big_fd, &c, 1, i * 512 + 1) != 1)
+                return false;
+        }
+
+        if (fat16_close(big_fd) < 0)
+            return false;
+    }
+
+    /* The FAT reached the device before the entry */
+    if (!check_chain_on_device("ORDER   TXT"))
+        return false;
+
+    return fat16_close(fd) == 0;
+}
+
+bool EvictionTest::check_chain_on_device(const std::string &name)
+{
+    std::ifstream image("data/fs.img", std::ios::binary);
+    unsigned char bpb[24];
+
+    if (!image.read(reinterpret_cast<char *>(bpb), sizeof(bpb)))
+        return false;
+
+    uint32_t bytes_per_sector = bpb[11] | (bpb[12] << 8);
+    uint32_t fat_start = (bpb[14] | (bpb[15] << 8)) * bytes_per_sector;
+    uint32_t root_start = fat_start + bpb[16] * (bpb[22] | (bpb[23] << 8)) * bytes_per_sector;
+    uint32_t root_entry_count = bpb[17] | (bpb[18] << 8);
+    unsigned char entry[32];
+    uint32_t i;
+
+    image.seekg(root_start);
+    for (i = 0; i < root_entry_count; ++i) {
+        if (!image.read(reinterpret_cast<char *>(entry), sizeof(entry)))
+            return false;
+
+        if (memcmp(entry, name.data(), 11) == 0)
+            break;
+    }
+
+    /* The entry must have been written back with its first cluster */
+    uint16_t cluster = entry[26] | (entry[27] << 8);
+    if (i == root_entry_count || cluster == 0)
+        return false;
+
+    /* Every cluster of the chain is allocated in the FAT */
+    while (cluster < 0xFFF8) {
+        unsigned char next[2];
+
+        image.seekg(fat_start + cluster * 2);
+        if (!image.read(reinterpret_cast<char *>(next), sizeof(next)))
+            return false;
+
+        cluster = next[0] | (next[1] << 8);
+        if (cluster < 2)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <fstream>
+#include <vector>
+#include "Common.hpp"
+#include "FallocateTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define CLUSTER_COUNT   (8)
+
+FallocateTest::FallocateTest():
+Test("FallocateTest")
+{
+}
+
+void FallocateTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool FallocateTest::run()
+{
+    uint32_t initial_free, free_count, cluster_size;
+
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    if (!count_free_clusters(initial_free, cluster_size))
+        return false;
+
+    /* Reserve several clusters and write into part of them */
+    {
+        int fd = fat16_open("FALLOC.TXT", 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_fallocate(fd, CLUSTER_COUNT * cluster_size) < 0)
+            return false;
+
+        std::vector<char> content(cluster_size + cluster_size / 2);
+        for (unsigned int i = 0; i < content.size(); ++i)
+            content[i] = 'a' + i % 26;
+
+        if (fat16_write(fd, content.data(), content.size()) != (int)content.size())
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+
+        /* The size is only that of the data, only its two clusters are still allocated */
+        if (!count_free_clusters(free_count, cluster_size)
+        ||  free_count != initial_free - 2)
+            return false;
+
+        fd = fat16_open("FALLOC.TXT", 'r');
+        if (fd < 0)
+            return false;
+
+        std::vector<char> buffer(content.size() + 1);
+        if (fat16_read(fd, buffer.data(), buffer.size()) != (int)content.size())
+            return false;
+
+        buffer.resize(content.size());
+        if (buffer != content)
+            return false;
+
+        /* Cannot reserve space with a handle in read mode */
+        if (fat16_fallocate(fd, CLUSTER_COUNT * cluster_size) != -1)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+
+        if (fat16_rm("FALLOC.TXT") < 0)
+            return false;
+    }
+
+    /* Closing a file without writing releases all reserved clusters */
+    {
+        int fd = fat16_open("FALLOC.TXT", 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_fallocate(fd, CLUSTER_COUNT * cluster_size) < 0)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+
+        if (!count_free_clusters(free_count, cluster_size)
+        ||  free_count != initial_free)
+            return false;
+
+        /* The file is still empty */
+        fd = fat16_open("FALLOC.TXT", 'r');
+        if (fd < 0)
+            return false;
+
+        char c;
+        if (fat16_read(fd, &c, 1) != 0)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    /* Reserving more than the free space fails */
+    {
+        int fd = fat16_open("FALLOC.TXT", 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_fallocate(fd, (initial_free + 1) * cluster_size) != -1)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+
+        if (!count_free_clusters(free_count, cluster_size)
+        ||  free_count != initial_free)
+            return false;
+    }
+
+    return true;
+}
+
+bool FallocateTest::count_free_clusters(uint32_t &free_count, uint32_t &cluster_size)
+{
+    std::ifstream image("data/fs.img", std::ios::binary);
+    unsigned char bpb[36];
+
+    if (!image.read(reinterpret_cast<char *>(bpb), sizeof(bpb)))
+        return false;
+
+    uint32_t bytes_per_sector = bpb[11] | (bpb[12] << 8);
+    uint32_t reserved_sector_count = bpb[14] | (bpb[15] << 8);
+    uint32_t root_dir_sectors = ((bpb[17] | (bpb[18] << 8)) * 32 + bytes_per_sector - 1) / bytes_per_sector;
+    uint32_t fat_sector_count = bpb[22] | (bpb[23] << 8);
+    uint32_t sector_count = bpb[19] | (bpb[20] << 8);
+    if (sector_count == 0)
+        sector_count = bpb[32] | (bpb[33] << 8) | (bpb[34] << 16) | (bpb[35] << 24);
+
+    uint32_t data_sector_count = sector_count - reserved_sector_count
+                               - bpb[16] * fat_sector_count - root_dir_sectors;
+    uint32_t cluster_count = data_sector_count / bpb[13];
+    std::vector<unsigned char> fat(fat_sector_count * bytes_per_sector);
+
+    image.seekg(reserved_sector_count * bytes_per_sector);
+    if (!image.read(reinterpret_cast<char *>(fat.data()), fat.size()))
+        return false;
+
+    free_count = 0;
+    for (uint32_t i = 2; i < cluster_count + 2 && 2 * i + 1 < fat.size(); ++i) {
+        if (fat[2 * i] == 0 && fat[2 * i + 1] == 0)
+            ++free_count;
+    }
+
+    cluster_size = bpb[13] * bytes_per_sector;
+    return true;
+}
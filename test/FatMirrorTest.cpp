@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Common.hpp"
+#include "FatMirrorTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define FILE_COUNT      (4)
+#define BYTE_COUNT      (20000)
+
+FatMirrorTest::FatMirrorTest():
+Test("FatMirrorTest")
+{
+}
+
+void FatMirrorTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool FatMirrorTest::run()
+{
+    std::vector<char> buffer(BYTE_COUNT, 'a');
+
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    /* Allocate clusters for several files and free some of them */
+    for (unsigned int i = 0; i < FILE_COUNT; ++i) {
+        std::string filename = "MIRROR" + std::to_string(i) + ".TXT";
+        int fd = fat16_open(filename.c_str(), 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_write(fd, buffer.data(), BYTE_COUNT) != BYTE_COUNT)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    if (fat16_rm("MIRROR1.TXT") < 0)
+        return false;
+
+    if (fat16_mkdir("MIRROR") < 0)
+        return false;
+
+    return fat_copies_match();
+}
+
+bool FatMirrorTest::fat_copies_match()
+{
+    std::ifstream image("data/fs.img", std::ios::binary);
+    unsigned char bpb[24];
+
+    if (!image.read(reinterpret_cast<char *>(bpb), sizeof(bpb)))
+        return false;
+
+    uint32_t bytes_per_sector = bpb[11] | (bpb[12] << 8);
+    uint32_t reserved_sector_count = bpb[14] | (bpb[15] << 8);
+    uint32_t fat_size = (bpb[22] | (bpb[23] << 8)) * bytes_per_sector;
+    std::vector<char> first_fat(fat_size), fat(fat_size);
+
+    image.seekg(reserved_sector_count * bytes_per_sector);
+    if (!image.read(first_fat.data(), fat_size))
+        return false;
+
+    for (unsigned int i = 1; i < bpb[16]; ++i) {
+        if (!image.read(fat.data(), fat_size))
+            return false;
+
+        if (fat != first_fat)
+            return false;
+    }
+
+    return true;
+}
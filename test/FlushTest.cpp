@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <fstream>
+#include "Common.hpp"
+#include "FlushTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define BYTE_COUNT      (1000)
+
+FlushTest::FlushTest():
+Test("FlushTest")
+{
+}
+
+void FlushTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool FlushTest::run()
+{
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    int fd = fat16_open("LOG.TXT", 'w');
+    if (fd < 0)
+        return false;
+
+    /* Write one byte at a time, as a logger would */
+    for (unsigned int i = 0; i < BYTE_COUNT; ++i) {
+        char c = 'a' + i % 26;
+        if (fat16_write(fd, &c, 1) != 1)
+            return false;
+    }
+
+    if (fat16_flush(fd) < 0)
+        return false;
+
+    /* The size is on the device although the file is still open */
+    if (file_size("LOG.TXT") != BYTE_COUNT)
+        return false;
+
+    for (unsigned int i = 0; i < BYTE_COUNT; ++i) {
+        char c = 'a' + i % 26;
+        if (fat16_write(fd, &c, 1) != 1)
+            return false;
+    }
+
+    if (fat16_close(fd) < 0)
+        return false;
+
+    if (file_size("LOG.TXT") != 2 * BYTE_COUNT)
+        return false;
+
+    /* fat16_sync writes the size of every file opened for writing */
+    int fd1 = fat16_open("LOG1.TXT", 'w');
+    int fd2 = fat16_open("LOG2.TXT", 'w');
+    if (fd1 < 0 || fd2 < 0)
+        return false;
+
+    for (unsigned int i = 0; i < BYTE_COUNT; ++i) {
+        char c = 'a' + i % 26;
+        if (fat16_write(fd1, &c, 1) != 1
+        ||  (i % 2 == 0 && fat16_write(fd2, &c, 1) != 1))
+            return false;
+    }
+
+    if (fat16_sync() < 0)
+        return false;
+
+    if (file_size("LOG1.TXT") != BYTE_COUNT
+    ||  file_size("LOG2.TXT") != BYTE_COUNT / 2)
+        return false;
+
+    return fat16_close(fd1) == 0 && fat16_close(fd2) == 0;
+}
+
+long FlushTest::file_size(const std::string &filename)
+{
+    long size;
+
+    mount_image();
+
+    std::ifstream file("/mnt/" + filename);
+    file.seekg(0, std::ios::end);
+    size = file.tellg();
+    file.close();
+
+    unmount_image();
+
+    return size;
+}
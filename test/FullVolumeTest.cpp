@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+#include "Common.hpp"
+#include "FullVolumeTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define CHUNK_SIZE      (65536)
+
+FullVolumeTest::FullVolumeTest():
+Test("FullVolumeTest")
+{
+}
+
+void FullVolumeTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool FullVolumeTest::run()
+{
+    std::vector<char> chunk(CHUNK_SIZE, 'f');
+    uint32_t size = 0;
+    int ret;
+
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    int fd = fat16_open("FULL.BIN", 'w');
+    if (fd < 0)
+        return false;
+
+    /* Once no cluster is left, the write fails instead of being cut short */
+    while ((ret = fat16_write(fd, chunk.data(), chunk.size())) == CHUNK_SIZE)
+        size += ret;
+
+    if (ret != -1 || size == 0)
+        return false;
+
+    if (fat16_close(fd) < 0)
+        return false;
+
+    /* The whole chain is freed, so the space can be used again */
+    if (fat16_rm("FULL.BIN") < 0)
+        return false;
+
+    fd = fat16_open("FULL.BIN", 'w');
+    if (fd < 0)
+        return false;
+
+    for (uint32_t i = 0; i < size; i += CHUNK_SIZE) {
+        if (fat16_write(fd, chunk.data(), chunk.size()) != CHUNK_SIZE)
+            return false;
+    }
+
+    return fat16_close(fd) == 0;
+}
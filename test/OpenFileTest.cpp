@@ -0,0 +1,122 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+#include "Common.hpp"
+#include "OpenFileTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+OpenFileTest::OpenFileTest():
+Test("OpenFileTest"),
+m_content("This file must not be erased.")
+{
+}
+
+bool OpenFileTest::check_content(const char *filepath)
+{
+    char buf[64];
+    int fd = fat16_open(filepath, 'r');
+    if (fd < 0)
+        return false;
+
+    if (fat16_read(fd, buf, sizeof(buf)) != (int)m_content.size())
+        return false;
+
+    if (fat16_close(fd) < 0)
+        return false;
+
+    return m_content == std::string(buf, m_content.size());
+}
+
+bool OpenFileTest::run()
+{
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    const char *paths[] = { "OPEN.TXT", "/TMP/OPEN.TXT" };
+    for (const char *path : paths) {
+        int fd = fat16_open(path, 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_write(fd, m_content.data(), m_content.size()) != (int)m_content.size())
+            return false;
+
+        /* A file open in write mode cannot be opened again, nor deleted */
+        if (fat16_open(path, 'r') >= 0 || fat16_open(path, 'a') >= 0
+        ||  fat16_rm(path) == 0)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+
+        /* Several handles can read the same file */
+        int fd1 = fat16_open(path, 'r');
+        int fd2 = fat16_open(path, 'r');
+        if (fd1 < 0 || fd2 < 0 || fd1 == fd2)
+            return false;
+
+        /* Opening it in write mode fails without erasing it */
+        if (fat16_open(path, 'w') >= 0 || fat16_open(path, 'a') >= 0)
+            return false;
+
+        if (fat16_close(fd1) < 0)
+            return false;
+
+        /* It cannot be deleted while a handle reads it */
+        if (fat16_open(path, 'w') >= 0 || fat16_rm(path) == 0)
+            return false;
+
+        if (fat16_close(fd2) < 0)
+            return false;
+
+        if (!check_content(path))
+            return false;
+    }
+
+    /* Use all handles, then reuse the last one */
+    std::vector<int> fds;
+    int fd;
+    while ((fd = fat16_open("OPEN.TXT", 'r')) >= 0)
+        fds.push_back(fd);
+
+    if (fds.empty())
+        return false;
+
+    if (fat16_close(fds.back()) < 0)
+        return false;
+
+    fd = fat16_open("/TMP/OPEN.TXT", 'r');
+    if (fd != fds.back())
+        return false;
+    fds.back() = fd;
+
+    for (int fd : fds) {
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    /* All handles are available again */
+    fd = fat16_open("OPEN.TXT", 'a');
+    if (fd < 0)
+        return false;
+
+    return fat16_close(fd) == 0 && check_content("OPEN.TXT");
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Common.hpp"
+#include "PathCacheTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+PathCacheTest::PathCacheTest():
+Test("PathCacheTest"),
+m_content("Deep paths are walked once.")
+{
+}
+
+bool PathCacheTest::check_content(const char *filepath)
+{
+    char buf[64];
+    int fd = fat16_open(filepath, 'r');
+    if (fd < 0)
+        return false;
+
+    if (fat16_read(fd, buf, sizeof(buf)) != (int)m_content.size())
+        return false;
+
+    if (fat16_close(fd) < 0)
+        return false;
+
+    return m_content == std::string(buf, m_content.size());
+}
+
+bool PathCacheTest::run()
+{
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    if (fat16_mkdir("/PATH") < 0
+    ||  fat16_mkdir("/PATH/A") < 0
+    ||  fat16_mkdir("/PATH/A/B") < 0
+    ||  fat16_mkdir("/PATH/A/B/C") < 0)
+        return false;
+
+    int fd = fat16_open("/PATH/A/B/C/FILE.TXT", 'w');
+    if (fd < 0)
+        return false;
+
+    if (fat16_write(fd, m_content.data(), m_content.size()) != (int)m_content.size())
+        return false;
+
+    if (fat16_close(fd) < 0)
+        return false;
+
+    for (int i = 0; i < 8; ++i) {
+        if (!check_content("/PATH/A/B/C/FILE.TXT"))
+            return false;
+    }
+
+    /* Each directory of the path is walked */
+    if (fat16_open("/PATH/A/B/FILE.TXT", 'r') >= 0
+    ||  fat16_open("/PATH/A/FILE.TXT", 'r') >= 0
+    ||  fat16_open("/PATH/X/B/C/FILE.TXT", 'r') >= 0)
+        return false;
+
+    if (fat16_rm("/PATH/A/B/C/FILE.TXT") < 0
+    ||  fat16_rmdir("/PATH/A/B/C") < 0)
+        return false;
+
+    /* A deleted directory is not found anymore */
+    if (fat16_open("/PATH/A/B/C/FILE.TXT", 'w') >= 0)
+        return false;
+
+    if (fat16_rmdir("/PATH/A/B") < 0
+    ||  fat16_rmdir("/PATH/A") < 0
+    ||  fat16_mkdir("/PATH/A") < 0)
+        return false;
+
+    if (fat16_open("/PATH/A/B/C/FILE.TXT", 'w') >= 0
+    ||  fat16_mkdir("/PATH/A/B/C") == 0)
+        return false;
+
+    return fat16_rmdir("/PATH/A") == 0 && fat16_rmdir("/PATH") == 0;
+}
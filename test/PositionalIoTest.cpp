@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include "Common.hpp"
+#include "PositionalIoTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define CHUNK_SIZE  (3000)
+
+PositionalIoTest::PositionalIoTest():
+Test("PositionalIoTest"),
+m_content(10 * CHUNK_SIZE)
+{
+    srand(4);
+    for (unsigned int i = 0; i < m_content.size(); ++i)
+        m_content[i] = rand();
+}
+
+void PositionalIoTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool PositionalIoTest::run()
+{
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    {
+        int fd = fat16_open("HELLO.TXT", 'w');
+        if (fd < 0)
+            return false;
+
+        /* Write the file with zeros, then fill it in reverse order */
+        std::vector<char> zeros(m_content.size());
+        if (fat16_write(fd, zeros.data(), zeros.size()) != (int)zeros.size())
+            return false;
+
+        for (int i = m_content.size() / CHUNK_SIZE - 1; i >= 0; --i) {
+            if (fat16_pwrite(fd, &m_content[i * CHUNK_SIZE], CHUNK_SIZE, i * CHUNK_SIZE) != CHUNK_SIZE)
+                return false;
+        }
+
+        /* Position of the handle must not have changed */
+        if (fat16_tell(fd) != (int32_t)m_content.size())
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    {
+        int fd = fat16_open("HELLO.TXT", 'r');
+        if (fd < 0)
+            return false;
+
+        for (int i = m_content.size() / CHUNK_SIZE - 1; i >= 0; --i) {
+            char buf[CHUNK_SIZE];
+            if (fat16_pread(fd, buf, CHUNK_SIZE, i * CHUNK_SIZE) != CHUNK_SIZE)
+                return false;
+
+            for (unsigned int j = 0; j < CHUNK_SIZE; ++j) {
+                if (buf[j] != m_content[i * CHUNK_SIZE + j]) {
+                    printf("Found %02x but expected %02X\n", buf[j], m_content[i * CHUNK_SIZE + j]);
+                    return false;
+                }
+            }
+        }
+
+        /* Reading at the end of the file does not return any byte */
+        char buf = 0;
+        if (fat16_pread(fd, &buf, sizeof(buf), m_content.size()) != 0)
+            return false;
+
+        if (fat16_tell(fd) != 0)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+#include "Common.hpp"
+#include "ReadViewTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define CHUNK_SIZE      (100)
+
+ReadViewTest::ReadViewTest():
+Test("ReadViewTest"),
+m_content()
+{
+    srand(11);
+    m_content.resize(5 * 2048 + 321);
+    for (unsigned int i = 0; i < m_content.size(); ++i)
+        m_content[i] = rand();
+}
+
+void ReadViewTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool ReadViewTest::run()
+{
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    {
+        int fd = fat16_open("VIEW.BIN", 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_write(fd, m_content.data(), m_content.size()) != (int)m_content.size())
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    if (!read_cached_view()
+    ||  !read_interleaved()
+    ||  !use_all_views())
+        return false;
+
+    /* Same checks with views in device memory */
+    if (linux_map_image("data/fs.img") < 0)
+        return false;
+
+    if (fat16_init_block(linux_mapped_dev, 0) < 0)
+        return false;
+
+    return read_mapped_view()
+        && read_interleaved()
+        && use_all_views();
+}
+
+void ReadViewTest::release()
+{
+    linux_unmap_image();
+    Test::release();
+}
+
+bool ReadViewTest::read_cached_view()
+{
+    uint32_t sector_size = get_sector_size();
+    uint32_t position = 0;
+    int fd = fat16_open("VIEW.BIN", 'r');
+    if (fd < 0)
+        return false;
+
+    /* Each view is limited to the end of the sector in the cache */
+    while (position < m_content.size()) {
+        const void *data;
+        uint32_t count;
+
+        if (fat16_read_view(fd, m_content.size(), &data, &count) < 0)
+            return false;
+
+        uint32_t expected_count = sector_size - position % sector_size;
+        if (expected_count > m_content.size() - position)
+            expected_count = m_content.size() - position;
+        if (count != expected_count || !check_view(data, count, position))
+            return false;
+
+        if (fat16_release_view(data) < 0)
+            return false;
+
+        position += count;
+    }
+
+    return fat16_close(fd) == 0;
+}
+
+bool ReadViewTest::read_mapped_view()
+{
+    const void *data;
+    uint32_t count;
+    int fd = fat16_open("VIEW.BIN", 'r');
+    if (fd < 0)
+        return false;
+
+    /* The file was written on an empty volume, its clusters follow each other */
+    if (fat16_read_view(fd, m_content.size(), &data, &count) < 0)
+        return false;
+
+    if (count != m_content.size() || !check_view(data, count, 0))
+        return false;
+
+    if (fat16_release_view(data) < 0)
+        return false;
+
+    if (fat16_read_view(fd, m_content.size(), &data, &count) < 0 || count != 0)
+        return false;
+
+    return fat16_close(fd) == 0;
+}
+
+bool ReadViewTest::read_interleaved()
+{
+    std::vector<char> buffer(CHUNK_SIZE);
+    uint32_t position = 0;
+    int fd = fat16_open("VIEW.BIN", 'r');
+    if (fd < 0)
+        return false;
+
+    /* Views and reads move the same handle */
+    while (position < m_content.size()) {
+        const void *data;
+        uint32_t count;
+
+        if (fat16_read_view(fd, CHUNK_SIZE, &data, &count) < 0)
+            return false;
+
+        if (count == 0 || count > CHUNK_SIZE || !check_view(data, count, position))
+            return false;
+
+        if (fat16_release_view(data) < 0)
+            return false;
+
+        position += count;
+        if (fat16_tell(fd) != (int32_t)position)
+            return false;
+
+        int ret = fat16_read(fd, buffer.data(), buffer.size());
+        if (ret < 0 || !check_view(buffer.data(), ret, position))
+            return false;
+
+        position += ret;
+    }
+
+    return fat16_close(fd) == 0;
+}
+
+bool ReadViewTest::use_all_views()
+{
+    std::vector<const void *> views;
+    const void *data;
+    uint32_t count;
+    int fd = fat16_open("VIEW.BIN", 'r');
+    if (fd < 0)
+        return false;
+
+    for (unsigned int i = 0; i < FAT16_VIEW_COUNT; ++i) {
+        if (fat16_read_view(fd, CHUNK_SIZE, &data, &count) < 0
+        ||  !check_view(data, count, i * CHUNK_SIZE))
+            return false;
+
+        views.push_back(data);
+    }
+
+    /* No view is available until one is released */
+    if (fat16_read_view(fd, CHUNK_SIZE, &data, &count) != -1)
+        return false;
+
+    if (fat16_tell(fd) != FAT16_VIEW_COUNT * CHUNK_SIZE)
+        return false;
+
+    if (fat16_release_view(views[0]) < 0)
+        return false;
+
+    if (fat16_read_view(fd, CHUNK_SIZE, &data, &count) < 0
+    ||  !check_view(data, count, FAT16_VIEW_COUNT * CHUNK_SIZE))
+        return false;
+
+    views[0] = data;
+    for (const void *view : views) {
+        if (fat16_release_view(view) < 0)
+            return false;
+    }
+
+    /* A view cannot be released twice */
+    if (fat16_release_view(views[0]) != -1)
+        return false;
+
+    return fat16_close(fd) == 0;
+}
+
+bool ReadViewTest::check_view(const void *data, uint32_t count, uint32_t position)
+{
+    if (position + count > m_content.size())
+        return false;
+
+    return memcmp(data, &m_content[position], count) == 0;
+}
+
+uint32_t ReadViewTest::get_sector_size()
+{
+    std::ifstream image("data/fs.img", std::ios::binary);
+    unsigned char bpb[13];
+
+    if (!image.read(reinterpret_cast<char *>(bpb), sizeof(bpb)))
+        return 0;
+
+    return bpb[11] | (bpb[12] << 8);
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _READVIEWTEST_HPP_
+#define _READVIEWTEST_HPP_
+
+#include <cstdint>
+#include <string>
+#include "Test.hpp"
+
+class ReadViewTest : public Test
+{
+    public :
+
+        ReadViewTest();
+
+        virtual void init() override;
+        virtual bool run() override;
+        virtual void release() override;
+
+    private :
+
+        bool read_cached_view();
+        bool read_mapped_view();
+        bool read_interleaved();
+        bool use_all_views();
+        bool check_view(const void *data, uint32_t count, uint32_t position);
+        uint32_t get_sector_size();
+
+        std::string m_content;
+};
+
+#endif
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include "Common.hpp"
+#include "ReadaheadTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define SMALL_CHUNK_SIZE    (100)
+#define LARGE_CHUNK_SIZE    (10000)
+
+namespace {
+    uint32_t watched_lba;
+    bool is_watched_lba_read;
+
+    int read_watched_sectors(void *context, uint32_t lba, uint32_t count, void *buffer)
+    {
+        if (lba <= watched_lba && watched_lba < lba + count)
+            is_watched_lba_read = true;
+
+        return linux_mapped_dev.read_sectors(context, lba, count, buffer);
+    }
+}
+
+ReadaheadTest::ReadaheadTest():
+Test("ReadaheadTest"),
+m_content()
+{
+}
+
+void ReadaheadTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool ReadaheadTest::run()
+{
+    uint32_t cluster_size = get_cluster_size();
+    if (cluster_size == 0)
+        return false;
+
+    srand(6);
+    m_content.resize(4 * cluster_size + LARGE_CHUNK_SIZE + 321);
+    for (unsigned int i = 0; i < m_content.size(); ++i)
+        m_content[i] = rand();
+
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    {
+        int fd = fat16_open("AHEAD.BIN", 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_write(fd, m_content.data(), m_content.size()) != (int)m_content.size())
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    int fd = fat16_open("AHEAD.BIN", 'r');
+    if (fd < 0)
+        return false;
+
+    /* Small sequential reads across the first clusters */
+    if (!read_chunks(fd, 2 * cluster_size + 17, SMALL_CHUNK_SIZE))
+        return false;
+
+    /* Seek backwards in the middle of the buffered bytes, then before them */
+    if (fat16_seek(fd, -150, FAT16_SEEK_CUR) < 0
+    ||  !read_chunks(fd, 1000, 37))
+        return false;
+
+    if (fat16_seek(fd, -(int32_t)cluster_size, FAT16_SEEK_CUR) < 0
+    ||  !read_chunks(fd, cluster_size, SMALL_CHUNK_SIZE))
+        return false;
+
+    /* Seek forwards, past the buffered bytes */
+    if (fat16_seek(fd, cluster_size / 2 + 3, FAT16_SEEK_CUR) < 0
+    ||  !read_chunks(fd, 1000, SMALL_CHUNK_SIZE))
+        return false;
+
+    /* Positional reads do not move the handle */
+    for (unsigned int i = 0; i < 10; ++i) {
+        uint32_t offset = (i * 7919) % (m_content.size() - SMALL_CHUNK_SIZE);
+
+        if (!check_pread(fd, SMALL_CHUNK_SIZE, offset)
+        ||  !check_read(fd, SMALL_CHUNK_SIZE))
+            return false;
+    }
+
+    /* A read larger than the buffer, then small reads again */
+    if (!check_read(fd, LARGE_CHUNK_SIZE)
+    ||  !read_chunks(fd, 500, SMALL_CHUNK_SIZE))
+        return false;
+
+    /* Small reads up to the end of the file */
+    int32_t position = fat16_tell(fd);
+    if (position < 0
+    ||  !read_chunks(fd, m_content.size() - position, SMALL_CHUNK_SIZE))
+        return false;
+
+    char c;
+    if (fat16_read(fd, &c, 1) != 0)
+        return false;
+
+    if (fat16_close(fd) < 0)
+        return false;
+
+#if FAT16_READAHEAD_COUNT > 0
+    /* Clusters larger than half a buffer are not read ahead */
+    if (2 * cluster_size <= FAT16_READAHEAD_SIZE)
+        return check_prefetch(cluster_size);
+#endif
+
+    return true;
+}
+
+void ReadaheadTest::release()
+{
+    linux_unmap_image();
+    Test::release();
+}
+
+bool ReadaheadTest::read_chunks(int fd, uint32_t count, uint32_t chunk_size)
+{
+    while (count > 0) {
+        uint32_t length = count < chunk_size ? count : chunk_size;
+
+        if (!check_read(fd, length))
+            return false;
+
+        count -= length;
+    }
+
+    return true;
+}
+
+bool ReadaheadTest::check_read(int fd, uint32_t count)
+{
+    std::vector<char> buffer(count);
+    int32_t position = fat16_tell(fd);
+
+    if (position < 0 || position + count > m_content.size())
+        return false;
+
+    if (fat16_read(fd, buffer.data(), count) != (int)count)
+        return false;
+
+    if (fat16_tell(fd) != (int32_t)(position + count))
+        return false;
+
+    return memcmp(buffer.data(), &m_content[position], count) == 0;
+}
+
+bool ReadaheadTest::check_pread(int fd, uint32_t count, uint32_t offset)
+{
+    std::vector<char> buffer(count);
+    int32_t position = fat16_tell(fd);
+
+    if (fat16_pread(fd, buffer.data(), count, offset) != (int)count)
+        return false;
+
+    if (fat16_tell(fd) != position)
+        return false;
+
+    return memcmp(buffer.data(), &m_content[offset], count) == 0;
+}
+
+bool ReadaheadTest::check_prefetch(uint32_t cluster_size)
+{
+    watched_lba = get_second_cluster_lba();
+    is_watched_lba_read = false;
+    if (watched_lba == 0)
+        return false;
+
+    /* Every read goes through read_watched_sectors */
+    if (linux_map_image("data/fs.img") < 0)
+        return false;
+
+    struct block_dev_t dev = linux_mapped_dev;
+    dev.read_sectors = read_watched_sectors;
+    dev.map_sectors = NULL;
+
+    if (fat16_init_block(dev, 0) < 0)
+        return false;
+
+    int fd = fat16_open("AHEAD.BIN", 'r');
+    if (fd < 0)
+        return false;
+
+    /* The first small read already brings the second cluster */
+    if (!check_read(fd, SMALL_CHUNK_SIZE)
+    ||  !is_watched_lba_read)
+        return false;
+
+    if (!read_chunks(fd, 3 * cluster_size, SMALL_CHUNK_SIZE))
+        return false;
+
+    return fat16_close(fd) == 0;
+}
+
+uint32_t ReadaheadTest::get_cluster_size()
+{
+    std::ifstream image("data/fs.img", std::ios::binary);
+    unsigned char bpb[14];
+
+    if (!image.read(reinterpret_cast<char *>(bpb), sizeof(bpb)))
+        return 0;
+
+    return bpb[13] * (bpb[11] | (bpb[12] << 8));
+}
+
+uint32_t ReadaheadTest::get_second_cluster_lba()
+{
+    std::ifstream image("data/fs.img", std::ios::binary);
+    unsigned char bpb[24];
+
+    if (!image.read(reinterpret_cast<char *>(bpb), sizeof(bpb)))
+        return 0;
+
+    uint32_t bytes_per_sector = bpb[11] | (bpb[12] << 8);
+    uint32_t fat_start = (bpb[14] | (bpb[15] << 8)) * bytes_per_sector;
+    uint32_t root_start = fat_start + bpb[16] * (bpb[22] | (bpb[23] << 8)) * bytes_per_sector;
+    uint32_t root_entry_count = bpb[17] | (bpb[18] << 8);
+    uint32_t data_start = root_start + root_entry_count * 32;
+    unsigned char entry[32];
+    uint32_t i;
+
+    image.seekg(root_start);
+    for (i = 0; i < root_entry_count; ++i) {
+        if (!image.read(reinterpret_cast<char *>(entry), sizeof(entry)))
+            return 0;
+
+        if (memcmp(entry, "AHEAD   BIN", 11) == 0)
+            break;
+    }
+
+    if (i == root_entry_count)
+        return 0;
+
+    unsigned char next[2];
+    image.seekg(fat_start + (entry[26] | (entry[27] << 8)) * 2);
+    if (!image.read(reinterpret_cast<char *>(next), sizeof(next)))
+        return 0;
+
+    uint16_t cluster = next[0] | (next[1] << 8);
+    if (cluster < 2 || cluster >= 0xFFF8)
+        return 0;
+
+    return (data_start + (cluster - 2) * bpb[13] * bytes_per_sector) / linux_mapped_dev.sector_size;
+}
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _READAHEADTEST_HPP_
+#define _READAHEADTEST_HPP_
+
+#include <cstdint>
+#include <vector>
+#include "Test.hpp"
+
+class ReadaheadTest : public Test
+{
+    public :
+
+        ReadaheadTest();
+
+        virtual void init() override;
+        virtual bool run() override;
+        virtual void release() override;
+
+    private :
+
+        bool read_chunks(int fd, uint32_t count, uint32_t chunk_size);
+        bool check_read(int fd, uint32_t count);
+        bool check_pread(int fd, uint32_t count, uint32_t offset);
+        bool check_prefetch(uint32_t cluster_size);
+        uint32_t get_cluster_size();
+        uint32_t get_second_cluster_lba();
+
+        std::vector<char> m_content;
+};
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+#include "Common.hpp"
+#include "ReaddirBatchTest.hpp"
+#include "linux_hal.h"
+
+#define BATCH_SIZE      (2)
+
+namespace {
+    struct File {
+        const char  *name;
+        uint32_t    size;
+    };
+
+    const File files[] = {
+        { "EMPTY.TXT", 0 },
+        { "SMALL.TXT", 100 },
+        { "LARGE.BIN", 5000 }
+    };
+}
+
+ReaddirBatchTest::ReaddirBatchTest():
+Test("ReaddirBatchTest")
+{
+}
+
+bool ReaddirBatchTest::read_all(std::vector<struct fat16_dirent> &entries, uint8_t filter)
+{
+    struct fat16_dirent batch[BATCH_SIZE];
+    int dir = fat16_opendir("/BATCH");
+    int ret;
+
+    if (dir < 0)
+        return false;
+
+    entries.clear();
+    while ((ret = fat16_readdir_batch(dir, batch, BATCH_SIZE, filter)) > 0)
+        entries.insert(entries.end(), batch, batch + ret);
+
+    return fat16_closedir(dir) == 0 && ret == 0;
+}
+
+bool ReaddirBatchTest::run()
+{
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    if (fat16_mkdir("/BATCH") < 0 || fat16_mkdir("/BATCH/SUB") < 0)
+        return false;
+
+    for (const File &file : files) {
+        std::string path = std::string("/BATCH/") + file.name;
+        std::vector<uint8_t> content(file.size, 'x');
+        int fd = fat16_open(path.c_str(), 'w');
+        if (fd < 0)
+            return false;
+
+        if (file.size > 0 && fat16_write(fd, &content[0], file.size) != (int)file.size)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    /* All entries, in the order of the directory */
+    std::vector<struct fat16_dirent> entries;
+    if (!read_all(entries, 0) || entries.size() != 6)
+        return false;
+
+    const char *dirs[] = { ".", "..", "SUB." };
+    for (unsigned int i = 0; i < 3; ++i) {
+        const struct fat16_dirent &e = entries[i < 2 ? i : 2];
+        if (std::string(e.name) != dirs[i] || !(e.attribute & FAT16_ATTR_SUBDIR) || e.size != 0)
+            return false;
+    }
+
+    for (unsigned int i = 0; i < 3; ++i) {
+        const struct fat16_dirent &e = entries[3 + i];
+        if (std::string(e.name) != files[i].name
+        ||  (e.attribute & (FAT16_ATTR_SUBDIR | FAT16_ATTR_VOLUME))
+        ||  e.size != files[i].size
+        ||  (e.starting_cluster == 0) != (files[i].size == 0))
+            return false;
+    }
+
+    /* Files only */
+    if (!read_all(entries, FAT16_SKIP_DIRECTORIES | FAT16_SKIP_VOLUME) || entries.size() != 3)
+        return false;
+    for (unsigned int i = 0; i < 3; ++i) {
+        if (std::string(entries[i].name) != files[i].name)
+            return false;
+    }
+
+    /* Directories only */
+    if (!read_all(entries, FAT16_SKIP_FILES | FAT16_SKIP_VOLUME) || entries.size() != 3)
+        return false;
+    for (const struct fat16_dirent &e : entries) {
+        if (!(e.attribute & FAT16_ATTR_SUBDIR))
+            return false;
+    }
+
+    return true;
+}
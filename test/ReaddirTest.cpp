@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Common.hpp"
+#include "ReaddirTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+ReaddirTest::ReaddirTest(const std::string &dirpath, unsigned int files_count):
+Test(std::string("ReaddirTest " + dirpath + " (") + std::to_string(files_count) + std::string(")")),
+m_dirpath(dirpath),
+m_files_count(files_count)
+{
+}
+
+void ReaddirTest::init()
+{
+    restore_image();
+    mount_image();
+    {
+        std::stringstream ss;
+        ss << "mkdir -p /mnt/" << m_dirpath;
+        system(ss.str().c_str());
+    }
+    for(unsigned int i = 0; i < m_files_count; ++i) {
+        std::stringstream ss;
+        ss << "touch /mnt/" << m_dirpath << "/" << i << ".TXT";
+        system(ss.str().c_str());
+    }
+    unmount_image();
+
+    load_image();
+}
+
+bool ReaddirTest::run()
+{
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    /* fat16_ls gives the same names, one directory scan per name */
+    std::vector<std::string> expected;
+    char filename[13];
+    uint32_t i = 0;
+    int ret;
+    while ((ret = fat16_ls(&i, filename, m_dirpath.c_str())) == 1)
+        expected.push_back(filename);
+    if (ret != 0)
+        return false;
+
+    int dir = fat16_opendir(m_dirpath.c_str());
+    if (dir < 0)
+        return false;
+
+    /* Directories are read independently */
+    int other_dir = fat16_opendir(m_dirpath.c_str());
+    if (other_dir < 0 || other_dir == dir)
+        return false;
+
+    std::vector<std::string> names;
+    unsigned int files_count = 0;
+    while ((ret = fat16_readdir(dir, filename)) == 1) {
+        std::string s(filename);
+        names.push_back(s);
+        if (s != "." && s != "..")
+            ++files_count;
+    }
+    if (ret != 0 || names != expected || files_count != m_files_count)
+        return false;
+
+    /* The end of the directory has been reached */
+    if (fat16_readdir(dir, filename) != 0)
+        return false;
+
+    ret = fat16_readdir(other_dir, filename);
+    if (expected.empty() ? ret != 0 : (ret != 1 || expected[0] != filename))
+        return false;
+
+    if (fat16_closedir(dir) < 0 || fat16_closedir(other_dir) < 0)
+        return false;
+
+    /* Closed handles cannot be used anymore */
+    if (fat16_readdir(dir, filename) >= 0 || fat16_closedir(dir) >= 0)
+        return false;
+
+    return fat16_opendir("/NOTFOUND") < 0;
+}
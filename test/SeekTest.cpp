@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include "Common.hpp"
+#include "SeekTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+
+SeekTest::SeekTest():
+Test("SeekTest"),
+m_content(100000)
+{
+    srand(3);
+    for (unsigned int i = 0; i < m_content.size(); ++i)
+        m_content[i] = rand();
+}
+
+void SeekTest::init()
+{
+    restore_image();
+    mount_image();
+    create_large_file("HELLO.TXT");
+    unmount_image();
+    load_image();
+}
+
+bool SeekTest::run()
+{
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    {
+        int fd = fat16_open("HELLO.TXT", 'r');
+        if (fd < 0)
+            return false;
+
+        /* Read the end of the file first, then move backward */
+        if (fat16_seek(fd, -100, FAT16_SEEK_END) != (int32_t)m_content.size() - 100)
+            return false;
+        if (!check_read_at(fd, m_content.size() - 100, 100))
+            return false;
+
+        if (!check_read_at(fd, 50000, 3000))
+            return false;
+        if (!check_read_at(fd, 2048, 2048))
+            return false;
+        if (!check_read_at(fd, 0, 10))
+            return false;
+
+        /* Move forward from the current position */
+        if (fat16_seek(fd, 70000, FAT16_SEEK_CUR) != 70010)
+            return false;
+        if (!check_read_at(fd, 70010, 1))
+            return false;
+
+        /* Cannot move outside of the file */
+        if (fat16_seek(fd, -1, FAT16_SEEK_SET) >= 0)
+            return false;
+        if (fat16_seek(fd, 1, FAT16_SEEK_END) >= 0)
+            return false;
+
+        /* Extreme offsets fail without moving the handle */
+        if (!check_read_at(fd, 1000, 0))
+            return false;
+        if (fat16_seek(fd, INT32_MAX, FAT16_SEEK_CUR) >= 0)
+            return false;
+        if (fat16_seek(fd, INT32_MIN, FAT16_SEEK_CUR) >= 0)
+            return false;
+        if (fat16_tell(fd) != 1000)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    {
+        /* Append handles start at the end of the file */
+        int fd = fat16_open("HELLO.TXT", 'a');
+        if (fd < 0)
+            return false;
+
+        if (fat16_tell(fd) != (int32_t)m_content.size())
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    return true;
+}
+
+bool SeekTest::check_read_at(int fd, unsigned int position, unsigned int length)
+{
+    std::vector<char> buf(length);
+
+    if (fat16_seek(fd, position, FAT16_SEEK_SET) != (int32_t)position)
+        return false;
+
+    if (fat16_read(fd, buf.data(), length) != (int)length)
+        return false;
+
+    if (fat16_tell(fd) != (int32_t)(position + length))
+        return false;
+
+    for (unsigned int i = 0; i < length; ++i) {
+        if (buf[i] != m_content[position + i]) {
+            printf("Found %02x at %u but expected %02X\n", buf[i], position + i, m_content[position + i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void SeekTest::create_large_file(const std::string &filename)
+{
+    std::string path = "/mnt/";
+    path += filename;
+    std::ofstream file(path);
+    file.write(m_content.data(), m_content.size());
+    file.close();
+}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include "Common.hpp"
+#include "ThreadTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define FILE_COUNT      (2)
+#define READER_COUNT    (4)
+#define ITERATION_COUNT (500)
+#define CHUNK_SIZE      (1000)
+
+ThreadTest::ThreadTest():
+Test("ThreadTest"),
+m_contents(FILE_COUNT),
+m_written()
+{
+    srand(5);
+    for (unsigned int i = 0; i < FILE_COUNT; ++i) {
+        m_contents[i].resize(5 * 2048 + 123 * i);
+        for (unsigned int j = 0; j < m_contents[i].size(); ++j)
+            m_contents[i][j] = rand();
+    }
+
+    for (unsigned int i = 0; i < ITERATION_COUNT * CHUNK_SIZE; ++i)
+        m_written += 'a' + i % 26;
+}
+
+bool ThreadTest::run()
+{
+    /* Reads of the mapped image can run in parallel */
+    if (linux_map_image("data/fs.img") < 0)
+        return false;
+
+    if (fat16_init_block(linux_mapped_dev, 0) < 0)
+        return false;
+
+    for (unsigned int i = 0; i < FILE_COUNT; ++i) {
+        std::string name = "THREAD" + std::to_string(i) + ".TXT";
+        int fd = fat16_open(name.c_str(), 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_write(fd, m_contents[i].data(), m_contents[i].size()) != (int)m_contents[i].size())
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    /* Each file is read by several threads while another file is written */
+    std::atomic<bool> result(true);
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < READER_COUNT; ++i) {
+        threads.push_back(std::thread([this, i, &result]() {
+            if (!read_file(i % FILE_COUNT))
+                result = false;
+        }));
+    }
+    threads.push_back(std::thread([this, &result]() {
+        if (!write_file())
+            result = false;
+    }));
+    threads.push_back(std::thread([this, &result]() {
+        if (!list_files())
+            result = false;
+    }));
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    if (!result)
+        return false;
+
+    int fd = fat16_open("WRITER.TXT", 'r');
+    if (fd < 0)
+        return false;
+
+    std::string buf(m_written.size() + 1, '\0');
+    if (fat16_read(fd, &buf[0], buf.size()) != (int)m_written.size())
+        return false;
+
+    if (buf.substr(0, m_written.size()) != m_written)
+        return false;
+
+    return fat16_close(fd) == 0;
+}
+
+bool ThreadTest::read_file(unsigned int index)
+{
+    const std::string &content = m_contents[index];
+    std::string name = "THREAD" + std::to_string(index) + ".TXT";
+    int fd = fat16_open(name.c_str(), 'r');
+    if (fd < 0)
+        return false;
+
+    for (unsigned int i = 0; i < ITERATION_COUNT; ++i) {
+        char buf[CHUNK_SIZE];
+        uint32_t offset = (i * 997) % content.size();
+        uint32_t count = content.size() - offset < CHUNK_SIZE ? content.size() - offset : CHUNK_SIZE;
+
+        /* Sequential read, the handle moves */
+        if (fat16_seek(fd, offset, FAT16_SEEK_SET) != (int32_t)offset)
+            return false;
+        if (fat16_read(fd, buf, CHUNK_SIZE) != (int)count)
+            return false;
+        if (content.compare(offset, count, buf, count) != 0)
+            return false;
+        if (fat16_tell(fd) != (int32_t)(offset + count))
+            return false;
+
+        /* Positional read, the handle stays in place */
+        offset = (i * 1499) % content.size();
+        count = content.size() - offset < CHUNK_SIZE ? content.size() - offset : CHUNK_SIZE;
+        if (fat16_pread(fd, buf, CHUNK_SIZE, offset) != (int)count)
+            return false;
+        if (content.compare(offset, count, buf, count) != 0)
+            return false;
+
+        /* Views are shared by all files of the volume */
+        const void *data;
+        uint32_t view_count;
+        if (fat16_read_view(fd, CHUNK_SIZE, &data, &view_count) == 0 && view_count > 0) {
+            int32_t position = fat16_tell(fd);
+            bool is_valid = content.compare(position - view_count, view_count, (const char *)data, view_count) == 0;
+            if (fat16_release_view(data) < 0 || !is_valid)
+                return false;
+        }
+    }
+
+    return fat16_close(fd) == 0;
+}
+
+bool ThreadTest::write_file()
+{
+    int fd = fat16_open("WRITER.TXT", 'w');
+    if (fd < 0)
+        return false;
+
+    for (unsigned int i = 0; i < ITERATION_COUNT; ++i) {
+        if (fat16_write(fd, &m_written[i * CHUNK_SIZE], CHUNK_SIZE) != CHUNK_SIZE)
+            return false;
+
+        if (i % 10 == 0 && fat16_flush(fd) < 0)
+            return false;
+    }
+
+    return fat16_close(fd) == 0;
+}
+
+bool ThreadTest::list_files()
+{
+    for (unsigned int i = 0; i < ITERATION_COUNT; ++i) {
+        uint32_t index = 0;
+        char filename[13];
+        bool found = false;
+        int ret;
+
+        while ((ret = fat16_ls(&index, filename, "/")) == 1) {
+            if (std::string(filename) == "THREAD0.TXT")
+                found = true;
+        }
+
+        if (ret < 0 || !found)
+            return false;
+    }
+
+    return true;
+}
+
+void ThreadTest::release()
+{
+    linux_unmap_image();
+    Test::release();
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cstring>
+#include "Common.hpp"
+#include "VectorIoTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+#define RECORD_COUNT    (50)
+
+VectorIoTest::VectorIoTest():
+Test("VectorIoTest")
+{
+}
+
+void VectorIoTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool VectorIoTest::run()
+{
+    char header[] = "HEADER";
+    char payload[1000];
+    char trailer[] = "TRAILER";
+
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    memset(payload, 'x', sizeof(payload));
+
+    {
+        int fd = fat16_open("HELLO.TXT", 'w');
+        if (fd < 0)
+            return false;
+
+        for (unsigned int i = 0; i < RECORD_COUNT; ++i) {
+            struct fat16_iovec iov[3] = {
+                { header, sizeof(header) },
+                { payload, sizeof(payload) },
+                { trailer, sizeof(trailer) }
+            };
+
+            if (fat16_writev(fd, iov, 3) != sizeof(header) + sizeof(payload) + sizeof(trailer))
+                return false;
+        }
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    {
+        int fd = fat16_open("HELLO.TXT", 'r');
+        if (fd < 0)
+            return false;
+
+        for (unsigned int i = 0; i < RECORD_COUNT; ++i) {
+            char h[sizeof(header)], p[sizeof(payload)], t[sizeof(trailer)];
+            struct fat16_iovec iov[3] = {
+                { h, sizeof(h) },
+                { p, sizeof(p) },
+                { t, sizeof(t) }
+            };
+
+            if (fat16_readv(fd, iov, 3) != sizeof(h) + sizeof(p) + sizeof(t))
+                return false;
+
+            if (memcmp(h, header, sizeof(h)) != 0
+            ||  memcmp(p, payload, sizeof(p)) != 0
+            ||  memcmp(t, trailer, sizeof(t)) != 0)
+                return false;
+        }
+
+        /* Check if we reached end of file */
+        char buf = 0;
+        struct fat16_iovec iov = { &buf, sizeof(buf) };
+        if (fat16_readv(fd, &iov, 1) != 0)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    return true;
+}
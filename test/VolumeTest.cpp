@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+#include "Common.hpp"
+#include "VolumeTest.hpp"
+#include "../driver/fat16.h"
+#include "linux_hal.h"
+
+VolumeTest::VolumeTest():
+Test("VolumeTest"),
+m_content("Hello from another volume!")
+{
+}
+
+void VolumeTest::init()
+{
+    restore_image();
+    load_image();
+}
+
+bool VolumeTest::run()
+{
+    if (fat16_init(linux_dev, 0) < 0)
+        return false;
+
+    {
+        int fd = fat16_open("VOLUME.TXT", 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_write(fd, m_content.data(), m_content.size()) != (int)m_content.size())
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+#if FAT16_VOLUME_COUNT > 1
+    if (!use_other_volume())
+        return false;
+#else
+    /* The only volume is used by fat16_init */
+    struct fat16_volume *volume = NULL;
+    if (fat16_mount(&volume, linux_mapped_dev, 0) == 0 || volume != NULL)
+        return false;
+#endif
+
+    /* The first volume is still mounted */
+    {
+        int fd = fat16_open("VOLUME.TXT", 'r');
+        if (fd < 0)
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    /* Mounting the partition again keeps what was written to an open file */
+    {
+        int fd = fat16_open("DIRTY.TXT", 'w');
+        if (fd < 0)
+            return false;
+
+        if (fat16_write(fd, m_content.data(), m_content.size()) != (int)m_content.size())
+            return false;
+
+        if (fat16_init(linux_dev, 0) < 0)
+            return false;
+
+        fd = fat16_open("DIRTY.TXT", 'r');
+        if (fd < 0)
+            return false;
+
+        char buf[64];
+        int ret = fat16_read(fd, buf, sizeof(buf));
+        if (ret != (int)m_content.size() || m_content != std::string(buf, ret))
+            return false;
+
+        if (fat16_close(fd) < 0)
+            return false;
+    }
+
+    return true;
+}
+
+#if FAT16_VOLUME_COUNT > 1
+bool VolumeTest::use_other_volume()
+{
+    struct fat16_volume *volume = NULL, *other = NULL;
+
+    /* Mount the same image a second time, through another device */
+    if (linux_map_image("data/fs.img") < 0)
+        return false;
+
+    if (fat16_mount(&volume, linux_mapped_dev, 0) < 0)
+        return false;
+
+    /* Once every volume is in use, no other one can be mounted */
+    std::vector<struct fat16_volume *> others(FAT16_VOLUME_COUNT - 2);
+    for (unsigned int i = 0; i < others.size(); ++i) {
+        if (fat16_mount(&others[i], linux_mapped_dev, 0) < 0)
+            return false;
+    }
+
+    if (fat16_mount(&other, linux_mapped_dev, 0) == 0 || other != NULL)
+        return false;
+
+    for (unsigned int i = 0; i < others.size(); ++i) {
+        if (fat16_unmount(others[i]) < 0)
+            return false;
+    }
+
+    {
+        int fd = fat16_vol_open(volume, "VOLUME.TXT", 'r');
+        if (fd < 0)
+            return false;
+
+        /* Handles belong to the volume which opened them */
+        char buf[64];
+        if (fat16_read(fd, buf, sizeof(buf)) >= 0)
+            return false;
+
+        int ret = fat16_vol_read(volume, fd, buf, sizeof(buf));
+        if (ret != (int)m_content.size())
+            return false;
+
+        if (m_content != std::string(buf, ret))
+            return false;
+
+        /* A volume cannot be unmounted while a file is open */
+        if (fat16_unmount(volume) == 0)
+            return false;
+
+        if (fat16_vol_close(volume, fd) < 0)
+            return false;
+    }
+
+    if (fat16_unmount(volume) < 0)
+        return false;
+
+    return fat16_vol_open(volume, "VOLUME.TXT", 'r') < 0;
+}
+#endif
+
+void VolumeTest::release()
+{
+    linux_unmap_image();
+    Test::release();
+}
@@ -18,11 +18,25 @@
  */
 
 
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "linux_hal.h"
 
+#define MAPPED_SECTOR_SIZE  (512)
+
 static FILE *image = NULL;
 
+static uint8_t *mapped_image = NULL;
+static size_t mapped_image_size = 0;
+
+/* Range of bytes written since the last call to msync */
+static size_t dirty_start = 0;
+static size_t dirty_end = 0;
+
 int linux_load_image(const char *path)
 {
     if (path == NULL) {
@@ -111,3 +125,140 @@ struct storage_dev_t linux_dev = {
     linux_write,
     linux_seek
 };
+
+int linux_map_image(const char *path)
+{
+    struct stat st;
+    void *data;
+    int fd;
+
+    if (path == NULL) {
+        printf("linux_map_image: Cannot map image with null path\n");
+        return -1;
+    }
+
+    if ((fd = open(path, O_RDWR)) < 0) {
+        printf("linux_map_image: Could not open file %s\n", path);
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        printf("linux_map_image: Could not get size of file %s\n", path);
+        close(fd);
+        return -1;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printf("linux_map_image: Could not map file %s\n", path);
+        return -1;
+    }
+
+    mapped_image = (uint8_t *)data;
+    mapped_image_size = st.st_size;
+    dirty_start = dirty_end = 0;
+
+    return 0;
+}
+
+int linux_unmap_image(void)
+{
+    int ret;
+
+    if (mapped_image == NULL)
+        return 0;
+
+    ret = munmap(mapped_image, mapped_image_size);
+    mapped_image = NULL;
+    mapped_image_size = 0;
+
+    return ret;
+}
+
+static bool is_in_mapped_image(uint32_t lba, uint32_t count)
+{
+    return mapped_image != NULL
+        && ((uint64_t)lba + count) * MAPPED_SECTOR_SIZE <= mapped_image_size;
+}
+
+int linux_mapped_read_sectors(void *context, uint32_t lba, uint32_t count, void *buffer)
+{
+    (void)context;
+
+    if (!is_in_mapped_image(lba, count)) {
+        printf("linux_mapped_read_sectors: Cannot read %u sectors at %u\n", count, lba);
+        return -1;
+    }
+
+    memcpy(buffer, &mapped_image[lba * MAPPED_SECTOR_SIZE], count * MAPPED_SECTOR_SIZE);
+    return 0;
+}
+
+int linux_mapped_write_sectors(void *context, uint32_t lba, uint32_t count, const void *buffer)
+{
+    (void)context;
+
+    if (!is_in_mapped_image(lba, count)) {
+        printf("linux_mapped_write_sectors: Cannot write %u sectors at %u\n", count, lba);
+        return -1;
+    }
+
+    memcpy(&mapped_image[lba * MAPPED_SECTOR_SIZE], buffer, count * MAPPED_SECTOR_SIZE);
+
+    if (dirty_start == dirty_end) {
+        dirty_start = lba * MAPPED_SECTOR_SIZE;
+        dirty_end = (lba + count) * MAPPED_SECTOR_SIZE;
+    } else {
+        if (lba * MAPPED_SECTOR_SIZE < dirty_start)
+            dirty_start = lba * MAPPED_SECTOR_SIZE;
+        if ((lba + count) * MAPPED_SECTOR_SIZE > dirty_end)
+            dirty_end = (lba + count) * MAPPED_SECTOR_SIZE;
+    }
+
+    return 0;
+}
+
+const void *linux_mapped_map_sectors(void *context, uint32_t lba, uint32_t count)
+{
+    (void)context;
+
+    if (!is_in_mapped_image(lba, count))
+        return NULL;
+
+    return &mapped_image[lba * MAPPED_SECTOR_SIZE];
+}
+
+int linux_mapped_sync(void *context)
+{
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t start;
+
+    (void)context;
+
+    if (mapped_image == NULL)
+        return -1;
+
+    if (dirty_start == dirty_end)
+        return 0;
+
+    /* msync only accepts page aligned addresses */
+    start = dirty_start - dirty_start % page_size;
+    if (msync(&mapped_image[start], dirty_end - start, MS_SYNC) < 0)
+        return -1;
+
+    dirty_start = dirty_end = 0;
+    return 0;
+}
+
+struct block_dev_t linux_mapped_dev = {
+    MAPPED_SECTOR_SIZE,
+    linux_mapped_read_sectors,
+    linux_mapped_write_sectors,
+    linux_mapped_map_sectors,
+    linux_mapped_sync,
+    NULL,
+    NULL,
+    NULL,
+    NULL
+};
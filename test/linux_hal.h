@@ -33,6 +33,29 @@ int linux_release_image(void);
 
 extern struct storage_dev_t linux_dev;
 
+/*
+ * Block device backed by an image mapped in memory. Reads and writes are
+ * memory copies, the image is only synchronised with msync when the driver
+ * reaches a flush point.
+ */
+int linux_map_image(const char *path);
+int linux_unmap_image(void);
+
+extern struct block_dev_t linux_mapped_dev;
+
+/*
+ * Block device backed by an image file. Batches of transfers are queued in
+ * an io_uring submission ring and submitted with a single system call. If
+ * io_uring is not available (or not allowed), batches are spread over a pool
+ * of threads calling pread and pwrite. Batches can also be started without
+ * waiting for them, for asynchronous requests.
+ */
+int linux_uring_open_image(const char *path, int allow_uring);
+int linux_uring_close_image(void);
+int linux_uring_is_active(void);
+
+extern struct block_dev_t linux_uring_dev;
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,460 @@
+/*
+ * Copyright (C) 2017  Francois Berder <fberder@outlook.fr>
+ *
+ * This file is part of fat16.
+ *
+ * fat16 is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * fat16 is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with fat16.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "linux_hal.h"
+
+#define URING_SECTOR_SIZE   (512)
+#define URING_QUEUE_DEPTH   (64)
+#define WORKER_COUNT        (4)
+
+namespace {
+    int image_fd = -1;
+
+    struct uring {
+        int fd;
+        void *sq_ring;
+        size_t sq_ring_size;
+        void *cq_ring;
+        size_t cq_ring_size;
+        struct io_uring_sqe *sqes;
+        size_t sqes_size;
+        unsigned int sq_entries;
+        unsigned int *sq_tail;
+        unsigned int *sq_mask;
+        unsigned int *sq_array;
+        unsigned int *cq_head;
+        unsigned int *cq_tail;
+        unsigned int *cq_mask;
+        struct io_uring_cqe *cqes;
+    } ring;
+
+    /* Batch performed through the ring */
+    struct uring_batch {
+        struct block_request *requests;
+        uint32_t count;
+        uint32_t next;              /**< Index of the first request not submitted yet */
+        uint32_t in_flight_count;   /**< Number of requests submitted but not complete */
+        bool has_failed;
+    } batch;
+
+    struct thread_pool {
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable work_available;
+        std::condition_variable work_done;
+        struct block_request *requests;
+        uint32_t count;
+        uint32_t next;
+        uint32_t done_count;
+        bool has_failed;
+        bool stop;
+    };
+
+    struct thread_pool *pool = nullptr;
+
+    /**
+     * @brief Perform a transfer with pread or pwrite
+     *
+     * @param[in] request
+     * @param[in] done Number of bytes already transferred
+     * @return 0 if successful, -1 otherwise
+     */
+    int transfer(const struct block_request &request, uint32_t done = 0)
+    {
+        uint32_t length = request.count * URING_SECTOR_SIZE;
+        uint8_t *buffer = static_cast<uint8_t *>(request.buffer);
+        off_t offset = (off_t)request.lba * URING_SECTOR_SIZE;
+
+        while (done < length) {
+            ssize_t ret;
+
+            if (request.is_write)
+                ret = pwrite(image_fd, &buffer[done], length - done, offset + done);
+            else
+                ret = pread(image_fd, &buffer[done], length - done, offset + done);
+
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret <= 0)
+                return -1;
+
+            done += ret;
+        }
+
+        return 0;
+    }
+
+    int uring_enter(unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+    {
+        int ret;
+
+        do {
+            ret = syscall(__NR_io_uring_enter, ring.fd, to_submit, min_complete, flags, NULL, 0);
+        } while (ret < 0 && errno == EINTR);
+
+        return ret;
+    }
+
+    void uring_release()
+    {
+        if (ring.sqes != nullptr)
+            munmap(ring.sqes, ring.sqes_size);
+        if (ring.cq_ring != nullptr && ring.cq_ring != ring.sq_ring)
+            munmap(ring.cq_ring, ring.cq_ring_size);
+        if (ring.sq_ring != nullptr)
+            munmap(ring.sq_ring, ring.sq_ring_size);
+        if (ring.fd >= 0)
+            close(ring.fd);
+
+        memset(&ring, 0, sizeof(ring));
+        ring.fd = -1;
+    }
+
+    int uring_setup()
+    {
+        struct io_uring_params params;
+        uint8_t *sq_ring, *cq_ring;
+        void *ptr;
+
+        memset(&ring, 0, sizeof(ring));
+        memset(&params, 0, sizeof(params));
+        ring.fd = syscall(__NR_io_uring_setup, URING_QUEUE_DEPTH, &params);
+        if (ring.fd < 0)
+            return -1;
+
+        ring.sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+        ring.cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            if (ring.cq_ring_size > ring.sq_ring_size)
+                ring.sq_ring_size = ring.cq_ring_size;
+            ring.cq_ring_size = ring.sq_ring_size;
+        }
+
+        ptr = mmap(NULL, ring.sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+        if (ptr == MAP_FAILED) {
+            uring_release();
+            return -1;
+        }
+        ring.sq_ring = ptr;
+
+        if (params.features & IORING_FEAT_SINGLE_MMAP) {
+            ring.cq_ring = ring.sq_ring;
+        } else {
+            ptr = mmap(NULL, ring.cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+            if (ptr == MAP_FAILED) {
+                uring_release();
+                return -1;
+            }
+            ring.cq_ring = ptr;
+        }
+
+        ring.sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+        ptr = mmap(NULL, ring.sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+        if (ptr == MAP_FAILED) {
+            ring.sqes = nullptr;
+            uring_release();
+            return -1;
+        }
+        ring.sqes = static_cast<struct io_uring_sqe *>(ptr);
+
+        sq_ring = static_cast<uint8_t *>(ring.sq_ring);
+        cq_ring = static_cast<uint8_t *>(ring.cq_ring);
+        ring.sq_entries = params.sq_entries;
+        ring.sq_tail = reinterpret_cast<unsigned int *>(sq_ring + params.sq_off.tail);
+        ring.sq_mask = reinterpret_cast<unsigned int *>(sq_ring + params.sq_off.ring_mask);
+        ring.sq_array = reinterpret_cast<unsigned int *>(sq_ring + params.sq_off.array);
+        ring.cq_head = reinterpret_cast<unsigned int *>(cq_ring + params.cq_off.head);
+        ring.cq_tail = reinterpret_cast<unsigned int *>(cq_ring + params.cq_off.tail);
+        ring.cq_mask = reinterpret_cast<unsigned int *>(cq_ring + params.cq_off.ring_mask);
+        ring.cqes = reinterpret_cast<struct io_uring_cqe *>(cq_ring + params.cq_off.cqes);
+
+        return 0;
+    }
+
+    /**
+     * @brief Queue the next requests of the batch, up to sq_entries, and
+     * submit them with one system call.
+     */
+    int uring_submit_next()
+    {
+        unsigned int tail = *ring.sq_tail;
+        uint32_t count = batch.count - batch.next;
+
+        if (count > ring.sq_entries)
+            count = ring.sq_entries;
+
+        for (uint32_t i = batch.next; i < batch.next + count; ++i) {
+            const struct block_request &request = batch.requests[i];
+            unsigned int index = tail & *ring.sq_mask;
+            struct io_uring_sqe *sqe = &ring.sqes[index];
+
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = request.is_write ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe->fd = image_fd;
+            sqe->off = (uint64_t)request.lba * URING_SECTOR_SIZE;
+            sqe->addr = reinterpret_cast<uint64_t>(request.buffer);
+            sqe->len = request.count * URING_SECTOR_SIZE;
+            sqe->user_data = i;
+            ring.sq_array[index] = index;
+            ++tail;
+        }
+        __atomic_store_n(ring.sq_tail, tail, __ATOMIC_RELEASE);
+
+        if (uring_enter(count, 0, 0) != (int)count)
+            return -1;
+
+        batch.next += count;
+        batch.in_flight_count = count;
+        return 0;
+    }
+
+    /**
+     * @brief Reap completed requests and submit the rest of the batch
+     *
+     * @param[in] is_blocking If true, wait until the batch is complete
+     * @return 1 if the batch is complete, 0 if it is in progress, -1 if a request failed
+     */
+    int uring_progress(bool is_blocking)
+    {
+        while (1) {
+            unsigned int head = *ring.cq_head;
+
+            while (head != __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE)) {
+                const struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cq_mask];
+                const struct block_request &request = batch.requests[cqe->user_data];
+
+                /* Finish short or unsupported transfers synchronously */
+                if (cqe->res != (int32_t)(request.count * URING_SECTOR_SIZE)
+                &&  transfer(request, cqe->res > 0 ? cqe->res : 0) < 0)
+                    batch.has_failed = true;
+
+                ++head;
+                --batch.in_flight_count;
+            }
+            __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+            if (batch.in_flight_count == 0) {
+                if (batch.next == batch.count)
+                    return batch.has_failed ? -1 : 1;
+                if (uring_submit_next() < 0)
+                    return -1;
+            } else if (!is_blocking) {
+                return 0;
+            } else if (uring_enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+                return -1;
+            }
+        }
+    }
+
+    void worker_main()
+    {
+        std::unique_lock<std::mutex> lock(pool->mutex);
+
+        while (1) {
+            pool->work_available.wait(lock, [] { return pool->stop || pool->next < pool->count; });
+            if (pool->stop)
+                break;
+
+            const struct block_request &request = pool->requests[pool->next++];
+            lock.unlock();
+            int ret = transfer(request);
+            lock.lock();
+
+            if (ret < 0)
+                pool->has_failed = true;
+            if (++pool->done_count == pool->count)
+                pool->work_done.notify_one();
+        }
+    }
+
+    void pool_start(struct block_request *requests, uint32_t count)
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+
+        pool->requests = requests;
+        pool->count = count;
+        pool->next = 0;
+        pool->done_count = 0;
+        pool->has_failed = false;
+        pool->work_available.notify_all();
+    }
+
+    /**
+     * @param[in] is_blocking If true, wait until the batch is complete
+     * @return 1 if the batch is complete, 0 if it is in progress, -1 if a request failed
+     */
+    int pool_progress(bool is_blocking)
+    {
+        std::unique_lock<std::mutex> lock(pool->mutex);
+
+        if (is_blocking)
+            pool->work_done.wait(lock, [] { return pool->done_count == pool->count; });
+        else if (pool->done_count < pool->count)
+            return 0;
+
+        return pool->has_failed ? -1 : 1;
+    }
+
+    void pool_release()
+    {
+        if (pool == nullptr)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(pool->mutex);
+            pool->stop = true;
+        }
+        pool->work_available.notify_all();
+        for (std::thread &worker : pool->workers)
+            worker.join();
+
+        delete pool;
+        pool = nullptr;
+    }
+}
+
+int linux_uring_open_image(const char *path, int allow_uring)
+{
+    if (path == NULL) {
+        printf("linux_uring_open_image: Cannot open image with null path\n");
+        return -1;
+    }
+
+    if ((image_fd = open(path, O_RDWR)) < 0) {
+        printf("linux_uring_open_image: Could not open file %s\n", path);
+        return -1;
+    }
+
+    if (allow_uring && uring_setup() == 0)
+        return 0;
+
+    /* io_uring is not available, use a pool of threads instead */
+    pool = new thread_pool();
+    pool->count = 0;
+    pool->next = 0;
+    pool->stop = false;
+    for (unsigned int i = 0; i < WORKER_COUNT; ++i)
+        pool->workers.push_back(std::thread(worker_main));
+
+    return 0;
+}
+
+int linux_uring_close_image(void)
+{
+    int ret = 0;
+
+    uring_release();
+    pool_release();
+
+    if (image_fd >= 0)
+        ret = close(image_fd);
+    image_fd = -1;
+
+    return ret;
+}
+
+int linux_uring_is_active(void)
+{
+    return ring.fd >= 0 && ring.sqes != nullptr;
+}
+
+int linux_uring_read_sectors(void *context, uint32_t lba, uint32_t count, void *buffer)
+{
+    struct block_request request = { lba, count, buffer, 0 };
+
+    (void)context;
+    return transfer(request);
+}
+
+int linux_uring_write_sectors(void *context, uint32_t lba, uint32_t count, const void *buffer)
+{
+    struct block_request request = { lba, count, const_cast<void *>(buffer), 1 };
+
+    (void)context;
+    return transfer(request);
+}
+
+int linux_uring_sync(void *context)
+{
+    (void)context;
+    return fdatasync(image_fd);
+}
+
+int linux_uring_start_batch(void *context, struct block_request *requests, uint32_t count)
+{
+    (void)context;
+
+    if (!linux_uring_is_active()) {
+        pool_start(requests, count);
+        return 0;
+    }
+
+    batch.requests = requests;
+    batch.count = count;
+    batch.next = 0;
+    batch.in_flight_count = 0;
+    batch.has_failed = false;
+
+    return uring_submit_next();
+}
+
+int linux_uring_poll_batch(void *context)
+{
+    (void)context;
+
+    if (!linux_uring_is_active())
+        return pool_progress(false);
+
+    return uring_progress(false);
+}
+
+int linux_uring_submit_batch(void *context, struct block_request *requests, uint32_t count)
+{
+    if (linux_uring_start_batch(context, requests, count) < 0)
+        return -1;
+
+    if (!linux_uring_is_active())
+        return pool_progress(true) < 0 ? -1 : 0;
+
+    return uring_progress(true) < 0 ? -1 : 0;
+}
+
+struct block_dev_t linux_uring_dev = {
+    URING_SECTOR_SIZE,
+    linux_uring_read_sectors,
+    linux_uring_write_sectors,
+    NULL,
+    linux_uring_sync,
+    linux_uring_submit_batch,
+    linux_uring_start_batch,
+    linux_uring_poll_batch,
+    NULL
+};
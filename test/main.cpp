@@ -24,10 +24,28 @@
 #include <vector>
 #include "../driver/fat16.h"
 #include "AppendSmallFileTest.hpp"
+#include "AsyncTest.hpp"
+#include "DentryCacheTest.hpp"
+#include "EvictionTest.hpp"
+#include "FallocateTest.hpp"
+#include "FatMirrorTest.hpp"
 #include "FilenameTest.hpp"
+#include "FlushTest.hpp"
+#include "FullVolumeTest.hpp"
+#include "OpenFileTest.hpp"
+#include "PathCacheTest.hpp"
+#include "PositionalIoTest.hpp"
+#include "ReadaheadTest.hpp"
+#include "ReaddirBatchTest.hpp"
+#include "ReaddirTest.hpp"
 #include "ReadEmptyFileTest.hpp"
 #include "ReadSmallFileTest.hpp"
+#include "ReadViewTest.hpp"
 #include "RmdirTest.hpp"
+#include "SeekTest.hpp"
+#include "ThreadTest.hpp"
+#include "VectorIoTest.hpp"
+#include "VolumeTest.hpp"
 #include "WriteEraseContentTest.hpp"
 #include "WriteSmallFileTest.hpp"
 #include "WriteLargeFileTest.hpp"
@@ -85,8 +103,31 @@ int main()
     tests.push_back(new LsTest("/DATA", 512));
     tests.push_back(new LsTest("/DATA", 2048));
     tests.push_back(new LsTest("/IMAGES/PNG", 2048));
+    tests.push_back(new ReaddirTest("/", 0));
+    tests.push_back(new ReaddirTest("/", 511));
+    tests.push_back(new ReaddirTest("/DATA", 0));
+    tests.push_back(new ReaddirTest("/DATA", 2048));
+    tests.push_back(new ReaddirBatchTest());
     tests.push_back(new MkdirTest());
     tests.push_back(new RmdirTest());
+    tests.push_back(new FallocateTest());
+    tests.push_back(new SeekTest());
+    tests.push_back(new PositionalIoTest());
+    tests.push_back(new ReadViewTest());
+    tests.push_back(new ReadaheadTest());
+    tests.push_back(new VectorIoTest());
+    tests.push_back(new AsyncTest());
+    tests.push_back(new FlushTest());
+    tests.push_back(new FatMirrorTest());
+    tests.push_back(new EvictionTest());
+    tests.push_back(new FullVolumeTest());
+    tests.push_back(new VolumeTest());
+    tests.push_back(new OpenFileTest());
+    tests.push_back(new DentryCacheTest());
+    tests.push_back(new PathCacheTest());
+#ifdef FAT16_THREAD_SAFE
+    tests.push_back(new ThreadTest());
+#endif
 
     /* Ensure that we start with a clean image */
     unmount_image();